@@ -0,0 +1,66 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <random.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static const size_t BLOCK_TXS = 2000;
+static const size_t MISSING_TXS = 10;
+
+static void AddTx(const CTransactionRef& tx, CTxMemPool& pool)
+{
+    LockPoints lp;
+    pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000, 0, 1, false, 4, lp));
+}
+
+// Initializing a compact block of BLOCK_TXS transactions from a mempool of
+// nMempoolTxs. A few of the block's transactions are not in the mempool,
+// so the whole mempool gets scanned, as it usually does.
+static void CompactBlockReconstruction(benchmark::State& state, size_t nMempoolTxs)
+{
+    FastRandomContext insecure_rand(true);
+    CTxMemPool pool;
+    CBlock block;
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = COIN;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    for (size_t i = 0; i < MISSING_TXS + nMempoolTxs; i++) {
+        tx.vin[0].prevout = COutPoint(insecure_rand.rand256(), 0);
+        CTransactionRef ptx = MakeTransactionRef(tx);
+        if (i >= MISSING_TXS)
+            AddTx(ptx, pool);
+        if (block.vtx.size() < BLOCK_TXS)
+            block.vtx.push_back(ptx);
+    }
+
+    const CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+    const std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partialBlock(&pool);
+        assert(partialBlock.InitData(cmpctblock, extra_txn) == READ_STATUS_OK);
+    }
+}
+
+static void CompactBlockReconstruction5k(benchmark::State& state)
+{
+    CompactBlockReconstruction(state, 5000);
+}
+
+static void CompactBlockReconstruction50k(benchmark::State& state)
+{
+    CompactBlockReconstruction(state, 50000);
+}
+
+BENCHMARK(CompactBlockReconstruction5k, 1000);
+BENCHMARK(CompactBlockReconstruction50k, 100);
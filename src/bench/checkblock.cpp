@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 
 #include <chainparams.h>
+#include <primitives/blockview.h>
 #include <validation.h>
 #include <streams.h>
 #include <consensus/validation.h>
@@ -35,6 +36,20 @@ static void DeserializeBlockTest(benchmark::State& state)
     }
 }
 
+// Walking the block's transactions and their txids without deserializing it
+static void BlockViewTest(benchmark::State& state)
+{
+    const unsigned char* begin = block_bench::block413567;
+    const unsigned char* end = begin + sizeof(block_bench::block413567);
+
+    while (state.KeepRunning()) {
+        CBlockView block(begin, end);
+        for (const CTxView& tx : block.Transactions()) {
+            tx.GetHash();
+        }
+    }
+}
+
 static void DeserializeAndCheckBlockTest(benchmark::State& state)
 {
     CDataStream stream((const char*)block_bench::block413567,
@@ -56,4 +71,5 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
 }
 
 BENCHMARK(DeserializeBlockTest, 130);
+BENCHMARK(BlockViewTest, 130);
 BENCHMARK(DeserializeAndCheckBlockTest, 160);
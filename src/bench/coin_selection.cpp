@@ -57,3 +57,44 @@ static void CoinSelection(benchmark::State& state)
 }
 
 BENCHMARK(CoinSelection, 650);
+
+// Wallets with many UTXOs with values spread over several orders of
+// magnitude. The coins are built once per run; only the selection itself is
+// measured.
+static void CoinSelectionLargeWallet(benchmark::State& state, int nCoins, const CAmount& nMaxExcess)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    vCoins.reserve(nCoins);
+    LOCK(wallet.cs_wallet);
+
+    static const CAmount scale[] = {10000, 100000, 1000000, 10000000};
+    for (int i = 0; i < nCoins; i++)
+        addCoin((1 + (int64_t)i * 7919 % 1000) * scale[i % 4], wallet, vCoins);
+
+    const CAmount nTarget = 50 * COIN - 1234;
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(nTarget, 1, 6, 0, vCoins, setCoinsRet, nValueRet, nMaxExcess);
+        assert(success);
+        assert(nValueRet >= nTarget);
+    }
+
+    for (COutput output : vCoins)
+        delete output.tx;
+}
+
+static void CoinSelectionBnB10k(benchmark::State& state) { CoinSelectionLargeWallet(state, 10000, 3000); }
+static void CoinSelectionBnB100k(benchmark::State& state) { CoinSelectionLargeWallet(state, 100000, 3000); }
+static void CoinSelectionBnB1M(benchmark::State& state) { CoinSelectionLargeWallet(state, 1000000, 3000); }
+static void CoinSelectionKnapsack10k(benchmark::State& state) { CoinSelectionLargeWallet(state, 10000, 0); }
+static void CoinSelectionKnapsack100k(benchmark::State& state) { CoinSelectionLargeWallet(state, 100000, 0); }
+static void CoinSelectionKnapsack1M(benchmark::State& state) { CoinSelectionLargeWallet(state, 1000000, 0); }
+
+BENCHMARK(CoinSelectionBnB10k, 20);
+BENCHMARK(CoinSelectionBnB100k, 3);
+BENCHMARK(CoinSelectionBnB1M, 1);
+BENCHMARK(CoinSelectionKnapsack10k, 20);
+BENCHMARK(CoinSelectionKnapsack100k, 3);
+BENCHMARK(CoinSelectionKnapsack1M, 1);
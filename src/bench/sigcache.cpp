@@ -0,0 +1,87 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <checkqueue.h>
+#include <random.h>
+#include <script/sigcache.h>
+#include <util.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <vector>
+
+static const int MIN_CORES = 2;
+static const size_t CACHE_BYTES = 32 << 20;
+static const size_t LOOKUPS = 4000;
+static const unsigned int QUEUE_BATCH_SIZE = 128;
+
+// Signature cache lookups from the script check threads (-par), as when
+// connecting a block whose signatures were all seen in the mempool. With
+// fInsert, every eighth check misses and inserts instead, as when
+// accepting new transactions alongside block validation.
+static void SigCacheConcurrent(benchmark::State& state, bool fInsert)
+{
+    struct SigCacheJob {
+        CShardedSignatureCache* cache = nullptr;
+        uint256 entry;
+        bool fInsert = false;
+        bool operator()()
+        {
+            if (fInsert) {
+                cache->insert(entry);
+            } else {
+                cache->contains(entry, false);
+            }
+            return true;
+        }
+        void swap(SigCacheJob& x)
+        {
+            std::swap(cache, x.cache);
+            std::swap(entry, x.entry);
+            std::swap(fInsert, x.fInsert);
+        }
+    };
+
+    CShardedSignatureCache cache;
+    cache.setup_bytes(CACHE_BYTES);
+    FastRandomContext insecure_rand(true);
+    std::vector<uint256> entries(LOOKUPS);
+    for (uint256& entry : entries) {
+        entry = insecure_rand.rand256();
+        cache.insert(entry);
+    }
+
+    CCheckQueue<SigCacheJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<SigCacheJob> control(&queue);
+        std::vector<SigCacheJob> vChecks(entries.size());
+        for (size_t i = 0; i < entries.size(); i++) {
+            vChecks[i].cache = &cache;
+            vChecks[i].fInsert = fInsert && i % 8 == 0;
+            vChecks[i].entry = vChecks[i].fInsert ? insecure_rand.rand256() : entries[i];
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void SigCacheConcurrentLookup(benchmark::State& state)
+{
+    SigCacheConcurrent(state, false);
+}
+
+static void SigCacheConcurrentLookupInsert(benchmark::State& state)
+{
+    SigCacheConcurrent(state, true);
+}
+
+BENCHMARK(SigCacheConcurrentLookup, 200);
+BENCHMARK(SigCacheConcurrentLookupInsert, 200);
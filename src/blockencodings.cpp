@@ -13,7 +13,7 @@
 #include <validation.h>
 #include <util.h>
 
-#include <unordered_map>
+#include <limits>
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
@@ -43,6 +43,85 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256* const txhashes[4], uint64_t shortids[4]) const {
+    SipHashUint256x4(shorttxidk0, shorttxidk1, txhashes, shortids);
+    for (int i = 0; i < 4; i++)
+        shortids[i] &= 0xffffffffffffL;
+}
+
+namespace {
+/**
+ * Map from short IDs to block positions, kept in a flat open-addressed
+ * table at most half full so that looking up every mempool transaction is
+ * a few cache lines each. Short IDs are picked by the peer sending the
+ * block, so slots are chosen by a salted hash of them.
+ */
+class ShortTxIDTable
+{
+public:
+    //! Short IDs are only 48 bits
+    static const uint64_t EMPTY = std::numeric_limits<uint64_t>::max();
+    //! Longest probe sequence accepted on insertion
+    static const size_t MAX_PROBES = 64;
+
+    explicit ShortTxIDTable(size_t nIDs) : m_count(0), m_salt(GetRand(std::numeric_limits<uint64_t>::max()) | 1), m_shift(60)
+    {
+        size_t nSlots = 16;
+        while (nSlots < 2 * nIDs) {
+            nSlots <<= 1;
+            m_shift--;
+        }
+        m_slots.assign(nSlots, Slot{EMPTY, 0});
+    }
+
+    /** Returns false if the short ID is present already or took too long to place */
+    bool Insert(uint64_t shortid, uint16_t pos)
+    {
+        size_t i = Index(shortid);
+        for (size_t nProbes = 0; nProbes < MAX_PROBES; nProbes++) {
+            Slot& slot = m_slots[i];
+            if (slot.shortid == EMPTY) {
+                slot = Slot{shortid, pos};
+                m_count++;
+                return true;
+            }
+            if (slot.shortid == shortid)
+                return false;
+            i = (i + 1) & (m_slots.size() - 1);
+        }
+        return false;
+    }
+
+    /** The block position of a short ID, or -1 */
+    int Find(uint64_t shortid) const
+    {
+        // Never full, so there is always an empty slot to stop at
+        for (size_t i = Index(shortid); ; i = (i + 1) & (m_slots.size() - 1)) {
+            const Slot& slot = m_slots[i];
+            if (slot.shortid == shortid)
+                return slot.pos;
+            if (slot.shortid == EMPTY)
+                return -1;
+        }
+    }
+
+    size_t size() const { return m_count; }
+
+private:
+    struct Slot {
+        uint64_t shortid;
+        uint16_t pos;
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_count;
+    const uint64_t m_salt;
+    int m_shift;
+
+    size_t Index(uint64_t shortid) const { return (shortid * m_salt) >> m_shift; }
+};
+} // namespace
+
 
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
@@ -77,48 +156,47 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     // Because well-formed cmpctblock messages will have a (relatively) uniform distribution
     // of short IDs, any highly-uneven distribution of elements can be safely treated as a
     // READ_STATUS_FAILED.
-    std::unordered_map<uint64_t, uint16_t> shorttxids(cmpctblock.shorttxids.size());
+    ShortTxIDTable shorttxids(cmpctblock.shorttxids.size());
     uint16_t index_offset = 0;
     for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
         while (txn_available[i + index_offset])
             index_offset++;
-        shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
-        // To determine the chance that the number of entries in a bucket exceeds N,
-        // we use the fact that the number of elements in a single bucket is
-        // binomially distributed (with n = the number of shorttxids S, and p =
-        // 1 / the number of buckets), that in the worst case the number of buckets is
-        // equal to S (due to std::unordered_map having a default load factor of 1.0),
-        // and that the chance for any bucket to exceed N elements is at most
-        // buckets * (the chance that any given bucket is above N elements).
-        // Thus: P(max_elements_per_bucket > N) <= S * (1 - cdf(binomial(n=S,p=1/S), N)).
-        // If we assume blocks of up to 16000, allowing 12 elements per bucket should
-        // only fail once per ~1 million block transfers (per peer and connection).
-        if (shorttxids.bucket_size(shorttxids.bucket(cmpctblock.shorttxids[i])) > 12)
-            return READ_STATUS_FAILED;
+        // With the table at most half full, a run of MAX_PROBES occupied
+        // slots is vanishingly unlikely for uniformly distributed short IDs.
+        // TODO: in the shortid-collision case, we should instead request both transactions
+        // which collided. Falling back to full-block-request here is overkill.
+        if (!shorttxids.Insert(cmpctblock.shorttxids[i], i + index_offset))
+            return READ_STATUS_FAILED; // Short ID collision or uneven distribution
     }
-    // TODO: in the shortid-collision case, we should instead request both transactions
-    // which collided. Falling back to full-block-request here is overkill.
-    if (shorttxids.size() != cmpctblock.shorttxids.size())
-        return READ_STATUS_FAILED; // Short ID collision
 
     std::vector<bool> have_txn(txn_available.size());
     {
     LOCK(pool->cs);
     const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
+    uint64_t shortids[4];
     for (size_t i = 0; i < vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
-                have_txn[idit->second]  = true;
+        // Short IDs are computed four at a time
+        if (i % 4 == 0) {
+            if (vTxHashes.size() - i >= 4) {
+                const uint256* txhashes[4] = {&vTxHashes[i].first, &vTxHashes[i + 1].first, &vTxHashes[i + 2].first, &vTxHashes[i + 3].first};
+                cmpctblock.GetShortIDs(txhashes, shortids);
+            } else {
+                for (size_t j = i; j < vTxHashes.size(); j++)
+                    shortids[j - i] = cmpctblock.GetShortID(vTxHashes[j].first);
+            }
+        }
+        int pos = shorttxids.Find(shortids[i % 4]);
+        if (pos >= 0) {
+            if (!have_txn[pos]) {
+                txn_available[pos] = vTxHashes[i].second->GetSharedTx();
+                have_txn[pos]  = true;
                 mempool_count++;
             } else {
                 // If we find two mempool txn that match the short id, just request it.
                 // This should be rare enough that the extra bandwidth doesn't matter,
                 // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
-                    txn_available[idit->second].reset();
+                if (txn_available[pos]) {
+                    txn_available[pos].reset();
                     mempool_count--;
                 }
             }
@@ -132,12 +210,11 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     }
 
     for (size_t i = 0; i < extra_txn.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = extra_txn[i].second;
-                have_txn[idit->second]  = true;
+        int pos = shorttxids.Find(cmpctblock.GetShortID(extra_txn[i].first));
+        if (pos >= 0) {
+            if (!have_txn[pos]) {
+                txn_available[pos] = extra_txn[i].second;
+                have_txn[pos]  = true;
                 mempool_count++;
                 extra_count++;
             } else {
@@ -147,9 +224,9 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
                 // but eating a round-trip due to FillBlock failure would be annoying
                 // Note that we don't want duplication between extra_txn and mempool to
                 // trigger this case, so we compare witness hashes first
-                if (txn_available[idit->second] &&
-                        txn_available[idit->second]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
-                    txn_available[idit->second].reset();
+                if (txn_available[pos] &&
+                        txn_available[pos]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
+                    txn_available[pos].reset();
                     mempool_count--;
                     extra_count--;
                 }
@@ -151,6 +151,8 @@ public:
     CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
 
     uint64_t GetShortID(const uint256& txhash) const;
+    /** GetShortID for four hashes at once */
+    void GetShortIDs(const uint256* const txhashes[4], uint64_t shortids[4]) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
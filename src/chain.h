@@ -160,6 +160,7 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+    BLOCK_STORED_COMPRESSED =   256, //!< block data in blk*.dat is stored compressed (-compressblocks)
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -19,6 +19,21 @@ bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
     return GetCoin(outpoint, coin);
 }
 
+size_t CCoinsView::GetCoins(const std::vector<COutPoint> &outpoints, std::vector<Coin> &coins) const
+{
+    size_t nFound = 0;
+    coins.clear();
+    coins.resize(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        if (GetCoin(outpoints[i], coins[i]) && !coins[i].IsSpent()) {
+            nFound++;
+        } else {
+            coins[i].Clear();
+        }
+    }
+    return nFound;
+}
+
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 bool CCoinsViewBacked::GetCoin(const COutPoint &outpoint, Coin &coin) const { return base->GetCoin(outpoint, coin); }
 bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->HaveCoin(outpoint); }
@@ -54,6 +69,43 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
     return ret;
 }
 
+void CCoinsViewCache::FetchCoins(const std::vector<COutPoint> &outpoints) const {
+    std::vector<COutPoint> missing;
+    for (const COutPoint &outpoint : outpoints) {
+        if (!cacheCoins.count(outpoint))
+            missing.push_back(outpoint);
+    }
+    if (missing.empty())
+        return;
+
+    std::vector<Coin> coins;
+    base->GetCoins(missing, coins);
+    for (size_t i = 0; i < missing.size(); i++) {
+        if (coins[i].IsSpent())
+            continue;
+        CCoinsMap::iterator it;
+        bool inserted;
+        std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(missing[i]), std::forward_as_tuple(std::move(coins[i])));
+        if (inserted)
+            cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    }
+}
+
+size_t CCoinsViewCache::GetCoins(const std::vector<COutPoint> &outpoints, std::vector<Coin> &coins) const {
+    FetchCoins(outpoints);
+    size_t nFound = 0;
+    coins.clear();
+    coins.resize(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        CCoinsMap::const_iterator it = cacheCoins.find(outpoints[i]);
+        if (it != cacheCoins.end() && !it->second.coin.IsSpent()) {
+            coins[i] = it->second.coin;
+            nFound++;
+        }
+    }
+    return nFound;
+}
+
 bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it != cacheCoins.end()) {
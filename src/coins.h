@@ -151,6 +151,12 @@ public:
      */
     virtual bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
 
+    /** Retrieve the Coins for many outpoints at once. coins[i] receives the
+     *  unspent coin for outpoints[i], or is left spent when there is none.
+     *  Returns the number of unspent coins found.
+     */
+    virtual size_t GetCoins(const std::vector<COutPoint> &outpoints, std::vector<Coin> &coins) const;
+
     //! Just check whether a given outpoint is unspent.
     virtual bool HaveCoin(const COutPoint &outpoint) const;
 
@@ -221,6 +227,7 @@ public:
 
     // Standard CCoinsView methods
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    size_t GetCoins(const std::vector<COutPoint> &outpoints, std::vector<Coin> &coins) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
@@ -236,6 +243,13 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Load the given outpoints that are not in this cache yet from the
+     * backing view, with a single GetCoins() call, so that later lookups of
+     * them are served from memory.
+     */
+    void FetchCoins(const std::vector<COutPoint> &outpoints) const;
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
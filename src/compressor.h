@@ -6,6 +6,8 @@
 #ifndef BITCOIN_COMPRESSOR_H
 #define BITCOIN_COMPRESSOR_H
 
+#include <consensus/consensus.h>
+#include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
 #include <serialize.h>
@@ -24,6 +26,9 @@ class CScriptID;
  *
  *  Other scripts up to 121 bytes require 1 byte + script length. Above
  *  that, scripts up to 16505 bytes require 2 bytes + script length.
+ *
+ *  Scripts longer than MAX_SCRIPT_SIZE are unspendable, and are read back
+ *  as a single OP_RETURN unless fKeepLarge is set.
  */
 class CScriptCompressor
 {
@@ -37,6 +42,7 @@ private:
     static const unsigned int nSpecialScripts = 6;
 
     CScript &script;
+    const bool fKeepLarge;
 protected:
     /**
      * These check for scripts for which a special case with a shorter encoding is defined.
@@ -53,7 +59,7 @@ protected:
     unsigned int GetSpecialSize(unsigned int nSize) const;
     bool Decompress(unsigned int nSize, const std::vector<unsigned char> &out);
 public:
-    explicit CScriptCompressor(CScript &scriptIn) : script(scriptIn) { }
+    explicit CScriptCompressor(CScript &scriptIn, bool fKeepLargeIn = false) : script(scriptIn), fKeepLarge(fKeepLargeIn) { }
 
     template<typename Stream>
     void Serialize(Stream &s) const {
@@ -78,11 +84,14 @@ public:
             return;
         }
         nSize -= nSpecialScripts;
-        if (nSize > MAX_SCRIPT_SIZE) {
+        if (nSize > MAX_SCRIPT_SIZE && !fKeepLarge) {
             // Overly long script, replace with a short invalid one
             script << OP_RETURN;
             s.ignore(nSize);
         } else {
+            if (nSize > MAX_BLOCK_SERIALIZED_SIZE) {
+                throw std::ios_base::failure("Script too large");
+            }
             script.resize(nSize);
             s >> REF(CFlatData(script));
         }
@@ -94,12 +103,13 @@ class CTxOutCompressor
 {
 private:
     CTxOut &txout;
+    const bool fKeepLarge;
 
 public:
     static uint64_t CompressAmount(uint64_t nAmount);
     static uint64_t DecompressAmount(uint64_t nAmount);
 
-    explicit CTxOutCompressor(CTxOut &txoutIn) : txout(txoutIn) { }
+    explicit CTxOutCompressor(CTxOut &txoutIn, bool fKeepLargeIn = false) : txout(txoutIn), fKeepLarge(fKeepLargeIn) { }
 
     ADD_SERIALIZE_METHODS;
 
@@ -113,9 +123,98 @@ public:
             READWRITE(VARINT(nVal));
             txout.nValue = DecompressAmount(nVal);
         }
-        CScriptCompressor cscript(REF(txout.scriptPubKey));
+        CScriptCompressor cscript(REF(txout.scriptPubKey), fKeepLarge);
         READWRITE(cscript);
     }
 };
 
+/** Compact serializer for transactions, used for blocks stored compressed in block files.
+ *
+ *  Inputs are stored as usual; outputs use CTxOutCompressor, keeping
+ *  scripts of any length so that the transaction reads back unchanged.
+ *  Witness data, if any, follows the outputs, with a flag byte ahead of the
+ *  inputs saying whether it is present.
+ */
+class CTxCompressor
+{
+private:
+    CTransactionRef &tx;
+
+public:
+    explicit CTxCompressor(CTransactionRef &txIn) : tx(txIn) { }
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        const CTransaction& txTo = *tx;
+        s << txTo.nVersion;
+        unsigned char flags = txTo.HasWitness() ? 1 : 0;
+        s << flags;
+        s << txTo.vin;
+        WriteCompactSize(s, txTo.vout.size());
+        for (const CTxOut& txout : txTo.vout) {
+            s << CTxOutCompressor(REF(txout), true);
+        }
+        if (flags & 1) {
+            for (const CTxIn& txin : txTo.vin) {
+                s << txin.scriptWitness.stack;
+            }
+        }
+        s << txTo.nLockTime;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        CMutableTransaction mtx;
+        s >> mtx.nVersion;
+        unsigned char flags = 0;
+        s >> flags;
+        if (flags & ~1) {
+            throw std::ios_base::failure("Unknown transaction optional data");
+        }
+        s >> mtx.vin;
+        uint64_t nOutputs = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nOutputs; i++) {
+            mtx.vout.emplace_back();
+            ::Unserialize(s, REF(CTxOutCompressor(mtx.vout.back(), true)));
+        }
+        if (flags & 1) {
+            for (CTxIn& txin : mtx.vin) {
+                s >> txin.scriptWitness.stack;
+            }
+        }
+        s >> mtx.nLockTime;
+        tx = MakeTransactionRef(std::move(mtx));
+    }
+};
+
+/** Compact serializer for blocks: the header followed by the transactions in CTxCompressor form. */
+class CBlockCompressor
+{
+private:
+    CBlock &block;
+
+public:
+    explicit CBlockCompressor(CBlock &blockIn) : block(blockIn) { }
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << static_cast<const CBlockHeader&>(block);
+        WriteCompactSize(s, block.vtx.size());
+        for (const CTransactionRef& tx : block.vtx) {
+            s << CTxCompressor(REF(tx));
+        }
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        s >> static_cast<CBlockHeader&>(block);
+        block.vtx.clear();
+        uint64_t nTransactions = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nTransactions; i++) {
+            block.vtx.emplace_back();
+            ::Unserialize(s, REF(CTxCompressor(block.vtx.back())));
+        }
+    }
+};
+
 #endif // BITCOIN_COMPRESSOR_H
@@ -6,13 +6,17 @@
 
 #include <memory>
 #include <random.h>
+#include <threadpool.h>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
 #include <memenv.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <algorithm>
+#include <mutex>
+#include <sstream>
 
 class CBitcoinLevelDBLogger : public leveldb::Logger {
 public:
@@ -72,14 +76,17 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBOptions& dboptions)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    // up to two write buffers may be held in memory simultaneously
+    options.write_buffer_size = dboptions.write_buffer_size ? dboptions.write_buffer_size : nCacheSize / 4;
+    options.filter_policy = dboptions.bloom_bits > 0 ? leveldb::NewBloomFilterPolicy(dboptions.bloom_bits) : nullptr;
+    options.compression = dboptions.compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.block_size = dboptions.block_size;
+    options.max_open_files = dboptions.max_open_files;
+    options.max_file_size = dboptions.max_file_size;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -89,14 +96,15 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const CDBOptions& dboptionsIn)
+    : dboptions(dboptionsIn)
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, dboptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -181,6 +189,77 @@ std::vector<unsigned char> CDBWrapper::CreateObfuscateKey() const
 
 }
 
+bool CDBWrapper::GetProperty(const std::string& property, std::string& value) const
+{
+    return pdb->GetProperty(property, &value);
+}
+
+std::vector<CDBLevelStats> CDBWrapper::GetLevelStats() const
+{
+    std::vector<CDBLevelStats> levels;
+    std::string value;
+    for (int level = 0; GetProperty(strprintf("leveldb.num-files-at-level%d", level), value); level++) {
+        levels.emplace_back();
+        levels.back().level = level;
+        levels.back().files = atoi(value);
+    }
+
+    // "leveldb.stats" has a row per level that has files or had compactions:
+    // level, files, size, compaction time, compaction read and write totals.
+    if (GetProperty("leveldb.stats", value)) {
+        std::istringstream stats(value);
+        std::string line;
+        while (std::getline(stats, line)) {
+            CDBLevelStats row;
+            if (sscanf(line.c_str(), "%d %d %lf %lf %lf %lf", &row.level, &row.files, &row.size_mb, &row.compaction_sec, &row.read_mb, &row.write_mb) == 6 &&
+                row.level >= 0 && row.level < (int)levels.size()) {
+                levels[row.level] = row;
+            }
+        }
+    }
+    return levels;
+}
+
+void CDBWrapper::ReadManyRaw(const std::vector<CDataStream>& vKeys, std::vector<std::string>& vValues, std::vector<char>& vFound) const
+{
+    vValues.clear();
+    vValues.resize(vKeys.size());
+    vFound.assign(vKeys.size(), false);
+
+    // Visit the keys in the order LevelDB stores them, so that neighbouring
+    // lookups share table blocks and each thread works on its own key range.
+    std::vector<size_t> vOrder(vKeys.size());
+    for (size_t i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+    std::sort(vOrder.begin(), vOrder.end(), [&vKeys](size_t a, size_t b) {
+        return leveldb::Slice(vKeys[a].data(), vKeys[a].size()).compare(leveldb::Slice(vKeys[b].data(), vKeys[b].size())) < 0;
+    });
+
+    std::mutex cs_error;
+    leveldb::Status error;
+    const size_t nChunks = (vOrder.size() + DBWRAPPER_KEYS_PER_READ_THREAD - 1) / DBWRAPPER_KEYS_PER_READ_THREAD;
+    ParallelFor(nChunks, std::min(GetNumCores(), DBWRAPPER_MAX_READ_THREADS), [&](size_t nChunk) {
+        const size_t nStart = nChunk * DBWRAPPER_KEYS_PER_READ_THREAD;
+        const size_t nEnd = std::min(vOrder.size(), nStart + DBWRAPPER_KEYS_PER_READ_THREAD);
+        for (size_t n = nStart; n < nEnd; n++) {
+            const size_t i = vOrder[n];
+            leveldb::Status status = pdb->Get(readoptions, leveldb::Slice(vKeys[i].data(), vKeys[i].size()), &vValues[i]);
+            if (status.ok()) {
+                vFound[i] = true;
+            } else if (!status.IsNotFound()) {
+                std::lock_guard<std::mutex> lock(cs_error);
+                if (error.ok())
+                    error = status;
+            }
+        }
+    });
+
+    if (!error.ok()) {
+        LogPrintf("LevelDB read failure: %s\n", error.ToString());
+        dbwrapper_private::HandleError(error);
+    }
+}
+
 bool CDBWrapper::IsEmpty()
 {
     std::unique_ptr<CDBIterator> it(NewIterator());
@@ -18,6 +18,10 @@
 
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
+/** Maximum number of threads a single ReadMany() call reads from */
+static const int DBWRAPPER_MAX_READ_THREADS = 8;
+/** Minimum number of keys a ReadMany() call gives each reading thread */
+static const size_t DBWRAPPER_KEYS_PER_READ_THREAD = 32;
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -27,6 +31,36 @@ public:
 
 class CDBWrapper;
 
+/**
+ * LevelDB tuning for one database. The defaults are the settings every
+ * database used before they could be set per database.
+ */
+struct CDBOptions
+{
+    //! approximate size of the blocks LevelDB reads and caches, in bytes
+    size_t block_size = 4 * 1024;
+    //! compress blocks with Snappy; the bundled LevelDB is built without it and stores them uncompressed
+    bool compression = false;
+    //! bloom filter bits per key, 0 to disable the filter
+    int bloom_bits = 10;
+    int max_open_files = 64;
+    //! size of the table files; larger files mean fewer but longer compactions
+    size_t max_file_size = 2 * 1024 * 1024;
+    //! memtable size at which it is compacted into level 0, 0 for a quarter of the cache size
+    size_t write_buffer_size = 0;
+};
+
+/** Size and compaction totals of one LevelDB level, as reported in its "leveldb.stats" property */
+struct CDBLevelStats
+{
+    int level = 0;
+    int files = 0;
+    double size_mb = 0;
+    double compaction_sec = 0;
+    double read_mb = 0;
+    double write_mb = 0;
+};
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -183,6 +217,9 @@ private:
     //! database options used
     leveldb::Options options;
 
+    //! tuning the options were built from
+    CDBOptions dboptions;
+
     //! options used when reading from the database
     leveldb::ReadOptions readoptions;
 
@@ -209,6 +246,9 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! Look up serialized keys for ReadMany(), leaving the raw values in vValues
+    void ReadManyRaw(const std::vector<CDataStream>& vKeys, std::vector<std::string>& vValues, std::vector<char>& vFound) const;
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -217,10 +257,19 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] dboptions   LevelDB tuning for this database.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const CDBOptions& dboptions = CDBOptions());
     ~CDBWrapper();
 
+    const CDBOptions& GetDBOptions() const { return dboptions; }
+
+    //! Read a LevelDB property such as "leveldb.stats" (see leveldb/db.h)
+    bool GetProperty(const std::string& property, std::string& value) const;
+
+    //! Per-level file counts, sizes and compaction totals
+    std::vector<CDBLevelStats> GetLevelStats() const;
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
@@ -247,6 +296,46 @@ public:
         return true;
     }
 
+    /**
+     * Read the values for many keys at once. The keys are looked up in
+     * database order, split over several threads for large batches.
+     * values[i] and found[i] receive the value of keys[i] and whether it was
+     * present; values that are absent or fail to deserialize are left
+     * default constructed. Returns the number of values found.
+     */
+    template <typename K, typename V>
+    size_t ReadMany(const std::vector<K>& keys, std::vector<V>& values, std::vector<char>& found) const
+    {
+        std::vector<CDataStream> vKeys;
+        vKeys.reserve(keys.size());
+        for (const K& key : keys) {
+            vKeys.emplace_back(SER_DISK, CLIENT_VERSION);
+            vKeys.back().reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+            vKeys.back() << key;
+        }
+
+        std::vector<std::string> vValues;
+        ReadManyRaw(vKeys, vValues, found);
+
+        size_t nFound = 0;
+        values.clear();
+        values.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (!found[i])
+                continue;
+            try {
+                CDataStream ssValue(vValues[i].data(), vValues[i].data() + vValues[i].size(), SER_DISK, CLIENT_VERSION);
+                ssValue.Xor(obfuscate_key);
+                ssValue >> values[i];
+                nFound++;
+            } catch (const std::exception&) {
+                found[i] = false;
+                values[i] = V();
+            }
+        }
+        return nFound;
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
@@ -205,6 +205,57 @@ uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val)
     return v0 ^ v1 ^ v2 ^ v3;
 }
 
+#define SIPROUND_X4 do { \
+    for (int l = 0; l < 4; l++) { \
+        v0[l] += v1[l]; v1[l] = ROTL(v1[l], 13); v1[l] ^= v0[l]; \
+        v0[l] = ROTL(v0[l], 32); \
+        v2[l] += v3[l]; v3[l] = ROTL(v3[l], 16); v3[l] ^= v2[l]; \
+        v0[l] += v3[l]; v3[l] = ROTL(v3[l], 21); v3[l] ^= v0[l]; \
+        v2[l] += v1[l]; v1[l] = ROTL(v1[l], 17); v1[l] ^= v2[l]; \
+        v2[l] = ROTL(v2[l], 32); \
+    } \
+} while (0)
+
+void SipHashUint256x4(uint64_t k0, uint64_t k1, const uint256* const vals[4], uint64_t out[4])
+{
+    /* SipHashUint256 with the state of each computation in its own lane */
+    uint64_t v0[4], v1[4], v2[4], v3[4], d[4];
+
+    for (int l = 0; l < 4; l++) {
+        v0[l] = 0x736f6d6570736575ULL ^ k0;
+        v1[l] = 0x646f72616e646f6dULL ^ k1;
+        v2[l] = 0x6c7967656e657261ULL ^ k0;
+        v3[l] = 0x7465646279746573ULL ^ k1;
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int l = 0; l < 4; l++) {
+            d[l] = vals[l]->GetUint64(i);
+            v3[l] ^= d[l];
+        }
+        SIPROUND_X4;
+        SIPROUND_X4;
+        for (int l = 0; l < 4; l++) {
+            v0[l] ^= d[l];
+        }
+    }
+    for (int l = 0; l < 4; l++) {
+        v3[l] ^= ((uint64_t)4) << 59;
+    }
+    SIPROUND_X4;
+    SIPROUND_X4;
+    for (int l = 0; l < 4; l++) {
+        v0[l] ^= ((uint64_t)4) << 59;
+        v2[l] ^= 0xFF;
+    }
+    SIPROUND_X4;
+    SIPROUND_X4;
+    SIPROUND_X4;
+    SIPROUND_X4;
+    for (int l = 0; l < 4; l++) {
+        out[l] = v0[l] ^ v1[l] ^ v2[l] ^ v3[l];
+    }
+}
+
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra)
 {
     /* Specialized implementation for efficiency */
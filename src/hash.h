@@ -227,6 +227,9 @@ public:
  *      .Finalize()
  */
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
+/** SipHashUint256 of four values at once. The four computations are
+ *  interleaved, so that their dependency chains overlap. */
+void SipHashUint256x4(uint64_t k0, uint64_t k1, const uint256* const vals[4], uint64_t out[4]);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
 #endif // BITCOIN_HASH_H
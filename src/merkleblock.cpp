@@ -7,6 +7,7 @@
 
 #include <hash.h>
 #include <consensus/consensus.h>
+#include <primitives/blockview.h>
 #include <utilstrencodings.h>
 
 
@@ -37,6 +38,25 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std:
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+CMerkleBlock::CMerkleBlock(const CBlockView& block, const std::set<uint256>& txids)
+{
+    header = block.GetHeader();
+
+    std::vector<bool> vMatch;
+    std::vector<uint256> vHashes;
+
+    vMatch.reserve(block.Transactions().size());
+    vHashes.reserve(block.Transactions().size());
+
+    for (const CTxView& tx : block.Transactions()) {
+        const uint256& hash = tx.GetHash();
+        vMatch.push_back(txids.count(hash) > 0);
+        vHashes.push_back(hash);
+    }
+
+    txn = CPartialMerkleTree(vHashes, vMatch);
+}
+
 uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid) {
     //we can never have zero txs in a merkle block, we always need the coinbase tx
     //if we do not have this assert, we can hit a memory access violation when indexing into vTxid
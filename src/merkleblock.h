@@ -13,6 +13,8 @@
 
 #include <vector>
 
+class CBlockView;
+
 /** Data structure that represents a partial merkle tree.
  *
  * It represents a subset of the txid's of a known block, in a way that
@@ -155,6 +157,9 @@ public:
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids) : CMerkleBlock(block, nullptr, &txids) { }
 
+    // Create from a serialized block, matching the txids in the set
+    CMerkleBlock(const CBlockView& block, const std::set<uint256>& txids);
+
     CMerkleBlock() {}
 
     ADD_SERIALIZE_METHODS;
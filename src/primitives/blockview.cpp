@@ -0,0 +1,155 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/blockview.h>
+
+#include <hash.h>
+#include <streams.h>
+#include <version.h>
+
+static void SkipScript(CByteReader& s)
+{
+    s.ignore(ReadCompactSize(s));
+}
+
+static void SkipInputs(CByteReader& s, uint64_t nCount)
+{
+    for (uint64_t i = 0; i < nCount; i++) {
+        s.ignore(36); // prevout
+        SkipScript(s);
+        s.ignore(4); // nSequence
+    }
+}
+
+static void SkipOutputs(CByteReader& s, uint64_t nCount)
+{
+    for (uint64_t i = 0; i < nCount; i++) {
+        s.ignore(8); // nValue
+        SkipScript(s);
+    }
+}
+
+// Mirrors UnserializeTransaction for the witness serialization
+CTxView::CTxView(const unsigned char* pbegin, const unsigned char* pend) : m_begin(pbegin), m_extended(false), m_witness(false), m_hash_set(false)
+{
+    CByteReader s(SER_NETWORK, PROTOCOL_VERSION, pbegin, pend);
+    s.ignore(4); // nVersion
+    unsigned char flags = 0;
+    m_io_begin = s.data();
+    uint64_t nIn = ReadCompactSize(s);
+    uint64_t nOut = 0;
+    m_vin = m_vin_end = m_vout = m_vout_end = s.data();
+    if (nIn == 0) {
+        // We read a dummy or an empty vin
+        s >> flags;
+        if (flags != 0) {
+            m_io_begin = s.data();
+            nIn = ReadCompactSize(s);
+            m_vin = s.data();
+            SkipInputs(s, nIn);
+            m_vin_end = s.data();
+            nOut = ReadCompactSize(s);
+            m_vout = s.data();
+            SkipOutputs(s, nOut);
+        } else {
+            // An empty vin and vout serialize as the same bytes as the dummy
+            m_vout = s.data();
+        }
+    } else {
+        SkipInputs(s, nIn);
+        m_vin_end = s.data();
+        nOut = ReadCompactSize(s);
+        m_vout = s.data();
+        SkipOutputs(s, nOut);
+    }
+    m_vout_end = s.data();
+    if (flags & 1) {
+        // The witness flag is present
+        flags ^= 1;
+        m_extended = true;
+        for (uint64_t i = 0; i < nIn; i++) {
+            uint64_t nItems = ReadCompactSize(s);
+            m_witness |= nItems > 0;
+            for (uint64_t j = 0; j < nItems; j++) {
+                s.ignore(ReadCompactSize(s));
+            }
+        }
+    }
+    if (flags) {
+        throw std::ios_base::failure("Unknown transaction optional data");
+    }
+    s.ignore(4); // nLockTime
+    m_end = s.data();
+    m_nIn = nIn;
+    m_nOut = nOut;
+}
+
+const uint256& CTxView::GetHash() const
+{
+    if (!m_hash_set) {
+        if (m_extended) {
+            // The txid commits to the serialization without witness
+            CHashWriter ss(SER_GETHASH, 0);
+            ss.write((const char*)m_begin, 4);
+            ss.write((const char*)m_io_begin, m_vout_end - m_io_begin);
+            ss.write((const char*)m_end - 4, 4);
+            m_hash = ss.GetHash();
+        } else {
+            m_hash = Hash(m_begin, m_end);
+        }
+        m_hash_set = true;
+    }
+    return m_hash;
+}
+
+uint256 CTxView::GetWitnessHash() const
+{
+    // Without any witness CTransaction serializes the same as for its txid,
+    // even if these bytes carry an (empty) witness record
+    if (!m_witness) {
+        return GetHash();
+    }
+    return Hash(m_begin, m_end);
+}
+
+CTransactionRef CTxView::ToTransaction() const
+{
+    CByteReader s(SER_NETWORK, PROTOCOL_VERSION, m_begin, m_end);
+    CTransactionRef tx;
+    s >> tx;
+    return tx;
+}
+
+CBlockView::CBlockView(const unsigned char* pbegin, const unsigned char* pend) : m_begin(pbegin), m_end(pend)
+{
+    CByteReader s(SER_NETWORK, PROTOCOL_VERSION, pbegin, pend);
+    s.ignore(80); // header
+    uint64_t nTx = ReadCompactSize(s);
+    // Every transaction takes at least 10 bytes, so this cannot be abused
+    // to reserve much more than the block's own size
+    m_vtx.reserve(std::min<uint64_t>(nTx, s.size() / 10));
+    for (uint64_t i = 0; i < nTx; i++) {
+        m_vtx.emplace_back(s.data(), pend);
+        s.ignore(m_vtx.back().GetTotalSize());
+    }
+    if (!s.empty()) {
+        throw std::ios_base::failure("CBlockView: data after the block");
+    }
+}
+
+CBlockHeader CBlockView::GetHeader() const
+{
+    CByteReader s(SER_NETWORK, PROTOCOL_VERSION, m_begin, m_end);
+    CBlockHeader header;
+    s >> header;
+    return header;
+}
+
+CBlock CBlockView::ToBlock() const
+{
+    CByteReader s(SER_NETWORK, PROTOCOL_VERSION, m_begin, m_end);
+    CBlock block;
+    s >> block;
+    return block;
+}
@@ -0,0 +1,246 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PRIMITIVES_BLOCKVIEW_H
+#define BITCOIN_PRIMITIVES_BLOCKVIEW_H
+
+#include <amount.h>
+#include <crypto/common.h>
+#include <primitives/block.h>
+#include <script/script.h>
+#include <uint256.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * Read-only views over a serialized block and its transactions, for code
+ * that walks a block (rescans, proofs, serving it to peers) without needing
+ * to own it. Nothing is copied or allocated per transaction: the views
+ * point into the serialized bytes, which must outlive them. Blocks are
+ * checked to be well-formed when the view is created, so the accessors
+ * below do no bounds checking of their own.
+ */
+
+namespace blockview_detail {
+/** Decode a CompactSize that has already been validated */
+inline uint64_t DecodeCompactSize(const unsigned char*& p)
+{
+    unsigned char ch = *p++;
+    uint64_t n;
+    if (ch < 253) {
+        n = ch;
+    } else if (ch == 253) {
+        n = ReadLE16(p);
+        p += 2;
+    } else if (ch == 254) {
+        n = ReadLE32(p);
+        p += 4;
+    } else {
+        n = ReadLE64(p);
+        p += 8;
+    }
+    return n;
+}
+} // namespace blockview_detail
+
+/** A script inside serialized data */
+class CScriptView
+{
+public:
+    CScriptView(const unsigned char* pbegin, const unsigned char* pend) : m_begin(pbegin), m_end(pend) {}
+
+    const unsigned char* begin() const { return m_begin; }
+    const unsigned char* end() const { return m_end; }
+    size_t size() const { return m_end - m_begin; }
+    bool empty() const { return m_begin == m_end; }
+
+    CScript ToScript() const { return CScript(m_begin, m_end); }
+
+    bool operator==(const CScript& script) const
+    {
+        return script.size() == size() && std::equal(m_begin, m_end, script.begin());
+    }
+
+private:
+    const unsigned char* m_begin;
+    const unsigned char* m_end;
+};
+
+/** An input inside a serialized transaction */
+class CTxInView
+{
+public:
+    explicit CTxInView(const unsigned char* p) : m_ptr(p) {}
+
+    uint256 GetPrevHash() const
+    {
+        uint256 hash;
+        memcpy(hash.begin(), m_ptr, 32);
+        return hash;
+    }
+    uint32_t GetPrevIndex() const { return ReadLE32(m_ptr + 32); }
+    COutPoint GetPrevout() const { return COutPoint(GetPrevHash(), GetPrevIndex()); }
+    bool IsNullPrevout() const
+    {
+        return GetPrevIndex() == (uint32_t)-1 && std::all_of(m_ptr, m_ptr + 32, [](unsigned char c) { return c == 0; });
+    }
+    CScriptView GetScriptSig() const
+    {
+        const unsigned char* p = m_ptr + 36;
+        uint64_t nSize = blockview_detail::DecodeCompactSize(p);
+        return CScriptView(p, p + nSize);
+    }
+    uint32_t GetSequence() const { return ReadLE32(GetScriptSig().end()); }
+
+    const unsigned char* Begin() const { return m_ptr; }
+    /** Where the next input starts */
+    const unsigned char* End() const { return GetScriptSig().end() + 4; }
+
+private:
+    const unsigned char* m_ptr;
+};
+
+/** An output inside a serialized transaction */
+class CTxOutView
+{
+public:
+    explicit CTxOutView(const unsigned char* p) : m_ptr(p) {}
+
+    CAmount GetValue() const { return (CAmount)ReadLE64(m_ptr); }
+    CScriptView GetScriptPubKey() const
+    {
+        const unsigned char* p = m_ptr + 8;
+        uint64_t nSize = blockview_detail::DecodeCompactSize(p);
+        return CScriptView(p, p + nSize);
+    }
+    CTxOut ToTxOut() const { return CTxOut(GetValue(), GetScriptPubKey().ToScript()); }
+
+    const unsigned char* Begin() const { return m_ptr; }
+    /** Where the next output starts */
+    const unsigned char* End() const { return GetScriptPubKey().end(); }
+
+private:
+    const unsigned char* m_ptr;
+};
+
+/** Forward iteration over consecutive serialized inputs or outputs */
+template <typename T>
+class CViewRange
+{
+public:
+    class const_iterator : public std::iterator<std::forward_iterator_tag, T>
+    {
+    public:
+        explicit const_iterator(const unsigned char* p) : m_item(p) {}
+        const T& operator*() const { return m_item; }
+        const T* operator->() const { return &m_item; }
+        const_iterator& operator++() { m_item = T(m_item.End()); return *this; }
+        const_iterator operator++(int) { const_iterator ret = *this; ++*this; return ret; }
+        bool operator==(const const_iterator& other) const { return m_item.Begin() == other.m_item.Begin(); }
+        bool operator!=(const const_iterator& other) const { return m_item.Begin() != other.m_item.Begin(); }
+    private:
+        T m_item;
+    };
+
+    CViewRange(const unsigned char* pbegin, const unsigned char* pend, size_t nCount) : m_begin(pbegin), m_end(pend), m_count(nCount) {}
+
+    const_iterator begin() const { return const_iterator(m_begin); }
+    const_iterator end() const { return const_iterator(m_end); }
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+
+private:
+    const unsigned char* m_begin;
+    const unsigned char* m_end;
+    size_t m_count;
+};
+
+/**
+ * A transaction inside serialized data, in the format CTransaction is
+ * serialized with (with or without witness). Its txid is computed from the
+ * byte ranges the first time it is asked for.
+ */
+class CTxView
+{
+public:
+    /**
+     * Parse the transaction starting at pbegin, which may be followed by
+     * more data up to pend. Throws std::ios_base::failure where
+     * deserializing a CTransaction would.
+     */
+    CTxView(const unsigned char* pbegin, const unsigned char* pend);
+
+    /** The serialized transaction */
+    const unsigned char* begin() const { return m_begin; }
+    const unsigned char* end() const { return m_end; }
+    size_t GetTotalSize() const { return m_end - m_begin; }
+
+    int32_t GetVersion() const { return (int32_t)ReadLE32(m_begin); }
+    uint32_t GetLockTime() const { return ReadLE32(m_end - 4); }
+    bool HasWitness() const { return m_witness; }
+    bool IsCoinBase() const { return m_nIn == 1 && CTxInView(m_vin).IsNullPrevout(); }
+
+    CViewRange<CTxInView> Inputs() const { return CViewRange<CTxInView>(m_vin, m_vin_end, m_nIn); }
+    CViewRange<CTxOutView> Outputs() const { return CViewRange<CTxOutView>(m_vout, m_vout_end, m_nOut); }
+
+    const uint256& GetHash() const;
+    uint256 GetWitnessHash() const;
+
+    /** Deserialize the full transaction */
+    CTransactionRef ToTransaction() const;
+
+private:
+    const unsigned char* m_begin;
+    const unsigned char* m_end;
+    //! The input and output counts and lists, as serialized without witness
+    const unsigned char* m_io_begin;
+    const unsigned char* m_vin;
+    const unsigned char* m_vin_end;
+    const unsigned char* m_vout;
+    const unsigned char* m_vout_end;
+    size_t m_nIn;
+    size_t m_nOut;
+    //! Serialized with the witness marker and flag
+    bool m_extended;
+    //! Has a non-empty witness
+    bool m_witness;
+
+    mutable uint256 m_hash;
+    mutable bool m_hash_set;
+};
+
+/** A serialized block */
+class CBlockView
+{
+public:
+    /**
+     * Parse a block that takes up the whole range. Throws
+     * std::ios_base::failure where deserializing a CBlock would, or if
+     * there is data left over.
+     */
+    CBlockView(const unsigned char* pbegin, const unsigned char* pend);
+    explicit CBlockView(const std::vector<unsigned char>& vch) : CBlockView(vch.data(), vch.data() + vch.size()) {}
+
+    const unsigned char* begin() const { return m_begin; }
+    const unsigned char* end() const { return m_end; }
+
+    CBlockHeader GetHeader() const;
+    uint256 GetHash() const { return GetHeader().GetHash(); }
+
+    const std::vector<CTxView>& Transactions() const { return m_vtx; }
+
+    /** Deserialize the full block */
+    CBlock ToBlock() const;
+
+private:
+    const unsigned char* m_begin;
+    const unsigned char* m_end;
+    std::vector<CTxView> m_vtx;
+};
+
+#endif // BITCOIN_PRIMITIVES_BLOCKVIEW_H
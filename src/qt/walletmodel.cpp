@@ -140,17 +140,18 @@ void WalletModel::pollBalanceChanged()
 
 void WalletModel::checkBalanceChanged()
 {
-    CAmount newBalance = getBalance();
-    CAmount newUnconfirmedBalance = getUnconfirmedBalance();
-    CAmount newImmatureBalance = getImmatureBalance();
+    const CWalletBalance balances = wallet->GetBalances();
+    CAmount newBalance = balances.m_mine_trusted;
+    CAmount newUnconfirmedBalance = balances.m_mine_untrusted_pending;
+    CAmount newImmatureBalance = balances.m_mine_immature;
     CAmount newWatchOnlyBalance = 0;
     CAmount newWatchUnconfBalance = 0;
     CAmount newWatchImmatureBalance = 0;
     if (haveWatchOnly())
     {
-        newWatchOnlyBalance = getWatchBalance();
-        newWatchUnconfBalance = getWatchUnconfirmedBalance();
-        newWatchImmatureBalance = getWatchImmatureBalance();
+        newWatchOnlyBalance = balances.m_watchonly_trusted;
+        newWatchUnconfBalance = balances.m_watchonly_untrusted_pending;
+        newWatchImmatureBalance = balances.m_watchonly_immature;
     }
 
     if(cachedBalance != newBalance || cachedUnconfirmedBalance != newUnconfirmedBalance || cachedImmatureBalance != newImmatureBalance ||
@@ -49,6 +49,7 @@
 [[noreturn]] static void RandFailure()
 {
     LogPrintf("Failed to read randomness, aborting\n");
+    FlushLogWriter();
     std::abort();
 }
 
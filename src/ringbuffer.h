@@ -0,0 +1,92 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RINGBUFFER_H
+#define BITCOIN_RINGBUFFER_H
+
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A bounded queue that producers on any number of threads can push to
+ * without taking a lock or blocking; TryPush() fails instead when the
+ * buffer is full. Every slot carries a sequence number that says whether
+ * it is free for the producer or filled for the consumer (Dmitry Vyukov's
+ * bounded queue), so producers only contend on one atomic counter.
+ *
+ * TryPop() may be called by one thread at a time; callers with several
+ * consumers must serialize them.
+ */
+template <typename T>
+class CRingBuffer
+{
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    const size_t m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<size_t> m_push_pos;
+    size_t m_pop_pos;
+
+public:
+    //! nCapacity must be a power of two
+    explicit CRingBuffer(size_t nCapacity) : m_mask(nCapacity - 1), m_slots(new Slot[nCapacity]), m_push_pos(0), m_pop_pos(0)
+    {
+        assert(nCapacity >= 2 && (nCapacity & m_mask) == 0);
+        for (size_t i = 0; i < nCapacity; i++) {
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    CRingBuffer(const CRingBuffer&) = delete;
+    CRingBuffer& operator=(const CRingBuffer&) = delete;
+
+    size_t Capacity() const { return m_mask + 1; }
+
+    //! Append value, unless the buffer is full
+    bool TryPush(T&& value)
+    {
+        size_t pos = m_push_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &m_slots[pos & m_mask];
+            const intptr_t diff = (intptr_t)slot->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+            if (diff == 0) {
+                // The slot is free; claim it
+                if (m_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                // The slot still holds the value pushed one lap earlier
+                return false;
+            } else {
+                // Another producer claimed the slot first
+                pos = m_push_pos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = std::move(value);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! Take the oldest value, if there is one
+    bool TryPop(T& value)
+    {
+        Slot& slot = m_slots[m_pop_pos & m_mask];
+        if (slot.seq.load(std::memory_order_acquire) != m_pop_pos + 1) {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.value = T();
+        slot.seq.store(m_pop_pos + m_mask + 1, std::memory_order_release);
+        m_pop_pos++;
+        return true;
+    }
+};
+
+#endif // BITCOIN_RINGBUFFER_H
@@ -790,6 +790,15 @@ UniValue getblock(const JSONRPCRequest& request)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
 
+    if (verbosity <= 0 && RPCSerializationFlags() == 0)
+    {
+        // The block as stored is what was asked for
+        std::vector<unsigned char> vBlock;
+        if (!ReadRawBlockFromDisk(vBlock, pblockindex, Params().GetConsensus()))
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+        return HexStr(vBlock);
+    }
+
     if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -971,6 +980,141 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+static UniValue DBStatsToJSON(const CDBWrapper& db)
+{
+    UniValue ret(UniValue::VOBJ);
+
+    const CDBOptions& dboptions = db.GetDBOptions();
+    UniValue options(UniValue::VOBJ);
+    options.push_back(Pair("block_size", (uint64_t)dboptions.block_size));
+    options.push_back(Pair("compression", dboptions.compression));
+    options.push_back(Pair("bloom_bits", dboptions.bloom_bits));
+    options.push_back(Pair("max_open_files", dboptions.max_open_files));
+    options.push_back(Pair("max_file_size", (uint64_t)dboptions.max_file_size));
+    options.push_back(Pair("write_buffer_size", (uint64_t)dboptions.write_buffer_size));
+    ret.push_back(Pair("options", options));
+
+    UniValue levels(UniValue::VARR);
+    double compaction_sec = 0;
+    int read_amplification = 0;
+    for (const CDBLevelStats& level : db.GetLevelStats()) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("level", level.level));
+        entry.push_back(Pair("files", level.files));
+        entry.push_back(Pair("size_mb", level.size_mb));
+        entry.push_back(Pair("compaction_sec", level.compaction_sec));
+        entry.push_back(Pair("compaction_read_mb", level.read_mb));
+        entry.push_back(Pair("compaction_write_mb", level.write_mb));
+        levels.push_back(entry);
+        compaction_sec += level.compaction_sec;
+        // A lookup may have to check every level 0 file, but only one file of each other level
+        read_amplification += level.level == 0 ? level.files : (level.files > 0 ? 1 : 0);
+    }
+    ret.push_back(Pair("levels", levels));
+    ret.push_back(Pair("compaction_sec", compaction_sec));
+    ret.push_back(Pair("read_amplification", read_amplification));
+
+    std::string value;
+    if (db.GetProperty("leveldb.approximate-memory-usage", value))
+        ret.push_back(Pair("memory_usage", atoi64(value)));
+    if (db.GetProperty("leveldb.stats", value))
+        ret.push_back(Pair("stats", value));
+    return ret;
+}
+
+UniValue getdbstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getdbstats\n"
+            "\nReturns the LevelDB options and statistics of the chainstate and block index databases.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {            (json object) The chainstate database\n"
+            "    \"options\": {...},        (json object) The options the database was opened with (see -dboption)\n"
+            "    \"levels\": [              (array) One entry per level\n"
+            "      {\n"
+            "        \"level\": n,            (numeric) The level\n"
+            "        \"files\": n,            (numeric) The number of table files in the level\n"
+            "        \"size_mb\": x.x,        (numeric) The size of the level in MiB\n"
+            "        \"compaction_sec\": x.x, (numeric) Time spent compacting into the level, in seconds\n"
+            "        \"compaction_read_mb\": x.x,  (numeric) MiB read by those compactions\n"
+            "        \"compaction_write_mb\": x.x  (numeric) MiB written by those compactions\n"
+            "      }, ...\n"
+            "    ],\n"
+            "    \"compaction_sec\": x.x,   (numeric) Time spent compacting, in seconds\n"
+            "    \"read_amplification\": n, (numeric) The most table files a lookup of a missing key may have to check\n"
+            "    \"memory_usage\": n,       (numeric) Approximate memory used by the block cache and memtables, in bytes\n"
+            "    \"stats\": \"...\"           (string) LevelDB's own leveldb.stats report\n"
+            "  },\n"
+            "  \"blockindex\": {...}        (json object) The block index database, in the same form\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    LOCK(cs_main);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("chainstate", DBStatsToJSON(pcoinsdbview->GetDB())));
+    ret.push_back(Pair("blockindex", DBStatsToJSON(*pblocktree)));
+    return ret;
+}
+
+static UniValue SigCacheStatsToJSON(const SignatureCacheStats& stats)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("shards", (uint64_t)stats.nShards));
+    ret.push_back(Pair("capacity", (uint64_t)stats.nCapacity));
+    ret.push_back(Pair("hits", stats.nHits));
+    ret.push_back(Pair("misses", stats.nMisses));
+    uint64_t nLookups = stats.nHits + stats.nMisses;
+    ret.push_back(Pair("hit_rate", nLookups ? (double)stats.nHits / nLookups : 0.0));
+    ret.push_back(Pair("inserts", stats.nInserts));
+    ret.push_back(Pair("evictions", stats.nEvictions));
+    return ret;
+}
+
+UniValue getsigcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getsigcacheinfo ( reset )\n"
+            "\nReturns the size and hit rate of the signature cache and the script execution cache,\n"
+            "for sizing -maxsigcachesize. Counts are since startup or the last reset.\n"
+            "\nArguments:\n"
+            "1. reset     (boolean, optional, default=false) Clear the counts after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"signature_cache\": {         (json object) Valid signatures\n"
+            "    \"shards\": n,               (numeric) Number of independently locked parts\n"
+            "    \"capacity\": n,             (numeric) Number of entries that fit\n"
+            "    \"hits\": n,                 (numeric) Lookups that found their entry\n"
+            "    \"misses\": n,               (numeric) Lookups that did not\n"
+            "    \"hit_rate\": x.xxx,         (numeric) hits / (hits + misses)\n"
+            "    \"inserts\": n,              (numeric) Entries added\n"
+            "    \"evictions\": n             (numeric) Entries pushed out by an insert into a full table\n"
+            "  },\n"
+            "  \"script_execution_cache\": {...} (json object) Transactions whose scripts all passed, in the same form\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getsigcacheinfo", "")
+            + HelpExampleRpc("getsigcacheinfo", "true")
+        );
+
+    bool fReset = !request.params[0].isNull() && request.params[0].get_bool();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("signature_cache", SigCacheStatsToJSON(GetSignatureCacheStats())));
+    ret.push_back(Pair("script_execution_cache", SigCacheStatsToJSON(GetScriptExecutionCacheStats())));
+    if (fReset) {
+        ResetSignatureCacheStats();
+        ResetScriptExecutionCacheStats();
+    }
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1520,6 +1664,44 @@ UniValue reconsiderblock(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+UniValue getvalidationqueueinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getvalidationqueueinfo\n"
+            "\nReturns the backlog of the validation notification queue of each subscriber (wallets, networking, zmq).\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",         (string) The subscriber\n"
+            "    \"pending\": n,             (numeric) Notifications waiting to be delivered\n"
+            "    \"max_pending\": n,         (numeric) The most notifications that were waiting at once\n"
+            "    \"callbacks\": n,           (numeric) Notifications delivered\n"
+            "    \"total_time_ms\": n,       (numeric) Time the subscriber spent handling them, in milliseconds\n"
+            "    \"max_time_ms\": n,         (numeric) The longest the subscriber spent on one, in milliseconds\n"
+            "    \"max_wait_ms\": n          (numeric) The longest a notification waited before delivery, in milliseconds\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationqueueinfo", "")
+            + HelpExampleRpc("getvalidationqueueinfo", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    for (const ValidationQueueInfo& info : GetMainSignals().GetQueueInfo()) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("name", info.name));
+        entry.push_back(Pair("pending", (uint64_t)info.pending));
+        entry.push_back(Pair("max_pending", (uint64_t)info.max_pending));
+        entry.push_back(Pair("callbacks", info.callbacks));
+        entry.push_back(Pair("total_time_ms", info.total_micros / 1000));
+        entry.push_back(Pair("max_time_ms", info.max_micros / 1000));
+        entry.push_back(Pair("max_wait_ms", info.max_wait_micros / 1000));
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
 UniValue getchaintxstats(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 2)
@@ -1629,14 +1811,17 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
+    { "blockchain",         "getdbstats",             &getdbstats,             {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getsigcacheinfo",        &getsigcacheinfo,        {"reset"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "getvalidationqueueinfo", &getvalidationqueueinfo, {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
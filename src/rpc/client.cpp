@@ -145,6 +145,11 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "echojson", 9, "arg9" },
     { "rescanblockchain", 0, "start_height"},
     { "rescanblockchain", 1, "stop_height"},
+    { "getrpcstats", 0, "reset" },
+    { "getsigcacheinfo", 0, "reset" },
+    { "getlockstats", 0, "reset" },
+    { "setlockprofiling", 0, "enable" },
+    { "setlockprofiling", 1, "sample_rate" },
 };
 
 class CRPCConvertTable
@@ -16,9 +16,12 @@
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
+#include <scheduler.h>
+#include <sync.h>
 #include <timedata.h>
 #include <util.h>
 #include <utilstrencodings.h>
+#include <validationinterface.h>
 #ifdef ENABLE_WALLET
 #include <wallet/rpcwallet.h>
 #include <wallet/wallet.h>
@@ -524,6 +527,212 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     }
 }
 
+static std::string SchedulerPriorityName(CScheduler::Priority priority)
+{
+    switch (priority) {
+    case CScheduler::Priority::HIGH: return "high";
+    case CScheduler::Priority::NORMAL: return "normal";
+    case CScheduler::Priority::LOW: return "low";
+    }
+    assert(false);
+}
+
+UniValue getschedulerinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getschedulerinfo\n"
+            "Returns the state of the background task scheduler and the execution times of its tasks.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,            (numeric) Threads running scheduled tasks (see -schedulerthreads)\n"
+            "  \"queued\": n,             (numeric) Tasks waiting to run\n"
+            "  \"tasks\": {               (json object) Execution times by task\n"
+            "    \"name\": {\n"
+            "      \"priority\": \"xxxx\",  (string) high, normal or low\n"
+            "      \"count\": n,          (numeric) Times the task ran\n"
+            "      \"total_ms\": n,       (numeric) Total execution time, in milliseconds\n"
+            "      \"max_ms\": n,         (numeric) Longest execution time, in milliseconds\n"
+            "      \"histogram\": [n,...] (array) Runs that took less than 1ms, 10ms, 100ms, 1s, 10s, and longer\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getschedulerinfo", "")
+            + HelpExampleRpc("getschedulerinfo", "")
+        );
+
+    const CScheduler* pscheduler = GetMainSignals().GetBackgroundSignalScheduler();
+    if (!pscheduler) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "No scheduler is running");
+    }
+    const CScheduler& scheduler = *pscheduler;
+    boost::chrono::system_clock::time_point first, last;
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("threads", scheduler.getNumThreads()));
+    obj.push_back(Pair("queued", (uint64_t)scheduler.getQueueInfo(first, last)));
+    UniValue tasks(UniValue::VOBJ);
+    for (const auto& task : scheduler.getTaskStats()) {
+        const CScheduler::TaskStats& stats = task.second;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("priority", SchedulerPriorityName(stats.priority)));
+        entry.push_back(Pair("count", stats.count));
+        entry.push_back(Pair("total_ms", stats.total_micros / 1000));
+        entry.push_back(Pair("max_ms", stats.max_micros / 1000));
+        UniValue histogram(UniValue::VARR);
+        for (uint64_t n : stats.histogram) {
+            histogram.push_back(n);
+        }
+        entry.push_back(Pair("histogram", histogram));
+        tasks.push_back(Pair(task.first, entry));
+    }
+    obj.push_back(Pair("tasks", tasks));
+    return obj;
+}
+
+static UniValue LockHistogramToJSON(const std::array<uint64_t, LOCK_PROFILE_BUCKETS>& buckets)
+{
+    UniValue histogram(UniValue::VOBJ);
+    for (int i = 0; i < LOCK_PROFILE_BUCKETS; i++) {
+        if (buckets[i])
+            histogram.pushKV(i64tostr((int64_t)1 << i), buckets[i]);
+    }
+    return histogram;
+}
+
+static UniValue LockStatsToJSON(const LockSiteStats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("acquisitions", stats.nAcquisitions);
+    obj.pushKV("contended", stats.nContended);
+    obj.pushKV("wait_us", stats.nWaitMicros);
+    obj.pushKV("max_wait_us", stats.nMaxWaitMicros);
+    obj.pushKV("hold_us", stats.nHoldMicros);
+    obj.pushKV("max_hold_us", stats.nMaxHoldMicros);
+    obj.pushKV("wait_histogram", LockHistogramToJSON(stats.vWaitBuckets));
+    obj.pushKV("hold_histogram", LockHistogramToJSON(stats.vHoldBuckets));
+    return obj;
+}
+
+/** The lock a LOCK() argument names: "cs_wallet" for "pwallet->cs_wallet", "cs_main" for "::cs_main" */
+static std::string LockBaseName(const std::string& strExpr)
+{
+    size_t nPos = strExpr.find_last_of(".>:");
+    std::string strName = nPos == std::string::npos ? strExpr : strExpr.substr(nPos + 1);
+    while (!strName.empty() && (strName[0] == '*' || strName[0] == '&' || strName[0] == '('))
+        strName = strName.substr(1);
+    return strName;
+}
+
+/** The source file relative to src/, which __FILE__ may not be in out-of-tree builds */
+static std::string LockSiteFile(const std::string& strFile)
+{
+    size_t nPos = strFile.rfind("src/");
+    return nPos == std::string::npos ? strFile : strFile.substr(nPos + 4);
+}
+
+UniValue getlockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getlockstats ( reset )\n"
+            "\nReturns how long locks were waited for and held, per lock and per acquisition site,\n"
+            "since lock profiling was enabled (see setlockprofiling and -lockprofiling) or the last reset.\n"
+            "Only one in sample_rate acquisitions of each thread is recorded, so counts are a sample.\n"
+            "\nArguments:\n"
+            "1. reset     (boolean, optional, default=false) Clear the statistics after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\" : true|false,      (boolean) Whether lock profiling is on\n"
+            "  \"sample_rate\" : n,           (numeric) One in this many acquisitions per thread is recorded\n"
+            "  \"locks\" : {                  (json object) Statistics per lock, summed over its sites\n"
+            "    \"lock\" : {\n"
+            "      \"acquisitions\" : n,      (numeric) Number of recorded times the lock was taken\n"
+            "      \"contended\" : n,         (numeric) Number of times it was already held by another thread\n"
+            "      \"wait_us\" : n,           (numeric) Total time spent waiting for it, in microseconds\n"
+            "      \"max_wait_us\" : n,       (numeric) Longest wait, in microseconds\n"
+            "      \"hold_us\" : n,           (numeric) Total time it was held, in microseconds\n"
+            "      \"max_hold_us\" : n,       (numeric) Longest hold, in microseconds\n"
+            "      \"wait_histogram\" : {     (json object) Acquisitions that waited less than the given number of microseconds (non-empty buckets only)\n"
+            "        \"us\" : n, ...\n"
+            "      },\n"
+            "      \"hold_histogram\" : {     (json object) Acquisitions held for less than the given number of microseconds (non-empty buckets only)\n"
+            "        \"us\" : n, ...\n"
+            "      }\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"sites\" : [                  (json array) Statistics per acquisition site, longest total wait first\n"
+            "    {\n"
+            "      \"lock\" : \"expr\",         (string) The locked expression, as written at the site\n"
+            "      \"site\" : \"file:line\",    (string) The source location\n"
+            "      ...                        Same fields as under \"locks\"\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleRpc("getlockstats", "true")
+        );
+
+    bool fReset = !request.params[0].isNull() && request.params[0].get_bool();
+
+    std::vector<LockSiteStats> vSites = GetLockSiteStats();
+    if (fReset)
+        ResetLockStats();
+    std::sort(vSites.begin(), vSites.end(), [](const LockSiteStats& a, const LockSiteStats& b) {
+        return a.nWaitMicros != b.nWaitMicros ? a.nWaitMicros > b.nWaitMicros : a.nHoldMicros > b.nHoldMicros;
+    });
+
+    std::map<std::string, LockSiteStats> mapLocks;
+    UniValue sites(UniValue::VARR);
+    for (const LockSiteStats& site : vSites) {
+        mapLocks[LockBaseName(site.strLock)].Add(site);
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("lock", site.strLock);
+        obj.pushKV("site", strprintf("%s:%d", LockSiteFile(site.strFile), site.nLine));
+        obj.pushKVs(LockStatsToJSON(site));
+        sites.push_back(obj);
+    }
+    UniValue locks(UniValue::VOBJ);
+    for (const auto& lock : mapLocks) {
+        locks.pushKV(lock.first, LockStatsToJSON(lock.second));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("enabled", UniValue(g_lock_profiling.load()));
+    ret.pushKV("sample_rate", (uint64_t)g_lock_profile_sample_rate.load());
+    ret.pushKV("locks", locks);
+    ret.pushKV("sites", sites);
+    return ret;
+}
+
+UniValue setlockprofiling(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "setlockprofiling enable ( sample_rate )\n"
+            "\nTurn recording of lock wait and hold times on or off. Recorded statistics are kept\n"
+            "until getlockstats is called with reset.\n"
+            "\nArguments:\n"
+            "1. enable         (boolean, required) true to record lock acquisitions, false to stop\n"
+            "2. sample_rate    (numeric, optional) Record one in this many acquisitions of each thread, 1 records all\n"
+            "                  (default: the current rate, initially -lockprofilesamplerate)\n"
+            "\nExamples:\n"
+            + HelpExampleCli("setlockprofiling", "true")
+            + HelpExampleCli("setlockprofiling", "true 1")
+            + HelpExampleRpc("setlockprofiling", "false")
+        );
+
+    if (!request.params[1].isNull()) {
+        int nSampleRate = request.params[1].get_int();
+        if (nSampleRate < 1)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "sample_rate must be at least 1");
+        g_lock_profile_sample_rate = nSampleRate;
+    }
+    g_lock_profiling = request.params[0].get_bool();
+    return NullUniValue;
+}
+
 uint32_t getCategoryMask(UniValue cats) {
     cats = cats.get_array();
     uint32_t mask = 0;
@@ -639,6 +848,9 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
+    { "control",            "getlockstats",           &getlockstats,           {"reset"} },
+    { "control",            "setlockprofiling",       &setlockprofiling,       {"enable","sample_rate"} },
+    { "control",            "getschedulerinfo",       &getschedulerinfo,       {} },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
     { "util",               "validateaddress",        &validateaddress,        {"address"} }, /* uses wallet if enabled */
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys"} },
@@ -16,6 +16,7 @@
 #include <net.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
+#include <primitives/blockview.h>
 #include <primitives/transaction.h>
 #include <rpc/safemode.h>
 #include <rpc/server.h>
@@ -262,13 +263,14 @@ UniValue gettxoutproof(const JSONRPCRequest& request)
         pblockindex = mapBlockIndex[hashBlock];
     }
 
-    CBlock block;
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+    std::vector<unsigned char> vBlock;
+    if(!ReadRawBlockFromDisk(vBlock, pblockindex, Params().GetConsensus()))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    const CBlockView block(vBlock);
 
     unsigned int ntxFound = 0;
-    for (const auto& tx : block.vtx)
-        if (setTxids.count(tx->GetHash()))
+    for (const CTxView& tx : block.Transactions())
+        if (setTxids.count(tx.GetHash()))
             ntxFound++;
     if (ntxFound != setTxids.size())
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Not all transactions found in specified or retrieved block");
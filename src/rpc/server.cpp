@@ -20,6 +20,7 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <atomic>
 #include <memory> // for unique_ptr
 #include <unordered_map>
 
@@ -32,6 +33,32 @@ static RPCTimerInterface* timerInterface = nullptr;
 /* Map of name to timer. */
 static std::map<std::string, std::unique_ptr<RPCTimerBase> > deadlineTimers;
 
+/** Number of power-of-two latency buckets kept per method; bucket i counts calls shorter than 2^i us */
+static const int RPC_LATENCY_BUCKETS = 32;
+
+/** Call statistics for a single RPC method */
+struct CRPCMethodStats
+{
+    uint64_t nCalls = 0;
+    uint64_t nErrors = 0;
+    uint64_t nSlowCalls = 0;
+    int64_t nTotalMicros = 0;
+    int64_t nMaxMicros = 0;
+    int64_t nLockWaitMicros = 0;
+    uint64_t vLatencyBuckets[RPC_LATENCY_BUCKETS] = {};
+};
+
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCMethodStats> mapRPCStats;
+/* Calls running longer than this are logged with their parameters; 0 disables */
+static std::atomic<int64_t> nRPCSlowCallMicros(DEFAULT_RPC_SLOW_CALL_MS * 1000);
+
+/* Methods whose parameters must never end up in the debug log */
+static const char* const RPC_SENSITIVE_METHODS[] = {
+    "dumpprivkey", "encryptwallet", "importprivkey", "importmulti", "importwallet",
+    "signmessagewithprivkey", "signrawtransaction", "walletpassphrase", "walletpassphrasechange",
+};
+
 static struct CRPCSignals
 {
     boost::signals2::signal<void ()> Started;
@@ -240,6 +267,63 @@ UniValue stop(const JSONRPCRequest& jsonRequest)
     return "TheHolyRoger server stopping";
 }
 
+UniValue getrpcstats(const JSONRPCRequest& jsonRequest)
+{
+    if (jsonRequest.fHelp || jsonRequest.params.size() > 1)
+        throw std::runtime_error(
+            "getrpcstats ( reset )\n"
+            "\nReturns call counts and latency statistics for every RPC method called since startup (or the last reset).\n"
+            "\nArguments:\n"
+            "1. reset     (boolean, optional, default=false) Clear the statistics after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"method\" : {              (json object) Statistics for one RPC method\n"
+            "    \"calls\" : n,            (numeric) Number of calls\n"
+            "    \"errors\" : n,           (numeric) Number of calls that returned an error\n"
+            "    \"slow_calls\" : n,       (numeric) Number of calls above -rpcslowcallthreshold\n"
+            "    \"total_us\" : n,         (numeric) Total execution time in microseconds\n"
+            "    \"avg_us\" : n,           (numeric) Average execution time in microseconds\n"
+            "    \"max_us\" : n,           (numeric) Longest execution time in microseconds\n"
+            "    \"lockwait_us\" : n,      (numeric) Total time spent blocked on contended locks (cs_main, cs_wallet, ...)\n"
+            "    \"histogram\" : {         (json object) Number of calls per latency bucket\n"
+            "      \"us\" : n,             (numeric) Calls shorter than the given number of microseconds (non-empty buckets only)\n"
+            "      ...\n"
+            "    }\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleRpc("getrpcstats", "true")
+        );
+
+    bool fReset = !jsonRequest.params[0].isNull() && jsonRequest.params[0].get_bool();
+
+    UniValue ret(UniValue::VOBJ);
+    LOCK(cs_rpcStats);
+    for (const auto& entry : mapRPCStats) {
+        const CRPCMethodStats& stats = entry.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("calls", stats.nCalls);
+        obj.pushKV("errors", stats.nErrors);
+        obj.pushKV("slow_calls", stats.nSlowCalls);
+        obj.pushKV("total_us", stats.nTotalMicros);
+        obj.pushKV("avg_us", stats.nCalls ? stats.nTotalMicros / (int64_t)stats.nCalls : 0);
+        obj.pushKV("max_us", stats.nMaxMicros);
+        obj.pushKV("lockwait_us", stats.nLockWaitMicros);
+        UniValue histogram(UniValue::VOBJ);
+        for (int i = 0; i < RPC_LATENCY_BUCKETS; i++) {
+            if (stats.vLatencyBuckets[i])
+                histogram.pushKV(i64tostr((int64_t)1 << i), stats.vLatencyBuckets[i]);
+        }
+        obj.pushKV("histogram", histogram);
+        ret.pushKV(entry.first, obj);
+    }
+    if (fReset)
+        mapRPCStats.clear();
+    return ret;
+}
+
 UniValue uptime(const JSONRPCRequest& jsonRequest)
 {
     if (jsonRequest.fHelp || jsonRequest.params.size() > 1)
@@ -266,6 +350,7 @@ static const CRPCCommand vRPCCommands[] =
     { "control",            "help",                   &help,                   {"command"}  },
     { "control",            "stop",                   &stop,                   {}  },
     { "control",            "uptime",                 &uptime,                 {}  },
+    { "control",            "getrpcstats",            &getrpcstats,            {"reset"}  },
 };
 
 CRPCTable::CRPCTable()
@@ -305,6 +390,7 @@ bool CRPCTable::appendCommand(const std::string& name, const CRPCCommand* pcmd)
 bool StartRPC()
 {
     LogPrint(BCLog::RPC, "Starting RPC\n");
+    nRPCSlowCallMicros = gArgs.GetArg("-rpcslowcallthreshold", DEFAULT_RPC_SLOW_CALL_MS) * 1000;
     fRPCRunning = true;
     g_rpcSignals.Started();
     return true;
@@ -469,6 +555,44 @@ static inline JSONRPCRequest transformNamedArguments(const JSONRPCRequest& in, c
     return out;
 }
 
+static void RecordRPCCall(const JSONRPCRequest& request, int64_t nTimeStart, int64_t nLockWaitStart, bool fError)
+{
+    int64_t nDuration = GetTimeMicros() - nTimeStart;
+    int64_t nLockWait = GetThreadLockWaitTime() - nLockWaitStart;
+    int64_t nSlowThreshold = nRPCSlowCallMicros;
+    bool fSlow = nSlowThreshold > 0 && nDuration >= nSlowThreshold;
+
+    int nBucket = 0;
+    while (nBucket < RPC_LATENCY_BUCKETS - 1 && ((int64_t)1 << nBucket) <= nDuration)
+        nBucket++;
+
+    {
+        LOCK(cs_rpcStats);
+        CRPCMethodStats& stats = mapRPCStats[request.strMethod];
+        stats.nCalls++;
+        if (fError)
+            stats.nErrors++;
+        if (fSlow)
+            stats.nSlowCalls++;
+        stats.nTotalMicros += nDuration;
+        stats.nMaxMicros = std::max(stats.nMaxMicros, nDuration);
+        stats.nLockWaitMicros += nLockWait;
+        stats.vLatencyBuckets[nBucket]++;
+    }
+
+    if (fSlow) {
+        std::string strParams = "<redacted>";
+        if (std::find(std::begin(RPC_SENSITIVE_METHODS), std::end(RPC_SENSITIVE_METHODS), request.strMethod) == std::end(RPC_SENSITIVE_METHODS)) {
+            strParams = request.params.write();
+            if (strParams.size() > MAX_RPC_SLOW_CALL_LOG_PARAMS)
+                strParams = strParams.substr(0, MAX_RPC_SLOW_CALL_LOG_PARAMS) + "...";
+        }
+        LogPrintf("Slow RPC call: method=%s user=%s time=%.2fms lockwait=%.2fms%s params=%s\n",
+            SanitizeString(request.strMethod), SanitizeString(request.authUser), nDuration * 0.001, nLockWait * 0.001,
+            fError ? " (error)" : "", SanitizeString(strParams));
+    }
+}
+
 UniValue CRPCTable::execute(const JSONRPCRequest &request) const
 {
     // Return immediately if in warmup
@@ -485,19 +609,32 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    int64_t nTimeStart = GetTimeMicros();
+    int64_t nLockWaitStart = GetThreadLockWaitTime();
+    bool fError = true;
     try
     {
         // Execute, convert arguments to array if necessary
+        UniValue result;
         if (request.params.isObject()) {
-            return pcmd->actor(transformNamedArguments(request, pcmd->argNames));
+            result = pcmd->actor(transformNamedArguments(request, pcmd->argNames));
         } else {
-            return pcmd->actor(request);
+            result = pcmd->actor(request);
         }
+        fError = false;
+        RecordRPCCall(request, nTimeStart, nLockWaitStart, fError);
+        return result;
     }
     catch (const std::exception& e)
     {
+        RecordRPCCall(request, nTimeStart, nLockWaitStart, fError);
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
+    catch (...)
+    {
+        RecordRPCCall(request, nTimeStart, nLockWaitStart, fError);
+        throw;
+    }
 }
 
 std::vector<std::string> CRPCTable::listCommands() const
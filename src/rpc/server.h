@@ -18,6 +18,10 @@
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+/** Log RPC calls that take longer than this many milliseconds (0 = never) */
+static const int64_t DEFAULT_RPC_SLOW_CALL_MS = 0;
+/** Maximum length of the parameter string written for a slow RPC call */
+static const size_t MAX_RPC_SLOW_CALL_LOG_PARAMS = 1000;
 
 class CRPCCommand;
 
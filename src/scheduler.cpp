@@ -6,12 +6,13 @@
 
 #include <random.h>
 #include <reverselock.h>
+#include <utiltime.h>
 
 #include <assert.h>
 #include <boost/bind.hpp>
 #include <utility>
 
-CScheduler::CScheduler() : nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
+CScheduler::CScheduler() : nThreadsServicingQueue(0), nLowPriorityRunning(0), stopRequested(false), stopWhenEmpty(false)
 {
 }
 
@@ -73,15 +74,67 @@ void CScheduler::serviceQueue()
             if (shouldStop() || taskQueue.empty())
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            // Of the tasks that are due, run the one with the highest priority
+            const boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+            const bool fLowAllowed = nLowPriorityRunning < std::max(1, nThreadsServicingQueue - 1);
+            auto itTask = taskQueue.end();
+            auto it = taskQueue.begin();
+            for (; it != taskQueue.end() && it->first <= now; ++it) {
+                if (it->second.priority == Priority::LOW && !fLowAllowed)
+                    continue;
+                if (itTask == taskQueue.end() || it->second.priority < itTask->second.priority)
+                    itTask = it;
+            }
+            if (itTask == taskQueue.end()) {
+                // Only LOW priority tasks are due, and they already have
+                // all the threads they may use. Wait for one of them to
+                // finish, a new task, or the next task to become due.
+                if (it == taskQueue.end()) {
+                    newTaskScheduled.wait(lock);
+                } else {
+#if BOOST_VERSION < 105000
+                    newTaskScheduled.timed_wait(lock, toPosixTime(it->first));
+#else
+                    newTaskScheduled.wait_until<>(lock, it->first);
+#endif
+                }
+                continue;
+            }
 
-            {
+            Task task = std::move(itTask->second);
+            taskQueue.erase(itTask);
+
+            const bool fLow = task.priority == Priority::LOW;
+            if (fLow)
+                ++nLowPriorityRunning;
+            const int64_t nStart = GetTimeMicros();
+            try {
                 // Unlock before calling f, so it can reschedule itself or another task
                 // without deadlocking:
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
-                f();
+                task.f();
+            } catch (...) {
+                if (fLow)
+                    --nLowPriorityRunning;
+                throw;
+            }
+            const int64_t nTime = GetTimeMicros() - nStart;
+            if (fLow) {
+                --nLowPriorityRunning;
+                // Threads waiting for a LOW priority slot and threads waiting
+                // for the next task share the condition; wake them all.
+                newTaskScheduled.notify_all();
             }
+
+            TaskStats& stats = taskStats[task.name.empty() ? "other" : task.name];
+            stats.priority = task.priority;
+            stats.count++;
+            stats.total_micros += nTime;
+            stats.max_micros = std::max(stats.max_micros, nTime);
+            size_t nBucket = 0;
+            for (int64_t nLimit = 1000; nBucket < stats.histogram.size() - 1 && nTime >= nLimit; nLimit *= 10)
+                nBucket++;
+            stats.histogram[nBucket]++;
         } catch (...) {
             --nThreadsServicingQueue;
             throw;
@@ -103,29 +156,29 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t, Priority priority, const std::string& name)
 {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue.insert(std::make_pair(t, Task{std::move(f), priority, name}));
     }
     newTaskScheduled.notify_one();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds, Priority priority, const std::string& name)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds));
+    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds), priority, name);
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds)
+static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds, CScheduler::Priority priority, const std::string& name)
 {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds), deltaMilliSeconds);
+    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds, priority, name), deltaMilliSeconds, priority, name);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds, Priority priority, const std::string& name)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds), deltaMilliSeconds);
+    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds, priority, name), deltaMilliSeconds, priority, name);
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
@@ -145,6 +198,16 @@ bool CScheduler::AreThreadsServicingQueue() const {
     return nThreadsServicingQueue;
 }
 
+int CScheduler::getNumThreads() const {
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    return nThreadsServicingQueue;
+}
+
+std::map<std::string, CScheduler::TaskStats> CScheduler::getTaskStats() const {
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    return taskStats;
+}
+
 
 void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
     {
@@ -155,7 +218,8 @@ void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
         if (m_are_callbacks_running) return;
         if (m_callbacks_pending.empty()) return;
     }
-    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this));
+    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this), boost::chrono::system_clock::now(),
+                           CScheduler::Priority::HIGH, "validationinterface");
 }
 
 void SingleThreadedSchedulerClient::ProcessQueue() {
@@ -12,10 +12,17 @@
 //
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
+#include <array>
 #include <map>
+#include <string>
 
 #include <sync.h>
 
+/** Default for -schedulerthreads, the number of threads servicing the scheduler */
+static const int DEFAULT_SCHEDULER_THREADS = 4;
+/** Maximum for -schedulerthreads */
+static const int MAX_SCHEDULER_THREADS = 16;
+
 //
 // Simple class for background tasks that should be run
 // periodically or once "after a while"
@@ -42,18 +49,34 @@ public:
 
     typedef std::function<void(void)> Function;
 
-    // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now());
+    // Tasks that are due run in priority order. LOW priority tasks (disk
+    // maintenance and the like) are never run by every servicing thread at
+    // once, so that one is always left for HIGH and NORMAL priority tasks.
+    enum class Priority { HIGH, NORMAL, LOW };
+
+    // Execution times of the tasks scheduled under one name
+    struct TaskStats {
+        Priority priority = Priority::NORMAL;
+        uint64_t count = 0;
+        int64_t total_micros = 0;
+        int64_t max_micros = 0;
+        // Runs that took less than 1ms, 10ms, 100ms, 1s, 10s, and longer
+        std::array<uint64_t, 6> histogram{};
+    };
+
+    // Call func at/after time t. Its execution times are recorded under name.
+    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now(),
+                  Priority priority=Priority::NORMAL, const std::string& name="");
 
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaMilliSeconds);
+    void scheduleFromNow(Function f, int64_t deltaMilliSeconds, Priority priority=Priority::NORMAL, const std::string& name="");
 
     // Another convenience method: call f approximately
     // every deltaSeconds forever, starting deltaSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaMilliSeconds);
+    void scheduleEvery(Function f, int64_t deltaMilliSeconds, Priority priority=Priority::NORMAL, const std::string& name="");
 
     // To keep things as simple as possible, there is no unschedule.
 
@@ -74,11 +97,25 @@ public:
     // Returns true if there are threads actively running in serviceQueue()
     bool AreThreadsServicingQueue() const;
 
+    // Returns the number of threads running serviceQueue()
+    int getNumThreads() const;
+
+    // Returns the execution time statistics of every task name that has run
+    std::map<std::string, TaskStats> getTaskStats() const;
+
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    struct Task {
+        Function f;
+        Priority priority;
+        std::string name;
+    };
+
+    std::multimap<boost::chrono::system_clock::time_point, Task> taskQueue;
+    std::map<std::string, TaskStats> taskStats;
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
+    int nLowPriorityRunning;
     bool stopRequested;
     bool stopWhenEmpty;
     bool shouldStop() const { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
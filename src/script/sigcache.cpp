@@ -11,9 +11,69 @@
 #include <uint256.h>
 #include <util.h>
 
-#include <cuckoocache.h>
 #include <boost/thread.hpp>
 
+const size_t CShardedSignatureCache::SHARDS;
+
+size_t CShardedSignatureCache::setup_bytes(size_t bytes)
+{
+    size_t nElems = 0;
+    for (Shard& shard : m_shards) {
+        shard.nCapacity = shard.cache.setup_bytes(bytes / SHARDS);
+        nElems += shard.nCapacity;
+    }
+    return nElems;
+}
+
+bool CShardedSignatureCache::contains(const uint256& entry, bool erase)
+{
+    Shard& shard = GetShard(entry);
+    bool fFound;
+    {
+        boost::shared_lock<boost::shared_mutex> lock(shard.mutex);
+        fFound = shard.cache.contains(entry, erase);
+    }
+    (fFound ? shard.nHits : shard.nMisses).fetch_add(1, std::memory_order_relaxed);
+    return fFound;
+}
+
+void CShardedSignatureCache::insert(const uint256& entry)
+{
+    Shard& shard = GetShard(entry);
+    bool fEvicted;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+        fEvicted = shard.cache.insert(entry);
+    }
+    shard.nInserts.fetch_add(1, std::memory_order_relaxed);
+    if (fEvicted)
+        shard.nEvictions.fetch_add(1, std::memory_order_relaxed);
+}
+
+SignatureCacheStats CShardedSignatureCache::GetStats() const
+{
+    SignatureCacheStats stats;
+    stats.nShards = SHARDS;
+    for (const Shard& shard : m_shards) {
+        stats.nCapacity += shard.nCapacity;
+        stats.nHits += shard.nHits.load(std::memory_order_relaxed);
+        stats.nMisses += shard.nMisses.load(std::memory_order_relaxed);
+        stats.nInserts += shard.nInserts.load(std::memory_order_relaxed);
+        stats.nEvictions += shard.nEvictions.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void CShardedSignatureCache::ResetStats()
+{
+    for (Shard& shard : m_shards) {
+        shard.nHits = 0;
+        shard.nMisses = 0;
+        shard.nInserts = 0;
+        shard.nEvictions = 0;
+    }
+}
+
 namespace {
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
@@ -25,9 +85,7 @@ class CSignatureCache
 private:
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    CShardedSignatureCache setValid;
 
 public:
     CSignatureCache()
@@ -44,19 +102,25 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
         return setValid.contains(entry, erase);
     }
 
     void Set(uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
         setValid.insert(entry);
     }
-    uint32_t setup_bytes(size_t n)
+    size_t setup_bytes(size_t n)
     {
         return setValid.setup_bytes(n);
     }
+    SignatureCacheStats GetStats() const
+    {
+        return setValid.GetStats();
+    }
+    void ResetStats()
+    {
+        setValid.ResetStats();
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -80,6 +144,16 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+SignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
+void ResetSignatureCacheStats()
+{
+    signatureCache.ResetStats();
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
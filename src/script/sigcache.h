@@ -6,10 +6,15 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include <cuckoocache.h>
 #include <script/interpreter.h>
 
+#include <array>
+#include <atomic>
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
 // systems). Due to how we count cache size, actual memory usage is slightly
 // more (~32.25 MB)
@@ -40,6 +45,57 @@ public:
     }
 };
 
+/** Size and hit, miss and eviction counts of a CShardedSignatureCache */
+struct SignatureCacheStats
+{
+    size_t nShards = 0;
+    size_t nCapacity = 0;
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+    uint64_t nInserts = 0;
+    uint64_t nEvictions = 0;
+};
+
+/**
+ * A cache of nonced uint256 entries, split in shards that each have their
+ * own CuckooCache::cache and lock. The script check threads look entries up
+ * concurrently; with shards, a lookup only waits for an insert that happens
+ * to go to the same shard, instead of for every insert.
+ */
+class CShardedSignatureCache
+{
+public:
+    static const size_t SHARDS = 16;
+
+    //! Split about bytes over the shards, returning the number of entries that fit
+    size_t setup_bytes(size_t bytes);
+    //! As CuckooCache::cache::contains
+    bool contains(const uint256& entry, bool erase);
+    void insert(const uint256& entry);
+
+    SignatureCacheStats GetStats() const;
+    void ResetStats();
+
+private:
+    struct Shard {
+        CuckooCache::cache<uint256, SignatureCacheHasher> cache;
+        boost::shared_mutex mutex;
+        uint32_t nCapacity = 0;
+        std::atomic<uint64_t> nHits{0};
+        std::atomic<uint64_t> nMisses{0};
+        std::atomic<uint64_t> nInserts{0};
+        std::atomic<uint64_t> nEvictions{0};
+    };
+    std::array<Shard, SHARDS> m_shards;
+
+    Shard& GetShard(const uint256& entry)
+    {
+        // Entries are uniformly random. The cache's hashes use the high bits
+        // of each 32-bit word, so select the shard by a low byte.
+        return m_shards[*(entry.begin() + 28) % SHARDS];
+    }
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -52,5 +108,7 @@ public:
 };
 
 void InitSignatureCache();
+SignatureCacheStats GetSignatureCacheStats();
+void ResetSignatureCacheStats();
 
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
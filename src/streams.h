@@ -138,6 +138,61 @@ private:
     size_t nPos;
 };
 
+/* Minimal stream for reading from a byte range that is owned elsewhere,
+ * without copying it
+ */
+class CByteReader
+{
+ public:
+
+/*
+ * @param[in]  nTypeIn Serialization Type
+ * @param[in]  nVersionIn Serialization Version (including any flags)
+ * @param[in]  pbeginIn, pendIn  The bytes to read, which must outlive the reader
+*/
+    CByteReader(int nTypeIn, int nVersionIn, const unsigned char* pbeginIn, const unsigned char* pendIn) : nType(nTypeIn), nVersion(nVersionIn), pcur(pbeginIn), pend(pendIn) {}
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > size()) {
+            throw std::ios_base::failure("CByteReader::read(): end of data");
+        }
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+    }
+    void ignore(size_t nSize)
+    {
+        if (nSize > size()) {
+            throw std::ios_base::failure("CByteReader::ignore(): end of data");
+        }
+        pcur += nSize;
+    }
+    template<typename T>
+    CByteReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+    int GetType() const
+    {
+        return nType;
+    }
+    /** The next byte to be read */
+    const unsigned char* data() const { return pcur; }
+    size_t size() const { return pend - pcur; }
+    bool empty() const { return pcur == pend; }
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pcur;
+    const unsigned char* const pend;
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -4,8 +4,10 @@
 
 #include <sync.h>
 
+#include <algorithm>
 #include <memory>
 #include <set>
+#include <unordered_map>
 #include <util.h>
 #include <utilstrencodings.h>
 
@@ -22,6 +24,145 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+#if defined(HAVE_THREAD_LOCAL)
+static thread_local int64_t g_thread_lock_wait_micros = 0;
+
+void AddThreadLockWaitTime(int64_t nMicros)
+{
+    g_thread_lock_wait_micros += nMicros;
+}
+
+int64_t GetThreadLockWaitTime()
+{
+    return g_thread_lock_wait_micros;
+}
+#else
+void AddThreadLockWaitTime(int64_t nMicros) {}
+int64_t GetThreadLockWaitTime() { return 0; }
+#endif
+
+std::atomic<bool> g_lock_profiling(false);
+std::atomic<uint32_t> g_lock_profile_sample_rate(DEFAULT_LOCK_PROFILE_SAMPLE_RATE);
+
+#if defined(HAVE_THREAD_LOCAL)
+static thread_local uint32_t g_thread_lock_profile_skipped = 0;
+
+bool SampleLockProfile()
+{
+    if (++g_thread_lock_profile_skipped < g_lock_profile_sample_rate.load(std::memory_order_relaxed))
+        return false;
+    g_thread_lock_profile_skipped = 0;
+    return true;
+}
+#else
+static std::atomic<uint32_t> g_lock_profile_skipped(0);
+
+bool SampleLockProfile()
+{
+    const uint32_t nRate = std::max<uint32_t>(g_lock_profile_sample_rate.load(std::memory_order_relaxed), 1);
+    return g_lock_profile_skipped.fetch_add(1, std::memory_order_relaxed) % nRate == 0;
+}
+#endif
+
+void LockSiteStats::Add(const LockSiteStats& other)
+{
+    nAcquisitions += other.nAcquisitions;
+    nContended += other.nContended;
+    nWaitMicros += other.nWaitMicros;
+    nMaxWaitMicros = std::max(nMaxWaitMicros, other.nMaxWaitMicros);
+    nHoldMicros += other.nHoldMicros;
+    nMaxHoldMicros = std::max(nMaxHoldMicros, other.nMaxHoldMicros);
+    for (int i = 0; i < LOCK_PROFILE_BUCKETS; i++) {
+        vWaitBuckets[i] += other.vWaitBuckets[i];
+        vHoldBuckets[i] += other.vHoldBuckets[i];
+    }
+}
+
+/**
+ * Lock profile storage. Sites are identified by the string literals LOCK()
+ * passes in, so a lookup only hashes three pointers. The table is split in
+ * shards with their own mutex, so that profiling does not itself become a
+ * point of contention between threads taking unrelated locks.
+ */
+namespace {
+struct LockSiteKey
+{
+    const char* pszName;
+    const char* pszFile;
+    int nLine;
+    bool operator==(const LockSiteKey& other) const
+    {
+        return pszName == other.pszName && pszFile == other.pszFile && nLine == other.nLine;
+    }
+};
+
+struct LockSiteKeyHasher
+{
+    size_t operator()(const LockSiteKey& key) const
+    {
+        return std::hash<const void*>()(key.pszFile) ^ (std::hash<const void*>()(key.pszName) << 1) ^ ((size_t)key.nLine << 16);
+    }
+};
+
+static const size_t LOCK_PROFILE_SHARDS = 16;
+
+struct LockProfileShard
+{
+    std::mutex mutex;
+    std::unordered_map<LockSiteKey, LockSiteStats, LockSiteKeyHasher> sites;
+};
+
+LockProfileShard g_lock_profile[LOCK_PROFILE_SHARDS];
+
+int LockProfileBucket(int64_t nMicros)
+{
+    int nBucket = 0;
+    while (nBucket < LOCK_PROFILE_BUCKETS - 1 && ((int64_t)1 << nBucket) <= nMicros)
+        nBucket++;
+    return nBucket;
+}
+} // namespace
+
+void RecordLockProfile(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros, int64_t nHoldMicros)
+{
+    const LockSiteKey key{pszName, pszFile, nLine};
+    LockProfileShard& shard = g_lock_profile[LockSiteKeyHasher()(key) % LOCK_PROFILE_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    LockSiteStats& stats = shard.sites[key];
+    stats.nAcquisitions++;
+    if (fContended)
+        stats.nContended++;
+    stats.nWaitMicros += nWaitMicros;
+    stats.nMaxWaitMicros = std::max(stats.nMaxWaitMicros, nWaitMicros);
+    stats.nHoldMicros += nHoldMicros;
+    stats.nMaxHoldMicros = std::max(stats.nMaxHoldMicros, nHoldMicros);
+    stats.vWaitBuckets[LockProfileBucket(nWaitMicros)]++;
+    stats.vHoldBuckets[LockProfileBucket(nHoldMicros)]++;
+}
+
+std::vector<LockSiteStats> GetLockSiteStats()
+{
+    std::vector<LockSiteStats> ret;
+    for (LockProfileShard& shard : g_lock_profile) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& site : shard.sites) {
+            ret.push_back(site.second);
+            ret.back().strLock = site.first.pszName;
+            ret.back().strFile = site.first.pszFile;
+            ret.back().nLine = site.first.nLine;
+        }
+    }
+    return ret;
+}
+
+void ResetLockStats()
+{
+    for (LockProfileShard& shard : g_lock_profile) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.sites.clear();
+    }
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -98,6 +239,7 @@ static void potential_deadlock_detected(const std::pair<void*, void*>& mismatch,
         }
         LogPrintf(" %s\n", i.second.ToString());
     }
+    FlushLogWriter();
     assert(false);
 }
 
@@ -152,6 +294,7 @@ void AssertLockHeldInternal(const char* pszName, const char* pszFile, int nLine,
         if (i.first == cs)
             return;
     fprintf(stderr, "Assertion failed: lock %s not held in %s:%i; locks held:\n%s", pszName, pszFile, nLine, LocksHeld().c_str());
+    FlushLogWriter();
     abort();
 }
 
@@ -160,6 +303,7 @@ void AssertLockNotHeldInternal(const char* pszName, const char* pszFile, int nLi
     for (const std::pair<void*, CLockLocation>& i : g_lockstack) {
         if (i.first == cs) {
             fprintf(stderr, "Assertion failed: lock %s held in %s:%i; locks held:\n%s", pszName, pszFile, nLine, LocksHeld().c_str());
+            FlushLogWriter();
             abort();
         }
     }
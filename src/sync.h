@@ -7,10 +7,15 @@
 #define BITCOIN_SYNC_H
 
 #include <threadsafety.h>
+#include <utiltime.h>
 
+#include <array>
+#include <atomic>
 #include <condition_variable>
+#include <string>
 #include <thread>
 #include <mutex>
+#include <vector>
 
 
 ////////////////////////////////////////////////
@@ -112,23 +117,91 @@ typedef std::unique_lock<std::mutex> WaitableLock;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Per-thread accounting of the time spent blocked on contended locks.
+ * Only the slow path (a failed try_lock) is timed, so uncontended locking
+ * stays as cheap as before. Callers take the difference of two readings.
+ */
+void AddThreadLockWaitTime(int64_t nMicros);
+int64_t GetThreadLockWaitTime();
+
+/**
+ * Lock profiling (-lockprofiling, setlockprofiling). While enabled, one in
+ * every g_lock_profile_sample_rate LOCK()s on each thread records how long
+ * it waited for the lock and how long it held it, under its acquisition
+ * site; the others only bump a thread-local counter. While disabled it
+ * costs one relaxed atomic load per acquisition.
+ */
+extern std::atomic<bool> g_lock_profiling;
+extern std::atomic<uint32_t> g_lock_profile_sample_rate;
+static const bool DEFAULT_LOCK_PROFILING = false;
+static const unsigned int DEFAULT_LOCK_PROFILE_SAMPLE_RATE = 64;
+
+/** Whether this thread's next acquisition is one to record. Only call while profiling is enabled. */
+bool SampleLockProfile();
+
+/** Number of power-of-two time buckets; bucket i counts times shorter than 2^i us */
+static const int LOCK_PROFILE_BUCKETS = 24;
+
+/** Wait and hold times of the acquisitions of one lock at one site */
+struct LockSiteStats
+{
+    std::string strLock;
+    std::string strFile;
+    int nLine = 0;
+    uint64_t nAcquisitions = 0;
+    uint64_t nContended = 0;
+    int64_t nWaitMicros = 0;
+    int64_t nMaxWaitMicros = 0;
+    int64_t nHoldMicros = 0;
+    int64_t nMaxHoldMicros = 0;
+    std::array<uint64_t, LOCK_PROFILE_BUCKETS> vWaitBuckets{};
+    std::array<uint64_t, LOCK_PROFILE_BUCKETS> vHoldBuckets{};
+
+    void Add(const LockSiteStats& other);
+};
+
+void RecordLockProfile(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros, int64_t nHoldMicros);
+/** Statistics of every site that acquired a lock while profiling was enabled */
+std::vector<LockSiteStats> GetLockSiteStats();
+void ResetLockStats();
+
 /** Wrapper around std::unique_lock<CCriticalSection> */
 class SCOPED_LOCKABLE CCriticalBlock
 {
 private:
     std::unique_lock<CCriticalSection> lock;
 
+    // Set when the lock was taken while profiling was enabled and sampled
+    const char* m_name = nullptr;
+    const char* m_file = nullptr;
+    int m_line = 0;
+    bool m_contended = false;
+    int64_t m_wait_micros = 0;
+    int64_t m_acquired_micros = 0;
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
+        const bool fProfile = g_lock_profiling.load(std::memory_order_relaxed) && SampleLockProfile();
+        int64_t nNow = 0;
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
+            int64_t nWaitStart = GetTimeMicros();
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            nNow = GetTimeMicros();
+            AddThreadLockWaitTime(nNow - nWaitStart);
+            m_contended = true;
+            m_wait_micros = nNow - nWaitStart;
+        }
+        if (fProfile) {
+            m_name = pszName;
+            m_file = pszFile;
+            m_line = nLine;
+            m_acquired_micros = nNow ? nNow : GetTimeMicros();
         }
-#endif
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -137,6 +210,12 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (g_lock_profiling.load(std::memory_order_relaxed) && SampleLockProfile()) {
+            m_name = pszName;
+            m_file = pszFile;
+            m_line = nLine;
+            m_acquired_micros = GetTimeMicros();
+        }
         return lock.owns_lock();
     }
 
@@ -162,8 +241,14 @@ public:
 
     ~CCriticalBlock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
             LeaveCritical();
+            if (m_acquired_micros) {
+                // Release first, so that recording does not count as holding
+                lock.unlock();
+                RecordLockProfile(m_name, m_file, m_line, m_contended, m_wait_micros, GetTimeMicros() - m_acquired_micros);
+            }
+        }
     }
 
     operator bool()
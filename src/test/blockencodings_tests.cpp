@@ -317,6 +317,45 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(MempoolScanTest)
+{
+    // Enough mempool transactions for their short IDs to be computed in
+    // batches, only some of which are in the block
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block;
+    block.nVersion = 1;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x1e0ffff0;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    std::vector<bool> in_mempool{false};
+    for (int i = 0; i < 103; i++) {
+        tx.vin[0].prevout.hash = InsecureRand256();
+        CTransactionRef ptx = MakeTransactionRef(tx);
+        if (i % 5 != 0)
+            pool.addUnchecked(ptx->GetHash(), entry.FromTx(*ptx));
+        if (i % 3 != 0) {
+            block.vtx.push_back(ptx);
+            in_mempool.push_back(i % 5 != 0);
+        }
+    }
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+
+    CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, extra_txn) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        // The coinbase is prefilled
+        BOOST_CHECK_EQUAL(partialBlock.IsTxAvailable(i), i == 0 || in_mempool[i]);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -0,0 +1,181 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <pow.h>
+#include <streams.h>
+#include <validation.h>
+#include <versionbits.h>
+#include <test/test_bitcoin.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+struct BlockImportSetup : public TestingSetup {
+    BlockImportSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+};
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, BlockImportSetup)
+
+/** A chain of min-difficulty blocks on top of the genesis block */
+static std::vector<CBlock> MakeChain(int nBlocks)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    std::vector<CBlock> chain;
+    CBlockHeader prev = Params().GenesisBlock();
+    for (int nHeight = 1; nHeight <= nBlocks; nHeight++) {
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+        coinbase.vout.emplace_back(0, CScript() << OP_TRUE);
+
+        CBlock block;
+        block.nVersion = VERSIONBITS_TOP_BITS;
+        block.hashPrevBlock = prev.GetHash();
+        // Late enough for the minimum difficulty rule
+        block.nTime = prev.nTime + 2 * consensus.nPowTargetSpacing + 1;
+        block.nBits = UintToArith256(consensus.powLimit).GetCompact();
+        block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensus)) {
+            ++block.nNonce;
+        }
+        chain.push_back(block);
+        prev = block.GetBlockHeader();
+    }
+    return chain;
+}
+
+/** Append a block in block file format, cut short after nTruncate bytes of block data */
+static void AppendBlock(CDataStream& data, const CBlock& block, size_t nTruncate = std::numeric_limits<size_t>::max())
+{
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << block;
+    data << FLATDATA(Params().MessageStart()) << (unsigned int)ssBlock.size();
+    data.write(ssBlock.data(), std::min(nTruncate, ssBlock.size()));
+}
+
+/** Write a block file and reopen it for reading */
+static FILE* WriteBlockFile(const CDiskBlockPos& pos, const CDataStream& data)
+{
+    FILE* file = OpenBlockFile(pos);
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+    rewind(file);
+    return file;
+}
+
+static bool HaveBlockData(const CBlock& block)
+{
+    LOCK(cs_main);
+    BlockMap::const_iterator it = mapBlockIndex.find(block.GetHash());
+    return it != mapBlockIndex.end() && (it->second->nStatus & BLOCK_HAVE_DATA);
+}
+
+static int ActivateChain()
+{
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    LOCK(cs_main);
+    return chainActive.Height();
+}
+
+BOOST_AUTO_TEST_CASE(out_of_order_blocks)
+{
+    const std::vector<CBlock> chain = MakeChain(4);
+    CUnknownParentBlocks unknownParents;
+
+    // Children before their parents, within a file and across files
+    CDataStream data1(SER_DISK, CLIENT_VERSION);
+    AppendBlock(data1, chain[2]);
+    AppendBlock(data1, chain[1]);
+    CDiskBlockPos pos1(1, 0);
+    BOOST_CHECK(!LoadExternalBlockFile(Params(), WriteBlockFile(pos1, data1), &pos1, &unknownParents));
+    BOOST_CHECK(!HaveBlockData(chain[1]));
+    BOOST_CHECK(!HaveBlockData(chain[2]));
+    BOOST_CHECK_EQUAL(unknownParents.mapBlocks.size(), 2U);
+    BOOST_CHECK(unknownParents.nCacheUsage > 0);
+
+    CDataStream data2(SER_DISK, CLIENT_VERSION);
+    AppendBlock(data2, chain[3]);
+    AppendBlock(data2, chain[0]);
+    CDiskBlockPos pos2(2, 0);
+    BOOST_CHECK(LoadExternalBlockFile(Params(), WriteBlockFile(pos2, data2), &pos2, &unknownParents));
+    for (const CBlock& block : chain) {
+        BOOST_CHECK(HaveBlockData(block));
+    }
+    BOOST_CHECK(unknownParents.mapBlocks.empty());
+    BOOST_CHECK_EQUAL(unknownParents.nCacheUsage, 0U);
+
+    // The recorded positions point at the blocks
+    BOOST_CHECK_EQUAL(ActivateChain(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(parent_after_cache_full)
+{
+    const std::vector<CBlock> chain = MakeChain(3);
+    CUnknownParentBlocks unknownParents;
+    unknownParents.nMaxCacheUsage = ::GetSerializeSize(chain[2], SER_DISK, CLIENT_VERSION);
+
+    // The first orphan fills the cache, the second one is only remembered by position
+    CDataStream data1(SER_DISK, CLIENT_VERSION);
+    AppendBlock(data1, chain[2]);
+    AppendBlock(data1, chain[1]);
+    CDiskBlockPos pos1(1, 0);
+    BOOST_CHECK(!LoadExternalBlockFile(Params(), WriteBlockFile(pos1, data1), &pos1, &unknownParents));
+    BOOST_CHECK_EQUAL(unknownParents.nCacheUsage, unknownParents.nMaxCacheUsage);
+    BOOST_REQUIRE_EQUAL(unknownParents.mapBlocks.count(chain[0].GetHash()), 1U);
+    BOOST_CHECK(!unknownParents.mapBlocks.find(chain[0].GetHash())->second.pblock);
+    BOOST_REQUIRE_EQUAL(unknownParents.mapBlocks.count(chain[1].GetHash()), 1U);
+    BOOST_CHECK(unknownParents.mapBlocks.find(chain[1].GetHash())->second.pblock);
+
+    // Once the parent arrives, the uncached block is read back from disk
+    CDataStream data2(SER_DISK, CLIENT_VERSION);
+    AppendBlock(data2, chain[0]);
+    CDiskBlockPos pos2(2, 0);
+    BOOST_CHECK(LoadExternalBlockFile(Params(), WriteBlockFile(pos2, data2), &pos2, &unknownParents));
+    for (const CBlock& block : chain) {
+        BOOST_CHECK(HaveBlockData(block));
+    }
+    BOOST_CHECK(unknownParents.mapBlocks.empty());
+    BOOST_CHECK_EQUAL(unknownParents.nCacheUsage, 0U);
+    BOOST_CHECK_EQUAL(ActivateChain(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(truncated_block_file)
+{
+    const std::vector<CBlock> chain = MakeChain(4);
+
+    // A record cut short in the middle of the file, and one at its end
+    CDataStream data(SER_DISK, CLIENT_VERSION);
+    AppendBlock(data, chain[0]);
+    AppendBlock(data, chain[1], 100);
+    AppendBlock(data, chain[1]);
+    AppendBlock(data, chain[2]);
+    AppendBlock(data, chain[3], 100);
+    CDiskBlockPos pos(1, 0);
+    BOOST_CHECK(LoadExternalBlockFile(Params(), WriteBlockFile(pos, data), &pos));
+    BOOST_CHECK(HaveBlockData(chain[0]));
+    BOOST_CHECK(HaveBlockData(chain[1]));
+    BOOST_CHECK(HaveBlockData(chain[2]));
+    BOOST_CHECK(!HaveBlockData(chain[3]));
+    BOOST_CHECK_EQUAL(ActivateChain(), 3);
+
+    // A file ending inside a record header
+    CDataStream data2(SER_DISK, CLIENT_VERSION);
+    AppendBlock(data2, chain[3]);
+    data2 << FLATDATA(Params().MessageStart());
+    CDiskBlockPos pos2(2, 0);
+    BOOST_CHECK(LoadExternalBlockFile(Params(), WriteBlockFile(pos2, data2), &pos2));
+    BOOST_CHECK(HaveBlockData(chain[3]));
+    BOOST_CHECK_EQUAL(ActivateChain(), 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,165 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/blockview.h>
+
+#include <merkleblock.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <test/test_bitcoin.h>
+#include <version.h>
+
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockview_tests, BasicTestingSetup)
+
+static CBlock MakeBlock()
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = InsecureRand256();
+    block.nTime = 1234567;
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 42 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+
+    for (int i = 0; i < 300; i++) {
+        CMutableTransaction mtx;
+        mtx.nVersion = 2;
+        mtx.nLockTime = i;
+        mtx.vin.resize(1 + i % 3);
+        for (size_t j = 0; j < mtx.vin.size(); j++) {
+            mtx.vin[j].prevout = COutPoint(InsecureRand256(), j);
+            mtx.vin[j].scriptSig = CScript() << std::vector<unsigned char>(i % 100, 1);
+            mtx.vin[j].nSequence = i + j;
+            if (i % 2) {
+                // Witness items, with scripts long enough for 3 byte sizes
+                mtx.vin[j].scriptWitness.stack.push_back(std::vector<unsigned char>(260, 2));
+                mtx.vin[j].scriptWitness.stack.push_back(std::vector<unsigned char>());
+            }
+        }
+        mtx.vout.resize(1 + i % 4);
+        for (size_t j = 0; j < mtx.vout.size(); j++) {
+            mtx.vout[j].nValue = i * 1000 + j;
+            mtx.vout[j].scriptPubKey = CScript() << OP_DUP << std::vector<unsigned char>(i % 300, 3);
+        }
+        block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+    return block;
+}
+
+static std::vector<unsigned char> SerializeBlock(const CBlock& block)
+{
+    std::vector<unsigned char> vch;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, vch, 0, block);
+    return vch;
+}
+
+BOOST_AUTO_TEST_CASE(blockview_matches_block)
+{
+    const CBlock block = MakeBlock();
+    const std::vector<unsigned char> vch = SerializeBlock(block);
+    const CBlockView view(vch);
+
+    BOOST_CHECK(view.GetHash() == block.GetHash());
+    BOOST_CHECK(view.ToBlock().GetHash() == block.GetHash());
+    BOOST_REQUIRE_EQUAL(view.Transactions().size(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const CTxView& txview = view.Transactions()[i];
+        BOOST_CHECK(txview.GetHash() == tx.GetHash());
+        BOOST_CHECK(txview.GetWitnessHash() == tx.GetWitnessHash());
+        BOOST_CHECK_EQUAL(txview.HasWitness(), tx.HasWitness());
+        BOOST_CHECK_EQUAL(txview.IsCoinBase(), tx.IsCoinBase());
+        BOOST_CHECK_EQUAL(txview.GetVersion(), tx.nVersion);
+        BOOST_CHECK_EQUAL(txview.GetLockTime(), tx.nLockTime);
+        BOOST_CHECK_EQUAL(txview.GetTotalSize(), tx.GetTotalSize());
+        BOOST_CHECK(*txview.ToTransaction() == tx);
+
+        BOOST_REQUIRE_EQUAL(txview.Inputs().size(), tx.vin.size());
+        size_t n = 0;
+        for (const CTxInView& txin : txview.Inputs()) {
+            BOOST_CHECK(txin.GetPrevout() == tx.vin[n].prevout);
+            BOOST_CHECK(txin.GetScriptSig() == tx.vin[n].scriptSig);
+            BOOST_CHECK_EQUAL(txin.GetSequence(), tx.vin[n].nSequence);
+            n++;
+        }
+        BOOST_CHECK_EQUAL(n, tx.vin.size());
+
+        BOOST_REQUIRE_EQUAL(txview.Outputs().size(), tx.vout.size());
+        n = 0;
+        for (const CTxOutView& txout : txview.Outputs()) {
+            BOOST_CHECK(txout.ToTxOut() == tx.vout[n]);
+            n++;
+        }
+        BOOST_CHECK_EQUAL(n, tx.vout.size());
+    }
+
+    // Merkle blocks built from the view and from the block agree
+    std::set<uint256> txids{block.vtx[7]->GetHash(), block.vtx[200]->GetHash()};
+    CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION), ss2(SER_NETWORK, PROTOCOL_VERSION);
+    ss1 << CMerkleBlock(block, txids);
+    ss2 << CMerkleBlock(view, txids);
+    BOOST_CHECK(ss1.str() == ss2.str());
+}
+
+BOOST_AUTO_TEST_CASE(blockview_malformed)
+{
+    const CBlock block = MakeBlock();
+    const std::vector<unsigned char> vch = SerializeBlock(block);
+
+    // Truncated anywhere, or followed by more data
+    for (size_t nSize : {(size_t)0, (size_t)79, (size_t)81, vch.size() / 2, vch.size() - 1}) {
+        BOOST_CHECK_THROW(CBlockView(vch.data(), vch.data() + nSize), std::ios_base::failure);
+    }
+    std::vector<unsigned char> vchLonger(vch);
+    vchLonger.push_back(0);
+    BOOST_CHECK_THROW(CBlockView view(vchLonger), std::ios_base::failure);
+
+    // Unknown optional data is rejected like CTransaction does
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vout.resize(1);
+    std::vector<unsigned char> vchTx;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS, vchTx, 0, mtx);
+    std::vector<unsigned char> vchUnknown(vchTx);
+    vchUnknown.insert(vchUnknown.begin() + 4, {0, 2});
+    BOOST_CHECK_THROW(CTxView(vchUnknown.data(), vchUnknown.data() + vchUnknown.size()), std::ios_base::failure);
+    CMutableTransaction mtxRead;
+    BOOST_CHECK_THROW(CDataStream(vchUnknown, SER_NETWORK, PROTOCOL_VERSION) >> mtxRead, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockview_empty_witness)
+{
+    // A witness flag with only empty witnesses is accepted by CTransaction,
+    // which then hashes it as if it had none
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vout.resize(1);
+    std::vector<unsigned char> vchTx;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS, vchTx, 0, mtx);
+    vchTx.insert(vchTx.begin() + 4, {0, 1});
+    vchTx.insert(vchTx.end() - 4, (unsigned char)0);
+
+    CDataStream ss(vchTx, SER_NETWORK, PROTOCOL_VERSION);
+    CTransaction tx(deserialize, ss);
+    CTxView txview(vchTx.data(), vchTx.data() + vchTx.size());
+    BOOST_CHECK(txview.end() == vchTx.data() + vchTx.size());
+    BOOST_CHECK(!txview.HasWitness());
+    BOOST_CHECK(txview.GetHash() == tx.GetHash());
+    BOOST_CHECK(txview.GetWitnessHash() == tx.GetWitnessHash());
+    BOOST_CHECK(*txview.ToTransaction() == tx);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -473,6 +473,53 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
     BOOST_CHECK(spent_a_duplicate_coinbase);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_getcoins)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest middle(&base);
+    CCoinsViewCacheTest top(&middle);
+
+    // Coins at every level of the stack, some of them spent again in a higher level
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 300; i++) {
+        outpoints.emplace_back(InsecureRand256(), InsecureRandRange(4));
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.out.scriptPubKey.assign(InsecureRandBits(6), 0);
+        coin.nHeight = 1;
+        if (i % 3 == 0) {
+            continue;
+        }
+        CCoinsViewCache& view = i % 3 == 1 ? top : middle;
+        view.AddCoin(outpoints.back(), std::move(coin), false);
+        if (i % 7 == 0) {
+            view.SpendCoin(outpoints.back());
+        }
+    }
+    BOOST_CHECK(middle.Flush());
+    for (size_t i = 0; i < outpoints.size(); i += 11) {
+        top.SpendCoin(outpoints[i]);
+    }
+
+    std::vector<Coin> coins;
+    size_t nFound = top.GetCoins(outpoints, coins);
+    BOOST_CHECK_EQUAL(coins.size(), outpoints.size());
+    size_t nExpected = 0;
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        Coin coin;
+        bool have = top.GetCoin(outpoints[i], coin);
+        nExpected += have;
+        BOOST_CHECK_EQUAL(!coins[i].IsSpent(), have);
+        if (have) {
+            BOOST_CHECK(coins[i] == coin);
+        }
+        BOOST_CHECK(top.HaveCoinInCache(outpoints[i]) == have);
+    }
+    BOOST_CHECK_EQUAL(nFound, nExpected);
+    top.SelfTest();
+    middle.SelfTest();
+}
+
 BOOST_AUTO_TEST_CASE(ccoins_serialization)
 {
     // Good example
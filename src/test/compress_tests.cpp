@@ -2,8 +2,18 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
 #include <compressor.h>
+#include <consensus/consensus.h>
+#include <consensus/merkle.h>
+#include <pow.h>
+#include <streams.h>
 #include <util.h>
+#include <validation.h>
+#include <version.h>
+#include <versionbits.h>
 #include <test/test_bitcoin.h>
 
 #include <stdint.h>
@@ -22,6 +32,20 @@
 // amounts 50 .. 21000000
 #define NUM_MULTIPLES_50BTC 1680000
 
+/** Outputs that the chainstate encoding would not keep as they are */
+static void AddUnusualOutputs(CMutableTransaction& tx, CAmount nValue)
+{
+    // Longer than MAX_SCRIPT_SIZE, so unspendable
+    std::vector<unsigned char> vchLong(MAX_SCRIPT_SIZE + 500, OP_NOP);
+    tx.vout.emplace_back(nValue, CScript(vchLong.begin(), vchLong.end()));
+    // Pay to an invalid uncompressed public key, which cannot use the special encoding
+    std::vector<unsigned char> vchKey(65, 0x05);
+    vchKey[0] = 0x04;
+    tx.vout.emplace_back(0, CScript() << vchKey << OP_CHECKSIG);
+    // Non-standard script
+    tx.vout.emplace_back(0, CScript() << OP_1 << OP_ADD << OP_2 << OP_EQUAL);
+}
+
 BOOST_FIXTURE_TEST_SUITE(compress_tests, BasicTestingSetup)
 
 bool static TestEncode(uint64_t in) {
@@ -62,4 +86,184 @@ BOOST_AUTO_TEST_CASE(compress_amounts)
         BOOST_CHECK(TestDecode(i));
 }
 
+BOOST_AUTO_TEST_CASE(compress_block)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1500000000;
+    block.nBits = 0x207fffff;
+    block.nNonce = 42;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 100 << OP_0;
+    coinbase.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(32, 0));
+    coinbase.vout.resize(2);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    coinbase.vout[1].nValue = 0;
+    coinbase.vout[1].scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(36, 2);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    CMutableTransaction spend;
+    spend.nVersion = 2;
+    spend.nLockTime = 1234;
+    spend.vin.resize(2);
+    spend.vin[0].prevout = COutPoint(block.vtx[0]->GetHash(), 0);
+    spend.vin[0].scriptSig = CScript() << std::vector<unsigned char>(71, 3) << std::vector<unsigned char>(33, 4);
+    spend.vin[1].prevout = COutPoint(block.vtx[0]->GetHash(), 1);
+    spend.vin[1].nSequence = 0xfffffffe;
+    for (int i = 0; i < 20; i++) {
+        spend.vout.emplace_back((i + 1) * CENT, CScript() << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUAL);
+    }
+    block.vtx.push_back(MakeTransactionRef(spend));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << CBlockCompressor(block);
+    BOOST_CHECK(ss.size() < ::GetSerializeSize(block, SER_DISK, PROTOCOL_VERSION));
+
+    CBlock decoded;
+    CBlockCompressor compressed(decoded);
+    ss >> compressed;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(decoded.GetHash() == block.GetHash());
+    BOOST_REQUIRE_EQUAL(decoded.vtx.size(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK(decoded.vtx[i]->GetWitnessHash() == block.vtx[i]->GetWitnessHash());
+    }
+    BOOST_CHECK(BlockMerkleRoot(decoded) == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(compress_block_unusual_scripts)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1500000000;
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 100 << OP_0;
+    AddUnusualOutputs(coinbase, 50 * COIN);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << CBlockCompressor(block);
+
+    CBlock decoded;
+    CBlockCompressor compressed(decoded);
+    ss >> compressed;
+    BOOST_CHECK(ss.empty());
+    BOOST_REQUIRE_EQUAL(decoded.vtx.size(), 1U);
+    BOOST_REQUIRE_EQUAL(decoded.vtx[0]->vout.size(), block.vtx[0]->vout.size());
+    for (size_t i = 0; i < block.vtx[0]->vout.size(); i++) {
+        BOOST_CHECK(decoded.vtx[0]->vout[i] == block.vtx[0]->vout[i]);
+    }
+    BOOST_CHECK(BlockMerkleRoot(decoded) == block.hashMerkleRoot);
+
+    // The chainstate encoding still replaces the long script
+    CDataStream ssOut(SER_DISK, PROTOCOL_VERSION);
+    ssOut << CTxOutCompressor(REF(block.vtx[0]->vout[0]));
+    CTxOut out;
+    ssOut >> REF(CTxOutCompressor(out));
+    BOOST_CHECK(out.scriptPubKey == CScript() << OP_RETURN);
+
+    // An impossible script length is rejected instead of allocated
+    CDataStream ssBad(SER_DISK, PROTOCOL_VERSION);
+    ssBad << VARINT(0xffffffffU);
+    CScript script;
+    CScriptCompressor scriptCompressor(script, true);
+    BOOST_CHECK_THROW(ssBad >> scriptCompressor, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+struct CompressedTxIndexSetup : public TestingSetup {
+    CompressedTxIndexSetup() : TestingSetup(CBaseChainParams::REGTEST)
+    {
+        fCompressBlocks = true;
+        fTxIndex = true;
+    }
+    ~CompressedTxIndexSetup()
+    {
+        fCompressBlocks = DEFAULT_COMPRESS_BLOCKS;
+        fTxIndex = DEFAULT_TXINDEX;
+    }
+
+    static const CBlockIndex* Tip()
+    {
+        LOCK(cs_main);
+        return chainActive.Tip();
+    }
+
+    /** Mine a min-difficulty block with the given transactions on the tip */
+    CBlock MineBlock(std::vector<CMutableTransaction> vtx)
+    {
+        const Consensus::Params& consensus = Params().GetConsensus();
+        const CBlockIndex* pindexPrev = Tip();
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << OP_0;
+        coinbase.vout.emplace_back(GetBlockSubsidy(pindexPrev->nHeight + 1, consensus), CScript() << OP_TRUE);
+
+        CBlock block;
+        block.nVersion = VERSIONBITS_TOP_BITS;
+        block.hashPrevBlock = pindexPrev->GetBlockHash();
+        block.nTime = pindexPrev->nTime + 2 * consensus.nPowTargetSpacing + 1;
+        block.nBits = UintToArith256(consensus.powLimit).GetCompact();
+        block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+        for (CMutableTransaction& tx : vtx) {
+            block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+        }
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensus)) {
+            ++block.nNonce;
+        }
+        BOOST_CHECK(ProcessNewBlock(Params(), std::make_shared<const CBlock>(block), true, nullptr));
+        return block;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(compress_txindex_tests, CompressedTxIndexSetup)
+
+BOOST_AUTO_TEST_CASE(compressed_block_txindex)
+{
+    // Mature the first coinbase, then spend it next to another transaction
+    const CBlock first = MineBlock({});
+    for (int i = 0; i < COINBASE_MATURITY; i++) {
+        MineBlock({});
+    }
+    CMutableTransaction spend;
+    spend.vin.emplace_back(COutPoint(first.vtx[0]->GetHash(), 0));
+    AddUnusualOutputs(spend, first.vtx[0]->vout[0].nValue);
+    const CBlock block = MineBlock({spend});
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    }
+
+    // The block index records each block's encoding; the genesis block was
+    // written before -compressblocks was set
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip()->nStatus & BLOCK_STORED_COMPRESSED);
+        BOOST_CHECK(!(chainActive.Genesis()->nStatus & BLOCK_STORED_COMPRESSED));
+    }
+
+    // The transaction index points into the compressed block
+    for (const CTransactionRef& tx : block.vtx) {
+        CTransactionRef txOut;
+        uint256 hashBlock;
+        BOOST_REQUIRE(GetTransaction(tx->GetHash(), txOut, Params().GetConsensus(), hashBlock, false));
+        BOOST_CHECK(txOut->GetWitnessHash() == tx->GetWitnessHash());
+        BOOST_CHECK(hashBlock == block.GetHash());
+    }
+
+    CBlock read;
+    BOOST_REQUIRE(ReadBlockFromDisk(read, Tip(), Params().GetConsensus()));
+    BOOST_CHECK(BlockMerkleRoot(read) == block.hashMerkleRoot);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -377,4 +377,40 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+BOOST_AUTO_TEST_CASE(sharded_signature_cache)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CShardedSignatureCache cache;
+    size_t nCapacity = cache.setup_bytes(1 << 16);
+    BOOST_CHECK_EQUAL(cache.GetStats().nCapacity, nCapacity);
+    BOOST_CHECK(nCapacity >= CShardedSignatureCache::SHARDS * 2);
+
+    std::vector<uint256> hashes(nCapacity / 4);
+    for (uint256& h : hashes) {
+        h = local_rand_ctx.rand256();
+        cache.insert(h);
+    }
+    for (const uint256& h : hashes) {
+        BOOST_CHECK(cache.contains(h, false));
+        BOOST_CHECK(!cache.contains(local_rand_ctx.rand256(), false));
+    }
+    SignatureCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nShards, CShardedSignatureCache::SHARDS);
+    BOOST_CHECK_EQUAL(stats.nHits, hashes.size());
+    BOOST_CHECK_EQUAL(stats.nMisses, hashes.size());
+    BOOST_CHECK_EQUAL(stats.nInserts, hashes.size());
+    BOOST_CHECK_EQUAL(stats.nEvictions, 0U);
+
+    // Overfilling the cache has to push entries out
+    for (size_t i = 0; i < nCapacity * 2; i++) {
+        cache.insert(local_rand_ctx.rand256());
+    }
+    BOOST_CHECK(cache.GetStats().nEvictions > 0);
+
+    cache.ResetStats();
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nHits + stats.nMisses + stats.nInserts + stats.nEvictions, 0U);
+    BOOST_CHECK_EQUAL(stats.nCapacity, nCapacity);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -79,6 +79,42 @@ BOOST_AUTO_TEST_CASE(dbwrapper_batch)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_readmany)
+{
+    // Perform tests both obfuscated and non-obfuscated.
+    for (bool obfuscate : {false, true}) {
+        fs::path ph = fs::temp_directory_path() / fs::unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        // Enough keys to be read from several threads, half of them absent
+        std::vector<uint32_t> keys;
+        std::map<uint32_t, uint256> written;
+        for (uint32_t i = 0; i < 2000; i++) {
+            keys.push_back(InsecureRand32());
+            if (i % 2 == 0) {
+                written[keys.back()] = InsecureRand256();
+                BOOST_CHECK(dbw.Write(keys.back(), written[keys.back()]));
+            }
+        }
+
+        std::vector<uint256> values;
+        std::vector<char> found;
+        BOOST_CHECK_EQUAL(dbw.ReadMany(keys, values, found), written.size());
+        BOOST_CHECK_EQUAL(values.size(), keys.size());
+        BOOST_CHECK_EQUAL(found.size(), keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            auto it = written.find(keys[i]);
+            BOOST_CHECK_EQUAL(found[i], it != written.end());
+            BOOST_CHECK(values[i] == (it != written.end() ? it->second : uint256()));
+        }
+
+        // An empty batch
+        keys.clear();
+        BOOST_CHECK_EQUAL(dbw.ReadMany(keys, values, found), 0U);
+        BOOST_CHECK(values.empty() && found.empty());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
 {
     // Perform tests both obfuscated and non-obfuscated.
@@ -319,4 +355,35 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
 
 
 
+BOOST_AUTO_TEST_CASE(dbwrapper_options_and_stats)
+{
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    CDBOptions dboptions;
+    dboptions.block_size = 16 * 1024;
+    dboptions.bloom_bits = 0;
+    dboptions.max_file_size = 64 * 1024;
+    CDBWrapper dbw(ph, (1 << 20), true, false, false, dboptions);
+    BOOST_CHECK_EQUAL(dbw.GetDBOptions().block_size, dboptions.block_size);
+    BOOST_CHECK_EQUAL(dbw.GetDBOptions().bloom_bits, 0);
+
+    for (int i = 0; i < 1000; i++) {
+        BOOST_CHECK(dbw.Write(i, InsecureRand256()));
+    }
+    dbw.CompactRange(0, 1000);
+
+    std::vector<CDBLevelStats> levels = dbw.GetLevelStats();
+    BOOST_CHECK_EQUAL(levels.size(), 7U);
+    int files = 0;
+    for (size_t i = 0; i < levels.size(); i++) {
+        BOOST_CHECK_EQUAL(levels[i].level, (int)i);
+        files += levels[i].files;
+    }
+    BOOST_CHECK(files > 0);
+
+    std::string stats;
+    BOOST_CHECK(dbw.GetProperty("leveldb.stats", stats));
+    BOOST_CHECK(stats.find("Compactions") != std::string::npos);
+    BOOST_CHECK(!dbw.GetProperty("leveldb.no-such-property", stats));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -105,6 +105,18 @@ BOOST_AUTO_TEST_CASE(siphash)
 
     BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, uint256S("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100")), 0x7127512f72f27cceull);
 
+    // Check the four-way version against the scalar one
+    for (int i = 0; i < 100; ++i) {
+        uint64_t k0 = InsecureRandBits(64), k1 = InsecureRandBits(64);
+        uint256 vals[4] = {InsecureRand256(), InsecureRand256(), InsecureRand256(), InsecureRand256()};
+        const uint256* pvals[4] = {&vals[0], &vals[1], &vals[2], &vals[3]};
+        uint64_t out[4];
+        SipHashUint256x4(k0, k1, pvals, out);
+        for (int l = 0; l < 4; ++l) {
+            BOOST_CHECK_EQUAL(out[l], SipHashUint256(k0, k1, vals[l]));
+        }
+    }
+
     // Check test vectors from spec, one byte at a time
     CSipHasher hasher2(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
     for (uint8_t x=0; x<ARRAYLEN(siphash_4_2_testvec); ++x)
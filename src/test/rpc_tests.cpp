@@ -322,6 +322,102 @@ BOOST_AUTO_TEST_CASE(rpc_ban)
     BOOST_CHECK_EQUAL(adr.get_str(), "2001:4d48:ac57:400:cacf:e9ff:fe1d:9c63/128");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_getrpcstats)
+{
+    if (RPCIsInWarmup(nullptr))
+        SetRPCWarmupFinished();
+    CallRPC("getrpcstats true");
+
+    JSONRPCRequest request;
+    request.strMethod = "uptime";
+    request.params = UniValue(UniValue::VARR);
+    BOOST_CHECK_NO_THROW(tableRPC.execute(request));
+    BOOST_CHECK_NO_THROW(tableRPC.execute(request));
+    request.strMethod = "getblockhash";
+    request.params.push_back(-1);
+    BOOST_CHECK_THROW(tableRPC.execute(request), UniValue);
+
+    UniValue r = CallRPC("getrpcstats true");
+    UniValue uptime = find_value(r.get_obj(), "uptime");
+    BOOST_CHECK_EQUAL(find_value(uptime, "calls").get_int(), 2);
+    BOOST_CHECK_EQUAL(find_value(uptime, "errors").get_int(), 0);
+    BOOST_CHECK(find_value(uptime, "max_us").get_int64() <= find_value(uptime, "total_us").get_int64());
+    int64_t nBucketed = 0;
+    for (const UniValue& count : find_value(uptime, "histogram").getValues())
+        nBucketed += count.get_int64();
+    BOOST_CHECK_EQUAL(nBucketed, 2);
+    UniValue getblockhash = find_value(r.get_obj(), "getblockhash");
+    BOOST_CHECK_EQUAL(find_value(getblockhash, "calls").get_int(), 1);
+    BOOST_CHECK_EQUAL(find_value(getblockhash, "errors").get_int(), 1);
+
+    // The statistics were reset by the previous call
+    r = CallRPC("getrpcstats");
+    BOOST_CHECK(r.get_obj().empty());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_getlockstats)
+{
+    CCriticalSection cs_test;
+    CallRPC("setlockprofiling false");
+    CallRPC("getlockstats true");
+    {
+        LOCK(cs_test);
+    }
+    UniValue r = CallRPC("getlockstats");
+    BOOST_CHECK(!find_value(r.get_obj(), "enabled").get_bool());
+    BOOST_CHECK(find_value(r.get_obj(), "sites").empty());
+
+    CallRPC("setlockprofiling true 1");
+    for (int i = 0; i < 3; i++) {
+        LOCK(cs_test);
+        MilliSleep(1);
+    }
+    {
+        TRY_LOCK(cs_test, lockTest);
+        BOOST_CHECK(static_cast<bool>(lockTest));
+    }
+    CallRPC("setlockprofiling false");
+
+    r = CallRPC("getlockstats true");
+    BOOST_CHECK(find_value(r.get_obj(), "enabled").isFalse());
+    UniValue test = find_value(find_value(r.get_obj(), "locks"), "cs_test");
+    BOOST_CHECK_EQUAL(find_value(test, "acquisitions").get_int(), 4);
+    BOOST_CHECK_EQUAL(find_value(test, "contended").get_int(), 0);
+    BOOST_CHECK(find_value(test, "hold_us").get_int64() >= 3000);
+    BOOST_CHECK(find_value(test, "max_hold_us").get_int64() >= 1000);
+    int64_t nBucketed = 0;
+    for (const UniValue& count : find_value(test, "hold_histogram").getValues())
+        nBucketed += count.get_int64();
+    BOOST_CHECK_EQUAL(nBucketed, 4);
+
+    // One entry for the loop and one for the TRY_LOCK
+    int nSites = 0;
+    for (const UniValue& site : find_value(r.get_obj(), "sites").getValues()) {
+        if (find_value(site, "lock").get_str() != "cs_test") continue;
+        nSites++;
+        BOOST_CHECK(find_value(site, "site").get_str().find("test/rpc_tests.cpp:") == 0);
+    }
+    BOOST_CHECK_EQUAL(nSites, 2);
+
+    // The statistics were reset by the previous call
+    r = CallRPC("getlockstats");
+    BOOST_CHECK(find_value(r.get_obj(), "sites").empty());
+
+    // Only one in sample_rate acquisitions of this thread is recorded
+    CallRPC("setlockprofiling true 4");
+    for (int i = 0; i < 8; i++) {
+        LOCK(cs_test);
+    }
+    CallRPC("setlockprofiling false");
+    r = CallRPC("getlockstats true");
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "sample_rate").get_int(), 4);
+    test = find_value(find_value(r.get_obj(), "locks"), "cs_test");
+    BOOST_CHECK_EQUAL(find_value(test, "acquisitions").get_int(), 2);
+
+    BOOST_CHECK_THROW(CallRPC("setlockprofiling true 0"), std::runtime_error);
+    CallRPC("setlockprofiling false 1");
+}
+
 BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
 {
     UniValue result;
@@ -2,8 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <primitives/transaction.h>
 #include <random.h>
 #include <scheduler.h>
+#include <validationinterface.h>
 
 #include <test/test_bitcoin.h>
 
@@ -11,6 +13,9 @@
 #include <boost/thread.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <thread>
+
 BOOST_AUTO_TEST_SUITE(scheduler_tests)
 
 static void microTask(CScheduler& s, boost::mutex& mutex, int& counter, int delta, boost::chrono::system_clock::time_point rescheduleTime)
@@ -112,4 +117,159 @@ BOOST_AUTO_TEST_CASE(manythreads)
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+BOOST_AUTO_TEST_CASE(priorities)
+{
+    CScheduler scheduler;
+    std::vector<std::string> order;
+    auto record = [&order](const std::string& name) { return [&order, name] { order.push_back(name); }; };
+
+    // All due at once, scheduled lowest priority first; a single thread runs them in priority order
+    boost::chrono::system_clock::time_point past = boost::chrono::system_clock::now() - boost::chrono::seconds(1);
+    scheduler.schedule(record("low"), past, CScheduler::Priority::LOW, "low");
+    scheduler.schedule(record("normal"), past, CScheduler::Priority::NORMAL, "normal");
+    scheduler.schedule(record("high"), past, CScheduler::Priority::HIGH, "high");
+    scheduler.schedule(record("normal"), past, CScheduler::Priority::NORMAL, "normal");
+    scheduler.stop(true);
+    scheduler.serviceQueue();
+
+    BOOST_CHECK((order == std::vector<std::string>{"high", "normal", "normal", "low"}));
+    std::map<std::string, CScheduler::TaskStats> stats = scheduler.getTaskStats();
+    BOOST_CHECK_EQUAL(stats.size(), 3U);
+    BOOST_CHECK_EQUAL(stats["normal"].count, 2U);
+    BOOST_CHECK(stats["low"].priority == CScheduler::Priority::LOW);
+    uint64_t runs = 0;
+    for (uint64_t n : stats["normal"].histogram) runs += n;
+    BOOST_CHECK_EQUAL(runs, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(low_priority_leaves_a_thread)
+{
+    CScheduler scheduler;
+    std::atomic<bool> release(false);
+    std::atomic<int> lowRunning(0), maxLowRunning(0), highRun(0);
+    auto low = [&] {
+        int running = ++lowRunning;
+        int prev = maxLowRunning;
+        while (running > prev && !maxLowRunning.compare_exchange_weak(prev, running)) {}
+        while (!release) MicroSleep(1000);
+        --lowRunning;
+    };
+
+    boost::thread_group threads;
+    for (int i = 0; i < 2; i++) {
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    }
+    while (scheduler.getNumThreads() < 2) MicroSleep(1000);
+
+    // Two slow LOW tasks may only occupy one of the two threads, so the HIGH task still runs
+    scheduler.schedule(low, boost::chrono::system_clock::now(), CScheduler::Priority::LOW);
+    scheduler.schedule(low, boost::chrono::system_clock::now(), CScheduler::Priority::LOW);
+    MicroSleep(50000);
+    scheduler.schedule([&highRun] { ++highRun; }, boost::chrono::system_clock::now(), CScheduler::Priority::HIGH);
+    for (int i = 0; i < 1000 && highRun == 0; i++) MicroSleep(1000);
+    BOOST_CHECK_EQUAL(highRun, 1);
+    BOOST_CHECK_EQUAL(maxLowRunning, 1);
+
+    release = true;
+    scheduler.stop(true);
+    threads.join_all();
+    BOOST_CHECK_EQUAL(maxLowRunning, 1);
+    BOOST_CHECK_EQUAL(scheduler.getTaskStats()["other"].count, 3U);
+}
+
+struct CountingSubscriber : public CValidationInterface {
+    std::atomic<int> m_count{0};
+    std::atomic<bool> m_blocked{false};
+    std::atomic<bool> m_started{false};
+
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override
+    {
+        m_started = true;
+        while (m_blocked) {
+            MilliSleep(10);
+        }
+        m_count++;
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(validationinterface_subscriber_queues, TestingSetup)
+{
+    // A second scheduler thread, so that one subscriber can be served while the other is stuck
+    boost::thread extra_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+
+    CountingSubscriber slow;
+    CountingSubscriber fast;
+    slow.m_blocked = true;
+    RegisterValidationInterface(&slow, "slow");
+    RegisterValidationInterface(&fast, "fast");
+
+    CTransactionRef tx = MakeTransactionRef(CMutableTransaction());
+    for (int i = 0; i < 3; i++) {
+        GetMainSignals().TransactionAddedToMempool(tx);
+    }
+
+    // The fast subscriber gets every notification while the slow one is stuck on its first
+    for (int i = 0; i < 500 && fast.m_count < 3; i++) {
+        MilliSleep(10);
+    }
+    BOOST_CHECK_EQUAL(fast.m_count, 3);
+    BOOST_CHECK_EQUAL(slow.m_count, 0);
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(&fast), 0U);
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(&slow), 2U);
+
+    bool found = false;
+    for (const ValidationQueueInfo& info : GetMainSignals().GetQueueInfo()) {
+        if (info.name != "fast") continue;
+        found = true;
+        BOOST_CHECK_EQUAL(info.callbacks, 3U);
+        BOOST_CHECK_EQUAL(info.pending, 0U);
+        BOOST_CHECK(info.max_pending >= 1);
+    }
+    BOOST_CHECK(found);
+
+    // Syncing with the queue still waits for every subscriber
+    slow.m_blocked = false;
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(slow.m_count, 3);
+
+    // Notifications queued for an unregistered subscriber are dropped
+    auto gate = std::make_shared<std::atomic<bool>>(true);
+    CallFunctionInValidationInterfaceQueue(&slow, [gate] {
+        while (*gate) {
+            MilliSleep(10);
+        }
+    });
+    GetMainSignals().TransactionAddedToMempool(tx);
+    UnregisterValidationInterface(&slow);
+    *gate = false;
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(slow.m_count, 3);
+    BOOST_CHECK_EQUAL(fast.m_count, 4);
+
+    UnregisterValidationInterface(&fast);
+
+    // Unregistering waits for a callback that is already running
+    CountingSubscriber busy;
+    busy.m_blocked = true;
+    RegisterValidationInterface(&busy, "busy");
+    GetMainSignals().TransactionAddedToMempool(tx);
+    for (int i = 0; i < 500 && !busy.m_started; i++) {
+        MilliSleep(10);
+    }
+    BOOST_REQUIRE(busy.m_started);
+    std::atomic<bool> unregistered{false};
+    std::thread unregister([&busy, &unregistered] {
+        UnregisterValidationInterface(&busy);
+        unregistered = true;
+    });
+    MilliSleep(100);
+    BOOST_CHECK(!unregistered);
+    busy.m_blocked = false;
+    unregister.join();
+    BOOST_CHECK_EQUAL(busy.m_count, 1);
+
+    extra_thread.interrupt();
+    extra_thread.join();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
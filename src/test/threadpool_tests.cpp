@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <threadpool.h>
+
+#include <test/test_bitcoin.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(threadpool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(parallel_for)
+{
+    // Every index is visited exactly once, whatever the thread count
+    for (int nThreads : {0, 1, 2, 8}) {
+        for (size_t nCount : {(size_t)0, (size_t)1, (size_t)3, (size_t)1000}) {
+            std::vector<std::atomic<int>> vCalls(nCount);
+            for (std::atomic<int>& calls : vCalls)
+                calls = 0;
+            ParallelFor(nCount, nThreads, [&](size_t i) { vCalls[i]++; });
+            for (const std::atomic<int>& calls : vCalls)
+                BOOST_CHECK_EQUAL(calls.load(), 1);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for_nested)
+{
+    // Batches started from inside a batch, and from several threads at once,
+    // finish even though the pool threads are all busy
+    std::atomic<int> nCalls(0);
+    auto outer = [&]() {
+        ParallelFor(16, 4, [&](size_t) {
+            ParallelFor(16, 4, [&](size_t) { nCalls++; });
+        });
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++)
+        threads.emplace_back(outer);
+    for (std::thread& thread : threads)
+        thread.join();
+    BOOST_CHECK_EQUAL(nCalls.load(), 4 * 16 * 16);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for_exception)
+{
+    std::atomic<int> nCalls(0);
+    BOOST_CHECK_THROW(ParallelFor(1000, 4, [&](size_t i) {
+        nCalls++;
+        if (i == 10)
+            throw std::runtime_error("parallel_for_exception");
+    }), std::runtime_error);
+    BOOST_CHECK(nCalls.load() <= 1000);
+
+    // The pool is still usable afterwards
+    nCalls = 0;
+    ParallelFor(100, 4, [&](size_t) { nCalls++; });
+    BOOST_CHECK_EQUAL(nCalls.load(), 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,11 +6,13 @@
 
 #include <clientversion.h>
 #include <primitives/transaction.h>
+#include <ringbuffer.h>
 #include <sync.h>
 #include <utilstrencodings.h>
 #include <utilmoneystr.h>
 #include <test/test_bitcoin.h>
 
+#include <algorithm>
 #include <stdint.h>
 #include <vector>
 #ifndef WIN32
@@ -20,6 +22,7 @@
 #endif
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(util_tests, BasicTestingSetup)
 
@@ -50,6 +53,52 @@ static const unsigned char ParseHex_expected[65] = {
     0xde, 0x5c, 0x38, 0x4d, 0xf7, 0xba, 0x0b, 0x8d, 0x57, 0x8a, 0x4c, 0x70, 0x2b, 0x6b, 0xf1, 0x1d,
     0x5f
 };
+BOOST_AUTO_TEST_CASE(util_ringbuffer)
+{
+    CRingBuffer<std::string> buffer(4);
+    std::string str;
+    BOOST_CHECK(!buffer.TryPop(str));
+
+    // Fill it, wrapping around a few times
+    for (int lap = 0; lap < 3; lap++) {
+        for (int i = 0; i < 4; i++) {
+            BOOST_CHECK(buffer.TryPush(std::to_string(i)));
+        }
+        BOOST_CHECK(!buffer.TryPush("full"));
+        for (int i = 0; i < 4; i++) {
+            BOOST_CHECK(buffer.TryPop(str));
+            BOOST_CHECK_EQUAL(str, std::to_string(i));
+        }
+        BOOST_CHECK(!buffer.TryPop(str));
+    }
+
+    // Several producers and one consumer: nothing lost, each producer's values in order
+    CRingBuffer<int> ints(64);
+    const int nProducers = 4, nValues = 20000;
+    boost::thread_group producers;
+    for (int p = 0; p < nProducers; p++) {
+        producers.create_thread([&ints, p] {
+            for (int i = 0; i < nValues; i++) {
+                while (!ints.TryPush(p * nValues + i)) {
+                    boost::this_thread::yield();
+                }
+            }
+        });
+    }
+    std::vector<int> next(nProducers, 0);
+    for (int n = 0; n < nProducers * nValues; ) {
+        int value;
+        if (!ints.TryPop(value)) {
+            boost::this_thread::yield();
+            continue;
+        }
+        BOOST_CHECK_EQUAL(value % nValues, next[value / nValues]++);
+        n++;
+    }
+    producers.join_all();
+    BOOST_CHECK(std::all_of(next.begin(), next.end(), [](int n) { return n == nValues; }));
+}
+
 BOOST_AUTO_TEST_CASE(util_ParseHex)
 {
     std::vector<unsigned char> result;
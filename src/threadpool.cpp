@@ -0,0 +1,146 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <threadpool.h>
+
+#include <util.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/** A ParallelFor call, owned by the thread that made it */
+struct ParallelJob
+{
+    const std::function<void(size_t)>& fn;
+    const size_t nCount;
+    std::atomic<size_t> nNext;
+    //! Pool threads allowed to help, and helping right now (guarded by the pool mutex)
+    int nHelpers;
+    int nActive;
+    //! First exception thrown by fn (guarded by the pool mutex)
+    std::exception_ptr error;
+
+    ParallelJob(const std::function<void(size_t)>& fnIn, size_t nCountIn, int nHelpersIn)
+        : fn(fnIn), nCount(nCountIn), nNext(0), nHelpers(nHelpersIn), nActive(0) {}
+
+    bool NeedsHelp() const { return nActive < nHelpers && nNext.load() < nCount; }
+};
+
+class ThreadPool
+{
+public:
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond_work.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    void Run(ParallelJob& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while ((int)m_threads.size() < std::min(job.nHelpers, MAX_THREADPOOL_THREADS)) {
+                m_threads.emplace_back(&ThreadPool::Worker, this);
+            }
+            m_jobs.push_back(&job);
+        }
+        m_cond_work.notify_all();
+
+        Work(job);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        // Once off the list no pool thread can pick the job up, so it is
+        // finished when the ones already on it are done
+        m_jobs.remove(&job);
+        m_cond_done.wait(lock, [&job] { return job.nActive == 0; });
+        if (job.error) {
+            std::rethrow_exception(job.error);
+        }
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond_work;
+    std::condition_variable m_cond_done;
+    std::list<ParallelJob*> m_jobs;
+    std::vector<std::thread> m_threads;
+    bool m_stop = false;
+
+    void Work(ParallelJob& job)
+    {
+        try {
+            for (size_t i = job.nNext++; i < job.nCount; i = job.nNext++) {
+                job.fn(i);
+            }
+        } catch (...) {
+            job.nNext = job.nCount;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!job.error) {
+                job.error = std::current_exception();
+            }
+        }
+    }
+
+    void Worker()
+    {
+        RenameThread("theholyroger-worker");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            ParallelJob* job = nullptr;
+            m_cond_work.wait(lock, [this, &job] {
+                for (ParallelJob* candidate : m_jobs) {
+                    if (candidate->NeedsHelp()) {
+                        job = candidate;
+                        return true;
+                    }
+                }
+                return m_stop;
+            });
+            if (!job) {
+                return;
+            }
+            job->nActive++;
+            lock.unlock();
+            Work(*job);
+            lock.lock();
+            if (--job->nActive == 0) {
+                m_cond_done.notify_all();
+            }
+        }
+    }
+};
+
+} // namespace
+
+void ParallelFor(size_t nCount, int nMaxThreads, const std::function<void(size_t)>& fn)
+{
+    if (nCount == 0) {
+        return;
+    }
+    const int nHelpers = (int)std::min<size_t>(std::max(nMaxThreads, 1), nCount) - 1;
+    if (nHelpers == 0) {
+        for (size_t i = 0; i < nCount; i++) {
+            fn(i);
+        }
+        return;
+    }
+
+    static ThreadPool pool;
+    ParallelJob job(fn, nCount, nHelpers);
+    pool.Run(job);
+}
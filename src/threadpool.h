@@ -0,0 +1,28 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_THREADPOOL_H
+#define BITCOIN_THREADPOOL_H
+
+#include <functional>
+#include <stddef.h>
+
+/** Maximum number of threads kept in the shared pool used by ParallelFor */
+static const int MAX_THREADPOOL_THREADS = 63;
+
+/**
+ * Call fn(i) for every i in [0, nCount), spread over the calling thread and
+ * up to nMaxThreads - 1 threads of a pool shared by the whole process, and
+ * return once all calls have returned. Pool threads are started the first
+ * time they are needed and then kept, so batches do not pay for creating
+ * threads.
+ *
+ * The calling thread always works on its own batch, so a batch finishes even
+ * when all pool threads are busy with other batches, and ParallelFor may be
+ * called from within fn. If fn throws, remaining indexes are skipped and the
+ * first exception is rethrown on the calling thread.
+ */
+void ParallelFor(size_t nCount, int nMaxThreads, const std::function<void(size_t)>& fn);
+
+#endif // BITCOIN_THREADPOOL_H
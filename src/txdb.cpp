@@ -11,6 +11,7 @@
 #include <pow.h>
 #include <uint256.h>
 #include <util.h>
+#include <utilstrencodings.h>
 #include <ui_interface.h>
 #include <init.h>
 
@@ -54,7 +55,55 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+/**
+ * Apply the -dboption=<db>:<option>=<n> settings for the database called
+ * strName on top of its default tuning.
+ */
+static CDBOptions ApplyDBOptionArgs(const std::string& strName, CDBOptions dboptions)
+{
+    for (const std::string& strArg : gArgs.GetArgs("-dboption")) {
+        size_t nColon = strArg.find(':');
+        size_t nEquals = strArg.find('=', nColon);
+        if (nColon == std::string::npos || nEquals == std::string::npos || strArg.substr(0, nColon) != strName)
+            continue;
+        const std::string strOption = strArg.substr(nColon + 1, nEquals - nColon - 1);
+        int64_t nValue = 0;
+        if (!ParseInt64(strArg.substr(nEquals + 1), &nValue) || nValue < 0 || nValue > std::numeric_limits<int>::max()) {
+            LogPrintf("Ignoring invalid -dboption=%s\n", strArg);
+            continue;
+        }
+        if (strOption == "blocksize") {
+            dboptions.block_size = nValue;
+        } else if (strOption == "compression") {
+            dboptions.compression = nValue != 0;
+        } else if (strOption == "bloombits") {
+            dboptions.bloom_bits = nValue;
+        } else if (strOption == "maxopenfiles") {
+            dboptions.max_open_files = nValue;
+        } else if (strOption == "maxfilesize") {
+            dboptions.max_file_size = nValue;
+        } else if (strOption == "writebuffersize") {
+            dboptions.write_buffer_size = nValue;
+        } else {
+            LogPrintf("Ignoring unknown -dboption=%s\n", strArg);
+        }
+    }
+    return dboptions;
+}
+
+/**
+ * The block index is mostly read sequentially while loading, so it gets
+ * larger blocks. Its records are repetitive, but the bundled LevelDB is
+ * built without Snappy, so compression stays off.
+ */
+static CDBOptions BlockTreeDBOptions()
+{
+    CDBOptions dboptions;
+    dboptions.block_size = 16 * 1024;
+    return dboptions;
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, ApplyDBOptionArgs("chainstate", CDBOptions()))
 {
 }
 
@@ -62,6 +111,15 @@ bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
+size_t CCoinsViewDB::GetCoins(const std::vector<COutPoint> &outpoints, std::vector<Coin> &coins) const {
+    std::vector<CoinEntry> keys;
+    keys.reserve(outpoints.size());
+    for (const COutPoint &outpoint : outpoints)
+        keys.emplace_back(&outpoint);
+    std::vector<char> found;
+    return db.ReadMany(keys, coins, found);
+}
+
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
     return db.Exists(CoinEntry(&outpoint));
 }
@@ -147,7 +205,7 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, ApplyDBOptionArgs("blockindex", BlockTreeDBOptions())) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -904,6 +904,35 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return base->GetCoin(outpoint, coin);
 }
 
+size_t CCoinsViewMemPool::GetCoins(const std::vector<COutPoint> &outpoints, std::vector<Coin> &coins) const {
+    // Mempool outputs take precedence, as in GetCoin; everything else is
+    // looked up in the base view in one batch.
+    size_t nFound = 0;
+    coins.clear();
+    coins.resize(outpoints.size());
+    std::vector<COutPoint> vBase;
+    std::vector<size_t> vBaseIndex;
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        CTransactionRef ptx = mempool.get(outpoints[i].hash);
+        if (ptx) {
+            if (outpoints[i].n < ptx->vout.size()) {
+                coins[i] = Coin(ptx->vout[outpoints[i].n], MEMPOOL_HEIGHT, false);
+                nFound++;
+            }
+        } else {
+            vBase.push_back(outpoints[i]);
+            vBaseIndex.push_back(i);
+        }
+    }
+    if (!vBase.empty()) {
+        std::vector<Coin> vBaseCoins;
+        nFound += base->GetCoins(vBase, vBaseCoins);
+        for (size_t i = 0; i < vBase.size(); i++)
+            coins[vBaseIndex[i]] = std::move(vBaseCoins[i]);
+    }
+    return nFound;
+}
+
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
@@ -7,6 +7,7 @@
 
 #include <chainparamsbase.h>
 #include <random.h>
+#include <ringbuffer.h>
 #include <serialize.h>
 #include <utilstrencodings.h>
 
@@ -173,6 +174,29 @@ static FILE* fileout = nullptr;
 static boost::mutex* mutexDebugLog = nullptr;
 static std::list<std::string>* vMsgsBeforeOpenLog;
 
+/**
+ * With StartLogWriter(), LogPrintStr only queues messages in logBuffer and a
+ * background thread writes them, so that logging threads never wait for
+ * the disk, the console or each other. When the buffer is full messages are
+ * dropped and counted rather than blocking the caller. The buffer is full
+ * once the queued messages add up to LOG_BUFFER_BYTES, or once all of its
+ * LOG_BUFFER_MESSAGES slots are taken.
+ */
+static const size_t LOG_BUFFER_BYTES = 4 << 20;
+static const size_t LOG_BUFFER_MESSAGES = 8192;
+static CRingBuffer<std::string>* logBuffer = nullptr;
+//! Total size of the messages queued in logBuffer
+static std::atomic<size_t> nLogBufferBytes(0);
+static std::atomic<bool> fLogAsync(false);
+static std::atomic<bool> fLogWriterStop(false);
+//! Set from StartLogWriter() until StopLogWriter() has drained logBuffer
+static std::atomic<bool> fLogWriterActive(false);
+static std::atomic<uint64_t> nLogMessagesDropped(0);
+static boost::thread* logWriterThread = nullptr;
+//! Serializes the consumers of logBuffer, and direct writes against the final drain in StopLogWriter()
+static boost::mutex* mutexLogDrain = nullptr;
+static boost::condition_variable* condLogWriter = nullptr;
+
 static int FileWriteStr(const std::string &str, FILE *fp)
 {
     return fwrite(str.data(), 1, str.size(), fp);
@@ -183,6 +207,9 @@ static void DebugPrintInit()
     assert(mutexDebugLog == nullptr);
     mutexDebugLog = new boost::mutex();
     vMsgsBeforeOpenLog = new std::list<std::string>;
+    logBuffer = new CRingBuffer<std::string>(LOG_BUFFER_MESSAGES);
+    mutexLogDrain = new boost::mutex();
+    condLogWriter = new boost::condition_variable();
 }
 
 fs::path GetDebugLogPath()
@@ -336,12 +363,9 @@ static std::string LogTimestampStr(const std::string &str, std::atomic_bool *fSt
     return strStamped;
 }
 
-int LogPrintStr(const std::string &str)
+static int LogWriteStr(const std::string &strTimestamped)
 {
     int ret = 0; // Returns total number of characters written
-    static std::atomic_bool fStartedNewLine(true);
-
-    std::string strTimestamped = LogTimestampStr(str, &fStartedNewLine);
 
     if (fPrintToConsole)
     {
@@ -376,6 +400,95 @@ int LogPrintStr(const std::string &str)
     return ret;
 }
 
+int LogPrintStr(const std::string &str)
+{
+    static std::atomic_bool fStartedNewLine(true);
+
+    std::string strTimestamped = LogTimestampStr(str, &fStartedNewLine);
+
+    if (fLogAsync) {
+        const size_t nSize = strTimestamped.size();
+        if (nLogBufferBytes.fetch_add(nSize) + nSize > LOG_BUFFER_BYTES ||
+            !logBuffer->TryPush(std::move(strTimestamped))) {
+            nLogBufferBytes -= nSize;
+            nLogMessagesDropped++;
+            return 0;
+        }
+        condLogWriter->notify_one();
+        // StopLogWriter() may have done its final drain since we checked
+        if (!fLogAsync) {
+            FlushLogWriter();
+        }
+        return nSize;
+    }
+    if (fLogWriterActive) {
+        // Do not overtake messages that StopLogWriter() is still draining
+        boost::mutex::scoped_lock scoped_lock(*mutexLogDrain);
+        return LogWriteStr(strTimestamped);
+    }
+    return LogWriteStr(strTimestamped);
+}
+
+/** Write out the queued log messages. mutexLogDrain must be held. */
+static void DrainLogBuffer()
+{
+    std::string str;
+    while (logBuffer->TryPop(str)) {
+        nLogBufferBytes -= str.size();
+        LogWriteStr(str);
+    }
+    uint64_t nDropped = nLogMessagesDropped.exchange(0);
+    if (nDropped) {
+        LogWriteStr(strprintf("*** %u log messages dropped because the log buffer was full\n", nDropped));
+    }
+}
+
+void FlushLogWriter()
+{
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    boost::mutex::scoped_lock scoped_lock(*mutexLogDrain);
+    DrainLogBuffer();
+}
+
+static void ThreadLogWriter()
+{
+    RenameThread("bitcoin-logwriter");
+    while (!fLogWriterStop) {
+        FlushLogWriter();
+        boost::mutex::scoped_lock scoped_lock(*mutexLogDrain);
+        // Producers notify without taking the lock, so a wakeup can be
+        // missed; the timeout bounds how long a message can sit in the buffer.
+        condLogWriter->timed_wait(scoped_lock, boost::posix_time::milliseconds(100));
+    }
+}
+
+void StartLogWriter()
+{
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    assert(!logWriterThread);
+    fLogWriterStop = false;
+    logWriterThread = new boost::thread(&ThreadLogWriter);
+    fLogWriterActive = true;
+    fLogAsync = true;
+}
+
+void StopLogWriter()
+{
+    if (!logWriterThread) return;
+    fLogWriterStop = true;
+    condLogWriter->notify_one();
+    logWriterThread->join();
+    delete logWriterThread;
+    logWriterThread = nullptr;
+
+    // Switch back and drain in one step, so that messages written on the
+    // calling thread from now on come after everything that was queued
+    boost::mutex::scoped_lock scoped_lock(*mutexLogDrain);
+    fLogAsync = false;
+    DrainLogBuffer();
+    fLogWriterActive = false;
+}
+
 /** A map that contains all the currently held directory locks. After
  * successful locking, these will be held here until the global destructor
  * cleans them up and thus automatically unlocks them, or ReleaseDirectoryLocks
@@ -573,6 +686,8 @@ void PrintExceptionContinue(const std::exception* pex, const char* pszThread)
     std::string message = FormatException(pex, pszThread);
     LogPrintf("\n\n************************\n%s\n", message);
     fprintf(stderr, "\n\n************************\n%s\n", message.c_str());
+    // The process may be about to die; do not leave messages in the buffer
+    FlushLogWriter();
 }
 
 fs::path GetDefaultDataDir()
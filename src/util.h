@@ -35,6 +35,7 @@
 int64_t GetStartupTime();
 
 static const bool DEFAULT_LOGTIMEMICROS = false;
+static const bool DEFAULT_LOGASYNC = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
 extern const char * const DEFAULT_DEBUGLOGFILE;
@@ -196,6 +197,12 @@ fs::path GetSpecialFolderPath(int nFolder, bool fCreate = true);
 fs::path GetDebugLogPath();
 bool OpenDebugLog();
 void ShrinkDebugFile();
+/** Queue log messages for a background thread to write, instead of writing them on the logging thread */
+void StartLogWriter();
+/** Write out the queued log messages and go back to writing on the logging thread */
+void StopLogWriter();
+/** Write out the queued log messages on the calling thread, e.g. before the process dies */
+void FlushLogWriter();
 void runCommand(const std::string& strCommand);
 
 inline bool IsSwitchChar(char c)
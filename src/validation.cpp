@@ -10,6 +10,7 @@
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <checkqueue.h>
+#include <compressor.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
@@ -28,6 +29,7 @@
 #include <script/script.h>
 #include <script/sigcache.h>
 #include <script/standard.h>
+#include <threadpool.h>
 #include <timedata.h>
 #include <tinyformat.h>
 #include <txdb.h>
@@ -160,7 +162,7 @@ public:
 
     bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock);
 
-    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex);
+    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true);
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock);
 
     // Block (dis)connection on a given view:
@@ -195,7 +197,7 @@ private:
 
     void InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state);
     CBlockIndex* FindMostWorkChain();
-    bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
+    bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos, bool fStoredCompressed, const Consensus::Params& consensusParams);
 
 
     bool RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params);
@@ -215,6 +217,7 @@ int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fTxIndex = false;
+bool fCompressBlocks = DEFAULT_COMPRESS_BLOCKS;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -645,11 +648,20 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
         view.SetBackend(viewMemPool);
 
-        // do all inputs exist?
-        for (const CTxIn txin : tx.vin) {
+        // Look up all inputs in one batch; whatever this brings into
+        // pcoinsTip is uncached again if the transaction is not accepted.
+        std::vector<COutPoint> vPrevouts;
+        vPrevouts.reserve(tx.vin.size());
+        for (const CTxIn& txin : tx.vin) {
             if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
                 coins_to_uncache.push_back(txin.prevout);
             }
+            vPrevouts.push_back(txin.prevout);
+        }
+        view.FetchCoins(vPrevouts);
+
+        // do all inputs exist?
+        for (const CTxIn txin : tx.vin) {
             if (!view.HaveCoin(txin.prevout)) {
                 // Are inputs missing because we already have the tx?
                 for (size_t out = 0; out < tx.vout.size(); out++) {
@@ -1008,6 +1020,8 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, pfMissingInputs, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee);
 }
 
+static bool ReadTxFromDisk(CTransactionRef& txOut, uint256& hashBlock, const CDiskTxPos& postx);
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
@@ -1028,18 +1042,8 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
+                if (!ReadTxFromDisk(txOut, hashBlock, postx))
+                    return false;
                 if (txOut->GetHash() != hash)
                     return error("%s: txid mismatch", __func__);
                 return true;
@@ -1081,7 +1085,57 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
 // CBlock and CBlockIndex
 //
 
-static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+/**
+ * Blocks are stored in the block files as the message start, a 32-bit size
+ * field and the block itself. The top byte of the size field says how the
+ * block is encoded; network serialization is 0, so files written before
+ * compression existed read as before.
+ */
+enum BlockFileEncoding : unsigned int {
+    BLOCK_ENCODING_NETWORK = 0,
+    BLOCK_ENCODING_COMPRESSED = 1, //!< CBlockCompressor, with compressed amounts and output scripts
+};
+static const unsigned int BLOCK_ENCODING_SHIFT = 24;
+static const unsigned int BLOCK_SIZE_MASK = (1U << BLOCK_ENCODING_SHIFT) - 1;
+static_assert(MAX_BLOCK_SERIALIZED_SIZE <= BLOCK_SIZE_MASK, "block size must fit in the size field");
+
+static unsigned int GetBlockFileSize(const CBlock& block, unsigned int nEncoding)
+{
+    if (nEncoding == BLOCK_ENCODING_COMPRESSED)
+        return ::GetSerializeSize(CBlockCompressor(REF(block)), SER_DISK, CLIENT_VERSION);
+    return ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+}
+
+static unsigned int GetTxFileSize(const CTransactionRef& tx, unsigned int nEncoding)
+{
+    if (nEncoding == BLOCK_ENCODING_COMPRESSED)
+        return ::GetSerializeSize(CTxCompressor(REF(tx)), SER_DISK, CLIENT_VERSION);
+    return ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+}
+
+/** Read the encoding and the stored size of the block at pos from the size field ahead of it */
+static bool ReadBlockFileHeader(const CDiskBlockPos& pos, unsigned int& nEncoding, unsigned int& nFileSize)
+{
+    if (pos.nPos < sizeof(uint32_t))
+        return error("%s: Invalid position %s", __func__, pos.ToString());
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(uint32_t)), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    try {
+        unsigned int nSize = 0;
+        filein >> nSize;
+        nEncoding = nSize >> BLOCK_ENCODING_SHIFT;
+        nFileSize = nSize & BLOCK_SIZE_MASK;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    if (nEncoding != BLOCK_ENCODING_NETWORK && nEncoding != BLOCK_ENCODING_COMPRESSED)
+        return error("%s: Unknown block encoding %u at %s", __func__, nEncoding, pos.ToString());
+    return true;
+}
+
+static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, unsigned int nEncoding, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1089,15 +1143,19 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
+    unsigned int nSize = GetBlockFileSize(block, nEncoding);
+    fileout << FLATDATA(messageStart) << (nSize | (nEncoding << BLOCK_ENCODING_SHIFT));
 
     // Write block
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    if (nEncoding == BLOCK_ENCODING_COMPRESSED) {
+        fileout << CBlockCompressor(REF(block));
+    } else {
+        fileout << block;
+    }
 
     return true;
 }
@@ -1106,14 +1164,26 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read, at the size field ahead of the block which holds its encoding
+    if (pos.nPos < sizeof(uint32_t))
+        return error("ReadBlockFromDisk: Invalid position %s", pos.ToString());
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(uint32_t)), true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
     // Read block
     try {
-        filein >> block;
+        unsigned int nSize = 0;
+        filein >> nSize;
+        const unsigned int nEncoding = nSize >> BLOCK_ENCODING_SHIFT;
+        if (nEncoding == BLOCK_ENCODING_COMPRESSED) {
+            CBlockCompressor compressed(block);
+            filein >> compressed;
+        } else if (nEncoding == BLOCK_ENCODING_NETWORK) {
+            filein >> block;
+        } else {
+            return error("%s: Unknown block encoding %u at %s", __func__, nEncoding, pos.ToString());
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
@@ -1142,6 +1212,93 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+/**
+ * Read a transaction from its transaction index position, in the encoding
+ * of the block holding it, and return the hash of that block.
+ */
+static bool ReadTxFromDisk(CTransactionRef& txOut, uint256& hashBlock, const CDiskTxPos& postx)
+{
+    if (postx.nPos < sizeof(uint32_t))
+        return error("%s: Invalid position %s", __func__, postx.ToString());
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(postx.nFile, postx.nPos - sizeof(uint32_t)), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
+
+    CBlockHeader header;
+    try {
+        unsigned int nSize = 0;
+        filein >> nSize;
+        const unsigned int nEncoding = nSize >> BLOCK_ENCODING_SHIFT;
+        filein >> header;
+        fseek(filein.Get(), postx.nTxOffset, SEEK_CUR);
+        if (nEncoding == BLOCK_ENCODING_COMPRESSED) {
+            CTxCompressor compressed(txOut);
+            filein >> compressed;
+        } else if (nEncoding == BLOCK_ENCODING_NETWORK) {
+            filein >> txOut;
+        } else {
+            return error("%s: Unknown block encoding %u at %s", __func__, nEncoding, postx.ToString());
+        }
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    hashBlock = header.GetHash();
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    block.clear();
+
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetBlockPos();
+    }
+
+    if (pos.nPos < sizeof(uint32_t))
+        return error("ReadRawBlockFromDisk: Invalid position %s", pos.ToString());
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(uint32_t)), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadRawBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+    try {
+        unsigned int nSize = 0;
+        filein >> nSize;
+        const unsigned int nEncoding = nSize >> BLOCK_ENCODING_SHIFT;
+        if (nEncoding == BLOCK_ENCODING_COMPRESSED) {
+            // Compressed blocks have to be expanded to their serialization
+            CBlock expanded;
+            CBlockCompressor compressed(expanded);
+            filein >> compressed;
+            CVectorWriter(SER_DISK, CLIENT_VERSION, block, 0, expanded);
+        } else if (nEncoding == BLOCK_ENCODING_NETWORK) {
+            block.resize(nSize & BLOCK_SIZE_MASK);
+            filein.read((char*)block.data(), block.size());
+        } else {
+            return error("%s: Unknown block encoding %u at %s", __func__, nEncoding, pos.ToString());
+        }
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    // Check the header
+    CBlockHeader header;
+    try {
+        CByteReader(SER_DISK, CLIENT_VERSION, block.data(), block.data() + block.size()) >> header;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    if (!CheckProofOfWork(header.GetPoWHash(), header.nBits, consensusParams))
+        return error("ReadRawBlockFromDisk: Errors in block header at %s", pos.ToString());
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk: GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), pos.ToString());
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1338,7 +1495,7 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 }
 
 
-static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+static CShardedSignatureCache scriptExecutionCache;
 static uint256 scriptExecutionCacheNonce(GetRandHash());
 
 void InitScriptExecutionCache() {
@@ -1350,6 +1507,16 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+SignatureCacheStats GetScriptExecutionCacheStats()
+{
+    return scriptExecutionCache.GetStats();
+}
+
+void ResetScriptExecutionCacheStats()
+{
+    scriptExecutionCache.ResetStats();
+}
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set.
@@ -1391,7 +1558,6 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
             static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
             CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
-            AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
             if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
                 return true;
             }
@@ -1512,6 +1678,8 @@ bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
     SetMiscWarning(strMessage);
     LogPrintf("*** %s\n", strMessage);
+    // Shutdown may never complete; write out the message that explains it now
+    FlushLogWriter();
     uiInterface.ThreadSafeMessageBox(
         userMessage.empty() ? _("Error: A fatal internal error occurred, see debug.log for details") : userMessage,
         "", CClientUIInterface::MSG_ERROR);
@@ -1668,13 +1836,15 @@ static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& stat
 {
     if (!fTxIndex) return true;
 
+    // Offsets are into the block as stored, which depends on its encoding
+    const unsigned int nEncoding = (pindex->nStatus & BLOCK_STORED_COMPRESSED) ? BLOCK_ENCODING_COMPRESSED : BLOCK_ENCODING_NETWORK;
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     for (const CTransactionRef& tx : block.vtx)
     {
         vPos.push_back(std::make_pair(tx->GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+        pos.nTxOffset += GetTxFileSize(tx, nEncoding);
     }
 
     if (!pblocktree->WriteTxIndex(vPos)) {
@@ -1915,6 +2085,23 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+
+    // Load the coins spent by the block in one batch, instead of one
+    // database lookup at a time as each input is checked. Outputs created
+    // earlier in the block are not in the database yet, so skip them.
+    std::vector<COutPoint> vSpent;
+    std::set<uint256> setBlockTxids;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn& txin : tx->vin) {
+                if (!setBlockTxids.count(txin.prevout.hash))
+                    vSpent.push_back(txin.prevout);
+            }
+        }
+        setBlockTxids.insert(tx->GetHash());
+    }
+    view.FetchCoins(vSpent);
+
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
@@ -2851,7 +3038,7 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
 }
 
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
-bool CChainState::ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+bool CChainState::ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos, bool fStoredCompressed, const Consensus::Params& consensusParams)
 {
     pindexNew->nTx = block.vtx.size();
     pindexNew->nChainTx = 0;
@@ -2859,6 +3046,11 @@ bool CChainState::ReceivedBlockTransactions(const CBlock &block, CValidationStat
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
     pindexNew->nStatus |= BLOCK_HAVE_DATA;
+    if (fStoredCompressed) {
+        pindexNew->nStatus |= BLOCK_STORED_COMPRESSED;
+    } else {
+        pindexNew->nStatus &= ~BLOCK_STORED_COMPRESSED;
+    }
     if (IsWitnessEnabled(pindexNew->pprev, consensusParams)) {
         pindexNew->nStatus |= BLOCK_OPT_WITNESS;
     }
@@ -3260,7 +3452,7 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3279,7 +3471,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3340,9 +3532,16 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
     return true;
 }
 
-/** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
-static CDiskBlockPos SaveBlockToDisk(const CBlock& block, int nHeight, const CChainParams& chainparams, const CDiskBlockPos* dbp) {
-    unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+/**
+ * Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk.
+ * nEncoding is set to the encoding of the stored block.
+ */
+static CDiskBlockPos SaveBlockToDisk(const CBlock& block, int nHeight, const CChainParams& chainparams, const CDiskBlockPos* dbp, unsigned int& nEncoding) {
+    // A block that is already on disk (reindex) may be in either encoding;
+    // accounting for the larger of the two never lets a later write overlap it.
+    unsigned int nBlockSize = GetBlockFileSize(block, fCompressBlocks ? BLOCK_ENCODING_COMPRESSED : BLOCK_ENCODING_NETWORK);
+    if (dbp != nullptr)
+        nBlockSize = std::max(GetBlockFileSize(block, BLOCK_ENCODING_NETWORK), GetBlockFileSize(block, BLOCK_ENCODING_COMPRESSED));
     CDiskBlockPos blockPos;
     if (dbp != nullptr)
         blockPos = *dbp;
@@ -3351,10 +3550,17 @@ static CDiskBlockPos SaveBlockToDisk(const CBlock& block, int nHeight, const CCh
         return CDiskBlockPos();
     }
     if (dbp == nullptr) {
-        if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart())) {
+        nEncoding = fCompressBlocks ? BLOCK_ENCODING_COMPRESSED : BLOCK_ENCODING_NETWORK;
+        if (!WriteBlockToDisk(block, blockPos, nEncoding, chainparams.MessageStart())) {
             AbortNode("Failed to write block");
             return CDiskBlockPos();
         }
+    } else {
+        unsigned int nFileSize = 0;
+        if (!ReadBlockFileHeader(blockPos, nEncoding, nFileSize)) {
+            error("%s: ReadBlockFileHeader failed", __func__);
+            return CDiskBlockPos();
+        }
     }
     return blockPos;
 }
@@ -3370,7 +3576,9 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
     CBlockIndex *pindexDummy = nullptr;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    // A block that already passed CheckBlock had its proof of work checked
+    // there; don't compute the (scrypt) proof of work hash a second time.
+    if (!AcceptBlockHeader(block, state, chainparams, &pindex, !block.fChecked))
         return false;
 
     // Try to process all requested blocks that we don't have, but only
@@ -3422,12 +3630,13 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
 
     // Write block to history file
     try {
-        CDiskBlockPos blockPos = SaveBlockToDisk(block, pindex->nHeight, chainparams, dbp);
+        unsigned int nEncoding = BLOCK_ENCODING_NETWORK;
+        CDiskBlockPos blockPos = SaveBlockToDisk(block, pindex->nHeight, chainparams, dbp, nEncoding);
         if (blockPos.IsNull()) {
             state.Error(strprintf("%s: Failed to find position to write new block to disk", __func__));
             return false;
         }
-        if (!ReceivedBlockTransactions(block, state, pindex, blockPos, chainparams.GetConsensus()))
+        if (!ReceivedBlockTransactions(block, state, pindex, blockPos, nEncoding == BLOCK_ENCODING_COMPRESSED, chainparams.GetConsensus()))
             return error("AcceptBlock(): ReceivedBlockTransactions failed");
     } catch (const std::runtime_error& e) {
         return AbortNode(state, std::string("System error: ") + e.what());
@@ -3523,6 +3732,7 @@ void PruneOneBlockFile(const int fileNumber)
         if (pindex->nFile == fileNumber) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
             pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nStatus &= ~BLOCK_STORED_COMPRESSED;
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
@@ -3864,6 +4074,59 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100, false);
 }
 
+/** Bytes of stored block data VerifyDB reads and checks in parallel before disconnecting them in order */
+static const unsigned int VERIFYDB_BATCH_SIZE = 16 * 1024 * 1024;
+/** Maximum number of threads reading and checking blocks in VerifyDB */
+static const int MAX_VERIFYDB_THREADS = 16;
+
+namespace {
+
+/** A block being verified by VerifyDB; strError is set if levels 0-2 failed for it */
+struct CVerifiedBlock
+{
+    CBlockIndex* pindex;
+    CDiskBlockPos pos;
+    CBlock block;
+    std::string strError;
+};
+
+} // namespace
+
+/**
+ * Run check levels 0 to 2 (read the block, CheckBlock, read the undo data)
+ * for a batch of blocks in parallel. The block positions are looked up by
+ * the caller, which holds cs_main for the duration.
+ */
+static void VerifyBlocks(std::vector<CVerifiedBlock>& batch, const Consensus::Params& consensusParams, int nCheckLevel)
+{
+    const int nThreads = std::min(GetNumCores(), MAX_VERIFYDB_THREADS);
+    ParallelFor(batch.size(), nThreads, [&](size_t i) {
+        CVerifiedBlock& entry = batch[i];
+        const CBlockIndex* pindex = entry.pindex;
+        // check level 0: read from disk
+        if (!ReadBlockFromDisk(entry.block, entry.pos, consensusParams) || entry.block.GetHash() != pindex->GetBlockHash()) {
+            entry.strError = strprintf("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return;
+        }
+        // check level 1: verify block validity
+        CValidationState state;
+        if (nCheckLevel >= 1 && !CheckBlock(entry.block, state, consensusParams)) {
+            entry.strError = strprintf("%s: *** found bad block at %d, hash=%s (%s)", "VerifyDB",
+                                       pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
+            return;
+        }
+        // check level 2: verify undo validity
+        if (nCheckLevel >= 2) {
+            CBlockUndo undo;
+            if (!pindex->GetUndoPos().IsNull()) {
+                if (!UndoReadFromDisk(undo, pindex)) {
+                    entry.strError = strprintf("VerifyDB(): *** found bad undo data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+                }
+            }
+        }
+    });
+}
+
 bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
 {
     LOCK(cs_main);
@@ -3882,57 +4145,72 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     CValidationState state;
     int reportDone = 0;
     LogPrintf("[0%%]...");
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
-    {
-        boost::this_thread::interruption_point();
-        int percentageDone = std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
-        if (reportDone < percentageDone/10) {
-            // report every 10% step
-            LogPrintf("[%d%%]...", percentageDone);
-            reportDone = percentageDone/10;
-        }
-        uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone, false);
-        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
-            break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
-            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
-            break;
-        }
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
-            return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
-                         pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            if (!pindex->GetUndoPos().IsNull()) {
-                if (!UndoReadFromDisk(undo, pindex)) {
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-                }
+    CBlockIndex* pindexNext = chainActive.Tip();
+    bool fDone = false;
+    while (!fDone) {
+        // Collect the next batch of blocks, walking back from the tip
+        std::vector<CVerifiedBlock> batch;
+        uint64_t nBatchSize = 0;
+        for (; pindexNext && pindexNext->pprev; pindexNext = pindexNext->pprev) {
+            if (pindexNext->nHeight < chainActive.Height()-nCheckDepth) {
+                fDone = true;
+                break;
+            }
+            if (fPruneMode && !(pindexNext->nStatus & BLOCK_HAVE_DATA)) {
+                // If pruning, only go back as far as we have data.
+                LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindexNext->nHeight);
+                fDone = true;
+                break;
             }
+            // A block whose size cannot be read counts as a full one; reading it
+            // fails at check level 0 below
+            const CDiskBlockPos pos = pindexNext->GetBlockPos();
+            unsigned int nEncoding = BLOCK_ENCODING_NETWORK;
+            unsigned int nFileSize = MAX_BLOCK_SERIALIZED_SIZE;
+            if (!ReadBlockFileHeader(pos, nEncoding, nFileSize)) {
+                nFileSize = MAX_BLOCK_SERIALIZED_SIZE;
+            }
+            if (!batch.empty() && nBatchSize + nFileSize > VERIFYDB_BATCH_SIZE)
+                break;
+            nBatchSize += nFileSize;
+            batch.push_back(CVerifiedBlock{pindexNext, pos, CBlock(), std::string()});
         }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
-            assert(coins.GetBestBlock() == pindex->GetBlockHash());
-            DisconnectResult res = g_chainstate.DisconnectBlock(block, pindex, coins);
-            if (res == DISCONNECT_FAILED) {
-                return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        if (batch.empty())
+            break;
+
+        // check levels 0-2 do not depend on each other; run them in parallel
+        VerifyBlocks(batch, chainparams.GetConsensus(), nCheckLevel);
+
+        for (CVerifiedBlock& entry : batch) {
+            CBlockIndex* pindex = entry.pindex;
+            boost::this_thread::interruption_point();
+            int percentageDone = std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
+            if (reportDone < percentageDone/10) {
+                // report every 10% step
+                LogPrintf("[%d%%]...", percentageDone);
+                reportDone = percentageDone/10;
             }
-            pindexState = pindex->pprev;
-            if (res == DISCONNECT_UNCLEAN) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else {
-                nGoodTransactions += block.vtx.size();
+            uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone, false);
+            if (!entry.strError.empty())
+                return error("%s", entry.strError);
+            // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+            if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
+                assert(coins.GetBestBlock() == pindex->GetBlockHash());
+                DisconnectResult res = g_chainstate.DisconnectBlock(entry.block, pindex, coins);
+                if (res == DISCONNECT_FAILED) {
+                    return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+                }
+                pindexState = pindex->pprev;
+                if (res == DISCONNECT_UNCLEAN) {
+                    nGoodTransactions = 0;
+                    pindexFailure = pindex;
+                } else {
+                    nGoodTransactions += entry.block.vtx.size();
+                }
             }
+            if (ShutdownRequested())
+                return true;
         }
-        if (ShutdownRequested())
-            return true;
     }
     if (pindexFailure)
         return error("VerifyDB(): *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions);
@@ -4225,12 +4503,13 @@ bool CChainState::LoadGenesisBlock(const CChainParams& chainparams)
 
     try {
         CBlock &block = const_cast<CBlock&>(chainparams.GenesisBlock());
-        CDiskBlockPos blockPos = SaveBlockToDisk(block, 0, chainparams, nullptr);
+        unsigned int nEncoding = BLOCK_ENCODING_NETWORK;
+        CDiskBlockPos blockPos = SaveBlockToDisk(block, 0, chainparams, nullptr, nEncoding);
         if (blockPos.IsNull())
             return error("%s: writing genesis block to disk failed", __func__);
         CBlockIndex *pindex = AddToBlockIndex(block);
         CValidationState state;
-        if (!ReceivedBlockTransactions(block, state, pindex, blockPos, chainparams.GetConsensus()))
+        if (!ReceivedBlockTransactions(block, state, pindex, blockPos, nEncoding == BLOCK_ENCODING_COMPRESSED, chainparams.GetConsensus()))
             return error("%s: genesis block not accepted", __func__);
     } catch (const std::runtime_error& e) {
         return error("%s: failed to write genesis block: %s", __func__, e.what());
@@ -4244,114 +4523,233 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+/** Bytes of block data LoadExternalBlockFile reads before decoding and checking them as one batch */
+static const unsigned int IMPORT_BATCH_SIZE = 16 * 1024 * 1024;
+/** Maximum number of threads decoding and checking a batch of imported blocks */
+static const int MAX_IMPORT_THREADS = 16;
+
+namespace {
+
+/** A block read from an external file, decoded and checked in parallel with the rest of its batch */
+struct CImportedBlock
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+    uint64_t nHeaderPos;
+    uint64_t nBlockPos;
+    CDataStream raw;
+    unsigned int nSize;
+    unsigned int nEncoding;
+    std::shared_ptr<CBlock> pblock;
+    std::string strError;
+
+    CImportedBlock(uint64_t nHeaderPosIn, uint64_t nBlockPosIn, unsigned int nSizeIn, unsigned int nEncodingIn)
+        : nHeaderPos(nHeaderPosIn), nBlockPos(nBlockPosIn), raw(SER_DISK, CLIENT_VERSION), nSize(nSizeIn), nEncoding(nEncodingIn) {}
+};
+
+} // namespace
+
+/**
+ * Deserialize a batch of blocks and run the context-free CheckBlock on them,
+ * which includes the proof of work and the merkle root. The result is cached
+ * in CBlock::fChecked, so AcceptBlock does not repeat that work under
+ * cs_main. Blocks that fail are left for AcceptBlock to reject and report.
+ */
+static void DecodeImportedBlocks(std::vector<CImportedBlock>& batch, const Consensus::Params& consensusParams)
+{
+    const int nThreads = std::min(GetNumCores(), MAX_IMPORT_THREADS);
+    ParallelFor(batch.size(), nThreads, [&](size_t i) {
+        CImportedBlock& entry = batch[i];
+        try {
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            if (entry.nEncoding == BLOCK_ENCODING_COMPRESSED) {
+                CBlockCompressor compressed(*pblock);
+                entry.raw >> compressed;
+            } else {
+                entry.raw >> *pblock;
+            }
+            CValidationState state;
+            CheckBlock(*pblock, state, consensusParams);
+            entry.pblock = pblock;
+        } catch (const std::exception& e) {
+            entry.strError = e.what();
+        }
+    });
+}
+
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp, CUnknownParentBlocks *unknownParents)
+{
+    // Blocks with unknown parent found in this file only, when the caller does not track them across files
+    CUnknownParentBlocks localUnknownParents;
+    CUnknownParentBlocks& pending = unknownParents ? *unknownParents : localUnknownParents;
+    std::multimap<uint256, CUnknownParentBlock>& mapBlocksUnknownParent = pending.mapBlocks;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor.
+        // The rewind window covers a whole batch, so scanning can resume
+        // right after the header of any block in it that fails to decode.
+        const uint64_t nRewindSize = IMPORT_BATCH_SIZE + 2*MAX_BLOCK_SERIALIZED_SIZE + 8;
+        CBufferedFile blkdat(fileIn, nRewindSize + MAX_BLOCK_SERIALIZED_SIZE, nRewindSize, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
-
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+        bool fAbort = false;
+        while (!fAbort) {
+            // Stage 1: locate the blocks of the next batch and read them without decoding
+            std::vector<CImportedBlock> batch;
+            const uint64_t nBatchStart = nRewind;
+            bool fEnd = false;
+            while (nRewind - nBatchStart < IMPORT_BATCH_SIZE) {
+                boost::this_thread::interruption_point();
+                blkdat.SetPos(nRewind);
+                if (blkdat.eof()) {
+                    fEnd = true;
+                    break;
+                }
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                unsigned int nEncoding = 0;
+                uint64_t nHeaderPos = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(chainparams.MessageStart()[0]);
+                    nHeaderPos = blkdat.GetPos();
+                    nRewind = nHeaderPos+1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size and encoding
+                    blkdat >> nSize;
+                    nEncoding = nSize >> BLOCK_ENCODING_SHIFT;
+                    nSize &= BLOCK_SIZE_MASK;
+                    if (nEncoding > BLOCK_ENCODING_COMPRESSED)
+                        continue;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    fEnd = true;
+                    break;
+                }
+                try {
+                    // read block
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    batch.emplace_back(nHeaderPos, nBlockPos, nSize, nEncoding);
+                    CImportedBlock& entry = batch.back();
+                    entry.raw.resize(nSize);
+                    blkdat.read(&entry.raw[0], nSize);
+                    nRewind = blkdat.GetPos();
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                    batch.pop_back();
+                }
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            if (batch.empty()) {
+                if (fEnd) break;
+                continue;
+            }
+
+            // Stage 2: decode and check the batch in parallel
+            DecodeImportedBlocks(batch, chainparams.GetConsensus());
+
+            // Stage 3: feed the blocks into the block index in file order
+            for (CImportedBlock& entry : batch) {
+                if (!entry.pblock) {
+                    // Rescan from right after this block's header, as the remaining data may hold other blocks
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, entry.strError);
+                    nRewind = entry.nHeaderPos + 1;
+                    fEnd = false;
+                    break;
+                }
+                std::shared_ptr<CBlock> pblock = std::move(entry.pblock);
                 CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
+                if (dbp)
+                    dbp->nPos = entry.nBlockPos;
 
                 // detect out of order blocks, and store them for later
                 uint256 hash = block.GetHash();
                 if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
                     LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
                             block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+                    if (dbp) {
+                        CUnknownParentBlock waiting{*dbp, nullptr, entry.nSize};
+                        if (pending.nCacheUsage + entry.nSize <= pending.nMaxCacheUsage) {
+                            waiting.pblock = pblock;
+                            pending.nCacheUsage += entry.nSize;
+                        }
+                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, waiting));
+                    }
+                } else {
+                    // process in case the block isn't known yet
+                    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                        LOCK(cs_main);
+                        CValidationState state;
+                        if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr))
+                            nLoaded++;
+                        if (state.IsError()) {
+                            fAbort = true;
+                            break;
+                        }
+                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                        LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+                    }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
+                    // Activate the genesis block so normal node progress can continue
+                    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                        CValidationState state;
+                        if (!ActivateBestChain(state, chainparams)) {
+                            fAbort = true;
+                            break;
+                        }
                     }
-                }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                    NotifyHeaderTip();
+
+                    // Recursively process earlier encountered successors of this block
+                    std::deque<uint256> queue;
+                    queue.push_back(hash);
+                    while (!queue.empty()) {
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        std::pair<std::multimap<uint256, CUnknownParentBlock>::iterator, std::multimap<uint256, CUnknownParentBlock>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                        while (range.first != range.second) {
+                            std::multimap<uint256, CUnknownParentBlock>::iterator it = range.first;
+                            std::shared_ptr<const CBlock> pblockrecursive = it->second.pblock;
+                            if (pblockrecursive) {
+                                pending.nCacheUsage -= it->second.nSize;
+                            } else {
+                                std::shared_ptr<CBlock> pblockread = std::make_shared<CBlock>();
+                                if (ReadBlockFromDisk(*pblockread, it->second.pos, chainparams.GetConsensus()))
+                                    pblockrecursive = pblockread;
+                            }
+                            if (pblockrecursive)
                             {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
+                                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                                        head.ToString());
+                                LOCK(cs_main);
+                                CValidationState dummy;
+                                if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second.pos, nullptr))
+                                {
+                                    nLoaded++;
+                                    queue.push_back(pblockrecursive->GetHash());
+                                }
                             }
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
+                            NotifyHeaderTip();
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
                     }
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+
+                if (entry.raw.size() != 0) {
+                    // The block was shorter than its recorded size; rescan from where it ended
+                    nRewind = entry.nBlockPos + entry.nSize - entry.raw.size();
+                    fEnd = false;
+                    break;
+                }
             }
+            if (fEnd) break;
         }
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
@@ -16,6 +16,7 @@
 #include <protocol.h> // For CMessageHeader::MessageStartChars
 #include <policy/feerate.h>
 #include <script/script_error.h>
+#include <script/sigcache.h>
 #include <sync.h>
 #include <versionbits.h>
 
@@ -131,6 +132,8 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+/** Default for -compressblocks */
+static const bool DEFAULT_COMPRESS_BLOCKS = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
@@ -171,6 +174,8 @@ extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+/** Whether new blocks are written to the block files in compressed form */
+extern bool fCompressBlocks;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -261,8 +266,24 @@ bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
-/** Import blocks from an external file */
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = nullptr);
+/** Memory for keeping out of order blocks found during reindex, instead of reading them from disk again once their parent is known */
+static const size_t MAX_UNKNOWN_PARENT_CACHE = 64 * 1024 * 1024;
+/** An out of order block waiting for its parent; pblock is null when it did not fit in the cache */
+struct CUnknownParentBlock
+{
+    CDiskBlockPos pos;
+    std::shared_ptr<const CBlock> pblock;
+    unsigned int nSize;
+};
+/** Out of order blocks found while reindexing, keyed by the parent they wait for. Owned by the reindex, so the cache is released when it ends. */
+struct CUnknownParentBlocks
+{
+    std::multimap<uint256, CUnknownParentBlock> mapBlocks;
+    size_t nCacheUsage = 0;
+    size_t nMaxCacheUsage = MAX_UNKNOWN_PARENT_CACHE;
+};
+/** Import blocks from an external file. Out of order blocks in block files (dbp set) are kept in unknownParents until their parent is loaded, which may be from a later file. */
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = nullptr, CUnknownParentBlocks *unknownParents = nullptr);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk,
@@ -393,11 +414,15 @@ public:
 
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
+SignatureCacheStats GetScriptExecutionCacheStats();
+void ResetScriptExecutionCacheStats();
 
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read a block's serialization (with witness) without deserializing it, e.g. for a CBlockView */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -13,29 +13,119 @@
 #include <util.h>
 #include <validation.h>
 
-#include <list>
 #include <atomic>
 #include <future>
+#include <list>
+#include <vector>
 
 #include <boost/signals2/signal.hpp>
 
+/**
+ * The background callback queue of one registered CValidationInterface.
+ * Each subscriber's callbacks run in order, but independently of the other
+ * subscribers', so a slow subscriber only delays itself.
+ *
+ * Queues are never destroyed while the scheduler may still run them; the
+ * queue of an unregistered subscriber is kept for the next registration,
+ * and callbacks still queued for the old one are dropped. A callback runs
+ * under m_cs_running, which unregistration takes after bumping the
+ * generation, so the subscriber is not used once that returns.
+ */
+struct ValidationQueue {
+    SingleThreadedSchedulerClient m_schedulerClient;
+
+    //! Subscriber the queue currently belongs to, or nullptr when unused. Guarded by MainSignalsInstance::m_cs_queues.
+    CValidationInterface* m_callbacks = nullptr;
+    std::string m_name;
+    //! Bumped on every (un)registration, so callbacks queued for an earlier subscriber can tell
+    std::atomic<uint64_t> m_generation{0};
+    //! Held while a callback runs
+    CCriticalSection m_cs_running;
+
+    std::atomic<size_t> m_max_pending{0};
+    std::atomic<uint64_t> m_callbacks_run{0};
+    std::atomic<int64_t> m_total_micros{0};
+    std::atomic<int64_t> m_max_micros{0};
+    std::atomic<int64_t> m_max_wait_micros{0};
+
+    explicit ValidationQueue(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+
+    void Reset(CValidationInterface* callbacks, const std::string& name) {
+        m_callbacks = callbacks;
+        m_name = name;
+        m_generation++;
+        m_max_pending = 0;
+        m_callbacks_run = 0;
+        m_total_micros = 0;
+        m_max_micros = 0;
+        m_max_wait_micros = 0;
+    }
+
+    //! Queue func to be called with the current subscriber, unless it unregisters first
+    void Add(std::function<void (CValidationInterface&)> func) {
+        CValidationInterface* callbacks = m_callbacks;
+        uint64_t generation = m_generation;
+        int64_t nQueued = GetTimeMicros();
+        m_schedulerClient.AddToProcessQueue([this, func, callbacks, generation, nQueued] {
+            LOCK(m_cs_running);
+            if (m_generation != generation) return;
+            int64_t nStart = GetTimeMicros();
+            func(*callbacks);
+            int64_t nTime = GetTimeMicros() - nStart;
+            m_callbacks_run++;
+            m_total_micros += nTime;
+            UpdateMax(m_max_micros, nTime);
+            UpdateMax(m_max_wait_micros, nStart - nQueued);
+        });
+        UpdateMax(m_max_pending, m_schedulerClient.CallbacksPending());
+    }
+
+    //! Wait for a callback running on another thread to return
+    void WaitForRunning() {
+        LOCK(m_cs_running);
+    }
+
+    template <typename T>
+    static void UpdateMax(std::atomic<T>& max, T value) {
+        T prev = max;
+        while (value > prev && !max.compare_exchange_weak(prev, value)) {}
+    }
+};
+
 struct MainSignalsInstance {
-    boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionAddedToMempool;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef>&)> BlockConnected;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &)> BlockDisconnected;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionRemovedFromMempool;
-    boost::signals2::signal<void (const CBlockLocator &)> SetBestChain;
+    // These are called synchronously, from the thread that generates them
     boost::signals2::signal<void (int64_t nBestBlockTime, CConnman* connman)> Broadcast;
     boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
     boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
 
-    // We are not allowed to assume the scheduler only runs in one thread,
-    // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
+    CScheduler *m_pscheduler;
+
+    // Holds functions queued with CallFunctionInValidationInterfaceQueue
+    // while no subscriber is registered; they must not run on the caller's
+    // thread either.
     SingleThreadedSchedulerClient m_schedulerClient;
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    CCriticalSection m_cs_queues;
+    std::vector<std::unique_ptr<ValidationQueue>> m_queues;
+
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_pscheduler(pscheduler), m_schedulerClient(pscheduler) {}
+
+    //! Queue func for every registered subscriber
+    void Enqueue(std::function<void (CValidationInterface&)> func) {
+        LOCK(m_cs_queues);
+        for (const auto& queue : m_queues) {
+            if (queue->m_callbacks) queue->Add(func);
+        }
+    }
+
+    //! The queue of callbacks, or nullptr if it is not registered
+    ValidationQueue* GetQueue(const CValidationInterface* callbacks) {
+        AssertLockHeld(m_cs_queues);
+        for (const auto& queue : m_queues) {
+            if (queue->m_callbacks == callbacks) return queue.get();
+        }
+        return nullptr;
+    }
 };
 
 static CMainSignals g_signals;
@@ -49,15 +139,64 @@ void CMainSignals::UnregisterBackgroundSignalScheduler() {
     m_internals.reset(nullptr);
 }
 
+const CScheduler* CMainSignals::GetBackgroundSignalScheduler() const {
+    return m_internals ? m_internals->m_pscheduler : nullptr;
+}
+
 void CMainSignals::FlushBackgroundCallbacks() {
     if (m_internals) {
-        m_internals->m_schedulerClient.EmptyQueue();
+        // Callbacks may queue more callbacks, for themselves or for other
+        // subscribers. Queues are never destroyed, so they can be emptied
+        // without holding m_cs_queues while the callbacks run.
+        do {
+            std::vector<SingleThreadedSchedulerClient*> clients{&m_internals->m_schedulerClient};
+            {
+                LOCK(m_internals->m_cs_queues);
+                for (const auto& queue : m_internals->m_queues) {
+                    clients.push_back(&queue->m_schedulerClient);
+                }
+            }
+            for (SingleThreadedSchedulerClient* client : clients) {
+                client->EmptyQueue();
+            }
+        } while (CallbacksPending() > 0);
     }
 }
 
 size_t CMainSignals::CallbacksPending() {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    LOCK(m_internals->m_cs_queues);
+    size_t pending = m_internals->m_schedulerClient.CallbacksPending();
+    for (const auto& queue : m_internals->m_queues) {
+        pending = std::max(pending, queue->m_schedulerClient.CallbacksPending());
+    }
+    return pending;
+}
+
+size_t CMainSignals::CallbacksPending(const CValidationInterface* callbacks) {
+    if (!m_internals) return 0;
+    LOCK(m_internals->m_cs_queues);
+    ValidationQueue* queue = m_internals->GetQueue(callbacks);
+    return queue ? queue->m_schedulerClient.CallbacksPending() : 0;
+}
+
+std::vector<ValidationQueueInfo> CMainSignals::GetQueueInfo() {
+    std::vector<ValidationQueueInfo> ret;
+    if (!m_internals) return ret;
+    LOCK(m_internals->m_cs_queues);
+    for (const auto& queue : m_internals->m_queues) {
+        if (!queue->m_callbacks) continue;
+        ValidationQueueInfo info;
+        info.name = queue->m_name;
+        info.pending = queue->m_schedulerClient.CallbacksPending();
+        info.max_pending = queue->m_max_pending;
+        info.callbacks = queue->m_callbacks_run;
+        info.total_micros = queue->m_total_micros;
+        info.max_micros = queue->m_max_micros;
+        info.max_wait_micros = queue->m_max_wait_micros;
+        ret.push_back(info);
+    }
+    return ret;
 }
 
 void CMainSignals::RegisterWithMempoolSignals(CTxMemPool& pool) {
@@ -73,28 +212,40 @@ CMainSignals& GetMainSignals()
     return g_signals;
 }
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.m_internals->UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->TransactionAddedToMempool.connect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->BlockDisconnected.connect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.m_internals->TransactionRemovedFromMempool.connect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& name) {
     g_signals.m_internals->Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
     g_signals.m_internals->BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.m_internals->NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+
+    LOCK(g_signals.m_internals->m_cs_queues);
+    ValidationQueue* queue = nullptr;
+    for (const auto& unused : g_signals.m_internals->m_queues) {
+        if (!unused->m_callbacks) {
+            queue = unused.get();
+            break;
+        }
+    }
+    if (!queue) {
+        g_signals.m_internals->m_queues.emplace_back(new ValidationQueue(g_signals.m_internals->m_pscheduler));
+        queue = g_signals.m_internals->m_queues.back().get();
+    }
+    queue->Reset(pwalletIn, name);
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.m_internals->BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.m_internals->Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.m_internals->SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.m_internals->TransactionAddedToMempool.disconnect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.m_internals->NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+
+    ValidationQueue* queue;
+    {
+        LOCK(g_signals.m_internals->m_cs_queues);
+        queue = g_signals.m_internals->GetQueue(pwalletIn);
+        if (!queue) return;
+        queue->Reset(nullptr, "");
+    }
+    // Not under m_cs_queues, which the running callback may need to queue more
+    queue->WaitForRunning();
 }
 
 void UnregisterAllValidationInterfaces() {
@@ -103,17 +254,47 @@ void UnregisterAllValidationInterfaces() {
     }
     g_signals.m_internals->BlockChecked.disconnect_all_slots();
     g_signals.m_internals->Broadcast.disconnect_all_slots();
-    g_signals.m_internals->SetBestChain.disconnect_all_slots();
-    g_signals.m_internals->TransactionAddedToMempool.disconnect_all_slots();
-    g_signals.m_internals->BlockConnected.disconnect_all_slots();
-    g_signals.m_internals->BlockDisconnected.disconnect_all_slots();
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect_all_slots();
-    g_signals.m_internals->UpdatedBlockTip.disconnect_all_slots();
     g_signals.m_internals->NewPoWValidBlock.disconnect_all_slots();
+
+    std::vector<ValidationQueue*> queues;
+    {
+        LOCK(g_signals.m_internals->m_cs_queues);
+        for (const auto& queue : g_signals.m_internals->m_queues) {
+            if (queue->m_callbacks) {
+                queue->Reset(nullptr, "");
+                queues.push_back(queue.get());
+            }
+        }
+    }
+    for (ValidationQueue* queue : queues) {
+        queue->WaitForRunning();
+    }
 }
 
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func) {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    // Queue a marker behind the pending callbacks of every subscriber; the
+    // last marker to run calls func.
+    LOCK(g_signals.m_internals->m_cs_queues);
+    std::vector<SingleThreadedSchedulerClient*> clients{&g_signals.m_internals->m_schedulerClient};
+    for (const auto& queue : g_signals.m_internals->m_queues) {
+        if (queue->m_callbacks) clients.push_back(&queue->m_schedulerClient);
+    }
+    auto remaining = std::make_shared<std::atomic<size_t>>(clients.size());
+    for (SingleThreadedSchedulerClient* client : clients) {
+        client->AddToProcessQueue([remaining, func] {
+            if (--*remaining == 0) func();
+        });
+    }
+}
+
+void CallFunctionInValidationInterfaceQueue(const CValidationInterface* callbacks, std::function<void ()> func) {
+    LOCK(g_signals.m_internals->m_cs_queues);
+    ValidationQueue* queue = g_signals.m_internals->GetQueue(callbacks);
+    if (queue) {
+        queue->m_schedulerClient.AddToProcessQueue(std::move(func));
+    } else {
+        g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    }
 }
 
 void SyncWithValidationInterfaceQueue() {
@@ -128,8 +309,8 @@ void SyncWithValidationInterfaceQueue() {
 
 void CMainSignals::MempoolEntryRemoved(CTransactionRef ptx, MemPoolRemovalReason reason) {
     if (reason != MemPoolRemovalReason::BLOCK && reason != MemPoolRemovalReason::CONFLICT) {
-        m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-            m_internals->TransactionRemovedFromMempool(ptx);
+        m_internals->Enqueue([ptx](CValidationInterface& callbacks) {
+            callbacks.TransactionRemovedFromMempool(ptx);
         });
     }
 }
@@ -139,32 +320,32 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
     // the chain actually updates. One way to ensure this is for the caller to invoke this signal
     // in the same critical section where the chain is updated
 
-    m_internals->m_schedulerClient.AddToProcessQueue([pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
+    m_internals->Enqueue([pindexNew, pindexFork, fInitialDownload](CValidationInterface& callbacks) {
+        callbacks.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     });
 }
 
 void CMainSignals::TransactionAddedToMempool(const CTransactionRef &ptx) {
-    m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-        m_internals->TransactionAddedToMempool(ptx);
+    m_internals->Enqueue([ptx](CValidationInterface& callbacks) {
+        callbacks.TransactionAddedToMempool(ptx);
     });
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>>& pvtxConflicted) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, pindex, pvtxConflicted, this] {
-        m_internals->BlockConnected(pblock, pindex, *pvtxConflicted);
+    m_internals->Enqueue([pblock, pindex, pvtxConflicted](CValidationInterface& callbacks) {
+        callbacks.BlockConnected(pblock, pindex, *pvtxConflicted);
     });
 }
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock> &pblock) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, this] {
-        m_internals->BlockDisconnected(pblock);
+    m_internals->Enqueue([pblock](CValidationInterface& callbacks) {
+        callbacks.BlockDisconnected(pblock);
     });
 }
 
 void CMainSignals::SetBestChain(const CBlockLocator &locator) {
-    m_internals->m_schedulerClient.AddToProcessQueue([locator, this] {
-        m_internals->SetBestChain(locator);
+    m_internals->Enqueue([locator](CValidationInterface& callbacks) {
+        callbacks.SetBestChain(locator);
     });
 }
 
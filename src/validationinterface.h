@@ -10,6 +10,8 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 class CBlock;
 class CBlockIndex;
@@ -26,11 +28,18 @@ enum class MemPoolRemovalReason;
 
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister a wallet from core */
+/**
+ * Register a wallet to receive updates from core. Its background callbacks
+ * get their own queue; name identifies the queue in getvalidationqueueinfo.
+ */
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& name = "");
+/**
+ * Unregister a wallet from core. Callbacks still queued for it are dropped,
+ * and one running on another thread is waited for, so it must not be
+ * called with locks held that its callbacks take.
+ */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister all wallets from core */
+/** Unregister all wallets from core, like UnregisterValidationInterface */
 void UnregisterAllValidationInterfaces();
 /**
  * Pushes a function to callback onto the notification queue, guaranteeing any
@@ -42,6 +51,12 @@ void UnregisterAllValidationInterfaces();
  * will result in a deadlock (that DEBUG_LOCKORDER will miss).
  */
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+/**
+ * Like CallFunctionInValidationInterfaceQueue, but only waits for the
+ * callbacks queued for one subscriber, so a subscriber can queue work behind
+ * its own callbacks without waiting for slower subscribers.
+ */
+void CallFunctionInValidationInterfaceQueue(const CValidationInterface* callbacks, std::function<void ()> func);
 /**
  * This is a synonym for the following, which asserts certain locks are not
  * held:
@@ -114,20 +129,38 @@ protected:
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated yet */
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {};
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend class CMainSignals;
+    friend void ::RegisterValidationInterface(CValidationInterface*, const std::string&);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
 };
 
+/** Backlog and timing of one subscriber's background callback queue */
+struct ValidationQueueInfo {
+    std::string name;
+    //! callbacks waiting to run
+    size_t pending = 0;
+    //! the most callbacks that were waiting at once
+    size_t max_pending = 0;
+    //! callbacks run
+    uint64_t callbacks = 0;
+    int64_t total_micros = 0;
+    //! longest single callback
+    int64_t max_micros = 0;
+    //! longest time a callback waited in the queue before it started
+    int64_t max_wait_micros = 0;
+};
+
 struct MainSignalsInstance;
 class CMainSignals {
 private:
     std::unique_ptr<MainSignalsInstance> m_internals;
 
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterValidationInterface(CValidationInterface*, const std::string&);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
     friend void ::CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+    friend void ::CallFunctionInValidationInterfaceQueue(const CValidationInterface* callbacks, std::function<void ()> func);
 
     void MempoolEntryRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
 
@@ -136,10 +169,17 @@ public:
     void RegisterBackgroundSignalScheduler(CScheduler& scheduler);
     /** Unregister a CScheduler to give callbacks which should run in the background - these callbacks will now be dropped! */
     void UnregisterBackgroundSignalScheduler();
+    /** The registered background scheduler, or nullptr */
+    const CScheduler* GetBackgroundSignalScheduler() const;
     /** Call any remaining callbacks on the calling thread */
     void FlushBackgroundCallbacks();
 
+    /** The most callbacks any one subscriber has waiting */
     size_t CallbacksPending();
+    /** The number of callbacks one subscriber has waiting */
+    size_t CallbacksPending(const CValidationInterface* callbacks);
+    /** Backlog and timing of every registered subscriber's queue */
+    std::vector<ValidationQueueInfo> GetQueueInfo();
 
     /** Register with mempool to call TransactionRemovedFromMempool callbacks */
     void RegisterWithMempoolSignals(CTxMemPool& pool);
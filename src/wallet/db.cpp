@@ -398,7 +398,7 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 }
 
 
-CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr)
+CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr), m_group_txn(nullptr), m_dbw(&dbw)
 {
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
     fFlushOnClose = fFlushOnCloseIn;
@@ -406,6 +406,7 @@ CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb
     if (dbw.IsDummy()) {
         return;
     }
+    DbTxn* group_txn = dbw.JoinGroupCommit();
     const std::string &strFilename = dbw.strFile;
 
     bool fCreate = strchr(pszMode, 'c') != nullptr;
@@ -457,6 +458,7 @@ CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb
         ++env->mapFileUseCount[strFilename];
         strFile = strFilename;
     }
+    m_group_txn = activeTxn = group_txn;
 }
 
 void CDB::Flush()
@@ -464,12 +466,19 @@ void CDB::Flush()
     if (activeTxn)
         return;
 
-    // Flush database activity from memory pool to disk log
-    unsigned int nMinutes = 0;
-    if (fReadOnly)
-        nMinutes = 1;
-
-    env->dbenv->txn_checkpoint(nMinutes ? gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024 : 0, nMinutes, 0);
+    // Make committed writes durable. Commits only append to the log
+    // (DB_TXN_WRITE_NOSYNC), and log_flush() syncs everything appended so
+    // far, so a caller that arrives while another sync is running finds
+    // its write already covered or joins the next one. Under RPC load this
+    // batches writes the way a commit timer would, sized by the load
+    // rather than by a fixed interval, and an idle wallet does not wait
+    // for a timer before acknowledging.
+    if (!fReadOnly)
+        env->dbenv->log_flush(nullptr);
+
+    // Folding the log into the data file is only needed to bound the log
+    // size; MaybeCompactWalletDB() and shutdown make the file self-contained.
+    env->dbenv->txn_checkpoint(gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024, 1, 0);
 }
 
 void CWalletDBWrapper::IncrementUpdateCounter()
@@ -477,17 +486,104 @@ void CWalletDBWrapper::IncrementUpdateCounter()
     ++nUpdateCounter;
 }
 
+bool CWalletDBWrapper::BeginGroupCommit()
+{
+    if (IsDummy()) {
+        return true;
+    }
+    WaitableLock lock(cs_group);
+    if (m_group_depth > 0 && m_group_owner == std::this_thread::get_id()) {
+        ++m_group_depth;
+        return true;
+    }
+    cv_group.wait(lock, [this] { return m_group_depth == 0; });
+
+    {
+        LOCK(env->cs_db);
+        if (!env->Open(GetWalletDir())) {
+            return false;
+        }
+        // Keep the file in use so PeriodicFlush() does not close it under
+        // the open transaction
+        ++env->mapFileUseCount[strFile];
+    }
+    m_group_txn = env->TxnBegin();
+    if (!m_group_txn) {
+        LOCK(env->cs_db);
+        --env->mapFileUseCount[strFile];
+        return false;
+    }
+    m_group_owner = std::this_thread::get_id();
+    m_group_depth = 1;
+    m_group_flush = false;
+    m_group_abort = false;
+    return true;
+}
+
+bool CWalletDBWrapper::EndGroupCommit(bool fCommit)
+{
+    if (IsDummy()) {
+        return true;
+    }
+    bool fFlush;
+    int ret;
+    {
+        WaitableLock lock(cs_group);
+        assert(m_group_depth > 0 && m_group_owner == std::this_thread::get_id());
+        m_group_abort |= !fCommit;
+        if (--m_group_depth > 0) {
+            return !m_group_abort;
+        }
+        fCommit = !m_group_abort;
+        ret = fCommit ? m_group_txn->commit(0) : m_group_txn->abort();
+        m_group_txn = nullptr;
+        m_group_owner = std::thread::id();
+        fFlush = m_group_flush;
+    }
+    if (ret != 0) {
+        LogPrintf("%s: Error %d %s %s: %s\n", __func__, ret, fCommit ? "committing" : "aborting", strFile, DbEnv::strerror(ret));
+    } else if (!fCommit) {
+        LogPrintf("%s: Discarded the grouped writes to %s\n", __func__, strFile);
+    } else if (fFlush) {
+        env->dbenv->log_flush(nullptr);
+    }
+    {
+        LOCK(env->cs_db);
+        --env->mapFileUseCount[strFile];
+    }
+    cv_group.notify_all();
+    return fCommit && ret == 0;
+}
+
+DbTxn* CWalletDBWrapper::JoinGroupCommit()
+{
+    WaitableLock lock(cs_group);
+    if (m_group_depth > 0 && m_group_owner == std::this_thread::get_id()) {
+        return m_group_txn;
+    }
+    cv_group.wait(lock, [this] { return m_group_depth == 0; });
+    return nullptr;
+}
+
 void CDB::Close()
 {
     if (!pdb)
         return;
-    if (activeTxn)
+    if (activeTxn && activeTxn != m_group_txn)
         activeTxn->abort();
     activeTxn = nullptr;
     pdb = nullptr;
 
-    if (fFlushOnClose)
+    if (m_group_txn) {
+        // Flushed once the group is committed
+        if (fFlushOnClose) {
+            WaitableLock lock(m_dbw->cs_group);
+            m_dbw->m_group_flush = true;
+        }
+        m_group_txn = nullptr;
+    } else if (fFlushOnClose) {
         Flush();
+    }
 
     {
         LOCK(env->cs_db);
@@ -17,6 +17,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <db_cxx.h>
@@ -76,10 +77,10 @@ public:
 
     void CloseDb(const std::string& strFile);
 
-    DbTxn* TxnBegin(int flags = DB_TXN_WRITE_NOSYNC)
+    DbTxn* TxnBegin(int flags = DB_TXN_WRITE_NOSYNC, DbTxn* parent = nullptr)
     {
         DbTxn* ptxn = nullptr;
-        int ret = dbenv->txn_begin(nullptr, &ptxn, flags);
+        int ret = dbenv->txn_begin(parent, &ptxn, flags);
         if (!ptxn || ret != 0)
             return nullptr;
         return ptxn;
@@ -124,6 +125,18 @@ public:
 
     void IncrementUpdateCounter();
 
+    /** Start grouping the writes made by this thread into one database
+     * transaction. Nests; the group is committed by the outermost
+     * EndGroupCommit(). CDB instances opened on other threads meanwhile
+     * wait for the group to be committed.
+     */
+    bool BeginGroupCommit();
+    /** End a group scope. The outermost scope commits the transaction, or
+     * aborts it if this or any nested scope ended with fCommit false.
+     * Returns false if the group's writes were or will be discarded.
+     */
+    bool EndGroupCommit(bool fCommit);
+
     std::atomic<unsigned int> nUpdateCounter;
     unsigned int nLastSeen;
     unsigned int nLastFlushed;
@@ -134,6 +147,19 @@ private:
     CDBEnv *env;
     std::string strFile;
 
+    /** Group commit state */
+    CWaitableCriticalSection cs_group;
+    CConditionVariable cv_group;
+    DbTxn* m_group_txn = nullptr;
+    std::thread::id m_group_owner;
+    int m_group_depth = 0;
+    bool m_group_flush = false;
+    bool m_group_abort = false;
+
+    /** Return the group transaction if this thread owns it. Otherwise wait
+     * for any group in progress to finish and return nullptr. */
+    DbTxn* JoinGroupCommit();
+
     /** Return whether this database handle is a dummy for testing.
      * Only to be used at a low level, application should ideally not care
      * about this.
@@ -152,6 +178,9 @@ protected:
     bool fReadOnly;
     bool fFlushOnClose;
     CDBEnv *env;
+    //! Group transaction of the database this instance writes through, if any
+    DbTxn* m_group_txn;
+    CWalletDBWrapper* m_dbw;
 
 public:
     explicit CDB(CWalletDBWrapper& dbw, const char* pszMode = "r+", bool fFlushOnCloseIn=true);
@@ -160,6 +189,8 @@ public:
     CDB(const CDB&) = delete;
     CDB& operator=(const CDB&) = delete;
 
+    /** Make this handle's committed writes durable. Writes committed on
+     * other threads before the call are synced along with them. */
     void Flush();
     void Close();
     static bool Recover(const std::string& filename, void *callbackDataIn, bool (*recoverKVcallback)(void* callbackData, CDataStream ssKey, CDataStream ssValue), std::string& out_backup_filename);
@@ -328,9 +359,10 @@ public:
 public:
     bool TxnBegin()
     {
-        if (!pdb || activeTxn)
+        if (!pdb || activeTxn != m_group_txn)
             return false;
-        DbTxn* ptxn = bitdb.TxnBegin();
+        // Inside a group this is a child transaction of the group
+        DbTxn* ptxn = bitdb.TxnBegin(DB_TXN_WRITE_NOSYNC, m_group_txn);
         if (!ptxn)
             return false;
         activeTxn = ptxn;
@@ -339,19 +371,19 @@ public:
 
     bool TxnCommit()
     {
-        if (!pdb || !activeTxn)
+        if (!pdb || !activeTxn || activeTxn == m_group_txn)
             return false;
         int ret = activeTxn->commit(0);
-        activeTxn = nullptr;
+        activeTxn = m_group_txn;
         return (ret == 0);
     }
 
     bool TxnAbort()
     {
-        if (!pdb || !activeTxn)
+        if (!pdb || !activeTxn || activeTxn == m_group_txn)
             return false;
         int ret = activeTxn->abort();
-        activeTxn = nullptr;
+        activeTxn = m_group_txn;
         return (ret == 0);
     }
 
@@ -93,6 +93,14 @@ bool GetWalletAddressesForKey(CWallet * const pwallet, const CKeyID &keyid, std:
 }
 
 
+/** The result of an import whose rescan was deferred to the end of an import session */
+static UniValue RescanDeferredResult()
+{
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("rescan_deferred", true);
+    return result;
+}
+
 UniValue importprivkey(const JSONRPCRequest& request)
 {
     CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
@@ -108,6 +116,8 @@ UniValue importprivkey(const JSONRPCRequest& request)
             "1. \"privkey\"          (string, required) The private key (see dumpprivkey)\n"
             "2. \"label\"            (string, optional, default=\"\") An optional label\n"
             "3. rescan               (boolean, optional, default=true) Rescan the wallet for transactions\n"
+            "\nResult:\n"
+            "null, or {\"rescan_deferred\": true} if the rescan was deferred to the end of an import session\n"
             "\nNote: This call can take minutes to complete if rescan is true, during that time, other rpc calls\n"
             "may report that the imported key exists but related transactions are still missing, leading to temporarily incorrect/bogus balances and unspent outputs until rescan completes.\n"
             "\nExamples:\n"
@@ -126,6 +136,7 @@ UniValue importprivkey(const JSONRPCRequest& request)
 
     WalletRescanReserver reserver(pwallet);
     bool fRescan = true;
+    bool fDefer = false;
     {
         LOCK2(cs_main, pwallet->cs_wallet);
 
@@ -143,6 +154,12 @@ UniValue importprivkey(const JSONRPCRequest& request)
         if (fRescan && fPruneMode)
             throw JSONRPCError(RPC_WALLET_ERROR, "Rescan is disabled in pruned mode");
 
+        // Inside an import session the rescan is done when the session ends
+        if (fRescan && pwallet->IsImportSessionOpen()) {
+            fRescan = false;
+            fDefer = true;
+        }
+
         if (fRescan && !reserver.reserve()) {
             throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
         }
@@ -179,6 +196,10 @@ UniValue importprivkey(const JSONRPCRequest& request)
             }
             pwallet->LearnAllRelatedScripts(pubkey);
         }
+        // cs_wallet has been held since the session was checked, so it is still open
+        if (fDefer && pwallet->DeferImportRescan(TIMESTAMP_MIN)) {
+            return RescanDeferredResult();
+        }
     }
     if (fRescan) {
         pwallet->RescanFromTime(TIMESTAMP_MIN, reserver, true /* update */);
@@ -213,6 +234,78 @@ UniValue abortrescan(const JSONRPCRequest& request)
     return true;
 }
 
+UniValue importsession(const JSONRPCRequest& request)
+{
+    CWallet* const pwallet = GetWalletForJSONRPCRequest(request);
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "importsession \"action\"\n"
+            "\nStarts, finishes or aborts an import session. While a session is open, importprivkey, importaddress,\n"
+            "importpubkey and importmulti calls do not rescan. Finishing the session performs a single rescan\n"
+            "covering all imports of the session that asked for one. Aborting it closes the session without\n"
+            "rescanning, e.g. one left open by a client that went away. getwalletinfo shows an open session.\n"
+            "\nArguments:\n"
+            "1. \"action\"    (string, required) \"start\", \"finish\" or \"abort\"\n"
+            "\nResult (for \"finish\"):\n"
+            "{\n"
+            "  \"rescanned\": true|false    (boolean) Whether a rescan was performed\n"
+            "}\n"
+            "\nExamples:\n"
+            "\nImport many addresses with a single rescan\n"
+            + HelpExampleCli("importsession", "\"start\"")
+            + HelpExampleCli("importaddress", "\"myaddress\"")
+            + HelpExampleCli("importsession", "\"finish\"") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("importsession", "\"finish\"")
+        );
+
+    const std::string action = request.params[0].get_str();
+    if (action == "start") {
+        if (!pwallet->BeginImportSession()) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "An import session is already open");
+        }
+        return NullUniValue;
+    }
+    if (action == "abort") {
+        if (!pwallet->AbortImportSession()) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "No import session is open");
+        }
+        return NullUniValue;
+    }
+    if (action != "finish") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown action: " + action);
+    }
+
+    WalletRescanReserver reserver(pwallet);
+    if (!reserver.reserve()) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
+    }
+    int64_t nStartTime;
+    if (!pwallet->EndImportSession(nStartTime)) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "No import session is open");
+    }
+
+    const bool fRescan = nStartTime != std::numeric_limits<int64_t>::max();
+    if (fRescan) {
+        int64_t scannedTime = pwallet->RescanFromTime(nStartTime, reserver, true /* update */);
+        pwallet->ReacceptWalletTransactions();
+        if (pwallet->IsAbortingRescan()) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted.");
+        }
+        if (scannedTime > nStartTime) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Rescan failed. Potentially corrupted data files.");
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("rescanned", UniValue(fRescan));
+    return result;
+}
+
 void ImportAddress(CWallet*, const CTxDestination& dest, const std::string& strLabel);
 void ImportScript(CWallet* const pwallet, const CScript& script, const std::string& strLabel, bool isRedeemScript)
 {
@@ -264,6 +357,8 @@ UniValue importaddress(const JSONRPCRequest& request)
             "2. \"label\"            (string, optional, default=\"\") An optional label\n"
             "3. rescan               (boolean, optional, default=true) Rescan the wallet for transactions\n"
             "4. p2sh                 (boolean, optional, default=false) Add the P2SH version of the script as well\n"
+            "\nResult:\n"
+            "null, or {\"rescan_deferred\": true} if the rescan was deferred to the end of an import session\n"
             "\nNote: This call can take minutes to complete if rescan is true, during that time, other rpc calls\n"
             "may report that the imported address exists but related transactions are still missing, leading to temporarily incorrect/bogus balances and unspent outputs until rescan completes.\n"
             "If you have the full public key, you should call importpubkey instead of this.\n"
@@ -291,19 +386,26 @@ UniValue importaddress(const JSONRPCRequest& request)
     if (fRescan && fPruneMode)
         throw JSONRPCError(RPC_WALLET_ERROR, "Rescan is disabled in pruned mode");
 
-    WalletRescanReserver reserver(pwallet);
-    if (fRescan && !reserver.reserve()) {
-        throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
-    }
-
     // Whether to import a p2sh version, too
     bool fP2SH = false;
     if (!request.params[3].isNull())
         fP2SH = request.params[3].get_bool();
 
+    WalletRescanReserver reserver(pwallet);
+    bool fDefer = false;
     {
         LOCK2(cs_main, pwallet->cs_wallet);
 
+        // Inside an import session the rescan is done when the session ends
+        if (fRescan && pwallet->IsImportSessionOpen()) {
+            fRescan = false;
+            fDefer = true;
+        }
+
+        if (fRescan && !reserver.reserve()) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
+        }
+
         CTxDestination dest = DecodeDestination(request.params[0].get_str());
         if (IsValidDestination(dest)) {
             if (fP2SH) {
@@ -316,6 +418,9 @@ UniValue importaddress(const JSONRPCRequest& request)
         } else {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid ROGER address or script");
         }
+        if (fDefer && pwallet->DeferImportRescan(TIMESTAMP_MIN)) {
+            return RescanDeferredResult();
+        }
     }
     if (fRescan)
     {
@@ -440,6 +545,8 @@ UniValue importpubkey(const JSONRPCRequest& request)
             "1. \"pubkey\"           (string, required) The hex-encoded public key\n"
             "2. \"label\"            (string, optional, default=\"\") An optional label\n"
             "3. rescan               (boolean, optional, default=true) Rescan the wallet for transactions\n"
+            "\nResult:\n"
+            "null, or {\"rescan_deferred\": true} if the rescan was deferred to the end of an import session\n"
             "\nNote: This call can take minutes to complete if rescan is true, during that time, other rpc calls\n"
             "may report that the imported pubkey exists but related transactions are still missing, leading to temporarily incorrect/bogus balances and unspent outputs until rescan completes.\n"
             "\nExamples:\n"
@@ -464,11 +571,6 @@ UniValue importpubkey(const JSONRPCRequest& request)
     if (fRescan && fPruneMode)
         throw JSONRPCError(RPC_WALLET_ERROR, "Rescan is disabled in pruned mode");
 
-    WalletRescanReserver reserver(pwallet);
-    if (fRescan && !reserver.reserve()) {
-        throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
-    }
-
     if (!IsHex(request.params[0].get_str()))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Pubkey must be a hex string");
     std::vector<unsigned char> data(ParseHex(request.params[0].get_str()));
@@ -476,14 +578,29 @@ UniValue importpubkey(const JSONRPCRequest& request)
     if (!pubKey.IsFullyValid())
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Pubkey is not a valid public key");
 
+    WalletRescanReserver reserver(pwallet);
+    bool fDefer = false;
     {
         LOCK2(cs_main, pwallet->cs_wallet);
 
+        // Inside an import session the rescan is done when the session ends
+        if (fRescan && pwallet->IsImportSessionOpen()) {
+            fRescan = false;
+            fDefer = true;
+        }
+
+        if (fRescan && !reserver.reserve()) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
+        }
+
         for (const auto& dest : GetAllDestinationsForKey(pubKey)) {
             ImportAddress(pwallet, dest, strLabel);
         }
         ImportScript(pwallet, GetScriptForRawPubKey(pubKey), strLabel, false);
         pwallet->LearnAllRelatedScripts(pubKey);
+        if (fDefer && pwallet->DeferImportRescan(TIMESTAMP_MIN)) {
+            return RescanDeferredResult();
+        }
     }
     if (fRescan)
     {
@@ -1167,7 +1284,9 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
             HelpExampleCli("importmulti", "'[{ \"scriptPubKey\": { \"address\": \"<my address>\" }, \"timestamp\":1455191478 }]' '{ \"rescan\": false}'") +
 
             "\nResponse is an array with the same size as the input that has the execution result :\n"
-            "  [{ \"success\": true } , { \"success\": false, \"error\": { \"code\": -1, \"message\": \"Internal Server Error\"} }, ... ]\n");
+            "  [{ \"success\": true } , { \"success\": false, \"error\": { \"code\": -1, \"message\": \"Internal Server Error\"} }, ... ]\n"
+            "Inside an import session, successful results whose rescan was deferred to the end of the session\n"
+            "have \"rescan_deferred\": true.\n");
 
     // clang-format on
 
@@ -1187,18 +1306,22 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
     }
 
     WalletRescanReserver reserver(pwallet);
-    if (fRescan && !reserver.reserve()) {
-        throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
-    }
-
     int64_t now = 0;
     bool fRunScan = false;
+    bool fDefer = false;
     int64_t nLowestTimestamp = 0;
     UniValue response(UniValue::VARR);
     {
         LOCK2(cs_main, pwallet->cs_wallet);
         EnsureWalletIsUnlocked(pwallet);
 
+        // Inside an import session the rescan is done when the session ends
+        if (fRescan && pwallet->IsImportSessionOpen()) {
+            fDefer = true;
+        } else if (fRescan && !reserver.reserve()) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
+        }
+
         // Verify all timestamps are present before importing any keys.
         now = chainActive.Tip() ? chainActive.Tip()->GetMedianTimePast() : 0;
         for (const UniValue& data : requests.getValues()) {
@@ -1227,11 +1350,25 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
                 fRunScan = true;
             }
 
-            // Get the lowest timestamp.
-            if (timestamp < nLowestTimestamp) {
+            // Get the lowest timestamp. A deferred rescan only needs to cover
+            // the imports that succeeded.
+            if (timestamp < nLowestTimestamp && (!fDefer || result["success"].get_bool())) {
                 nLowestTimestamp = timestamp;
             }
         }
+
+        if (fRescan && fRunScan && fDefer && pwallet->DeferImportRescan(nLowestTimestamp)) {
+            fRescan = false;
+            std::vector<UniValue> results = response.getValues();
+            response.clear();
+            response.setArray();
+            for (UniValue& result : results) {
+                if (result["success"].get_bool()) {
+                    result.pushKV("rescan_deferred", true);
+                }
+                response.push_back(std::move(result));
+            }
+        }
     }
     if (fRescan && fRunScan && requests.size()) {
         int64_t scannedTime = pwallet->RescanFromTime(nLowestTimestamp, reserver, true /* update */);
@@ -23,6 +23,7 @@
 #include <timedata.h>
 #include <util.h>
 #include <utilmoneystr.h>
+#include <utilstrencodings.h>
 #include <wallet/coincontrol.h>
 #include <wallet/feebumper.h>
 #include <wallet/wallet.h>
@@ -1728,15 +1729,20 @@ UniValue listtransactions(const JSONRPCRequest& request)
         return NullUniValue;
     }
 
-    if (request.fHelp || request.params.size() > 4)
+    if (request.fHelp || request.params.size() > 5)
         throw std::runtime_error(
-            "listtransactions ( \"account\" count skip include_watchonly)\n"
+            "listtransactions ( \"account\" count skip include_watchonly \"cursor\" )\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account 'account'.\n"
             "\nArguments:\n"
             "1. \"account\"    (string, optional) DEPRECATED. The account name. Should be \"*\".\n"
             "2. count          (numeric, optional, default=10) The number of transactions to return\n"
             "3. skip           (numeric, optional, default=0) The number of transactions to skip\n"
             "4. include_watchonly (bool, optional, default=false) Include transactions to watch-only addresses (see 'importaddress')\n"
+            "5. \"cursor\"     (string, optional) Page through the history instead of skipping. Pass \"\" to get the most recent\n"
+            "                  page, then the \"cursor\" of each result to get the page before it. The result is then an\n"
+            "                  object {\"transactions\":[...], \"cursor\":\"...\"}, where \"cursor\" is absent after the oldest page.\n"
+            "                  A page never splits the entries of one transaction, so it may hold more than 'count' entries.\n"
+            "                  Cannot be combined with skip.\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -1784,6 +1790,9 @@ UniValue listtransactions(const JSONRPCRequest& request)
             + HelpExampleCli("listtransactions", "") +
             "\nList transactions 100 to 120\n"
             + HelpExampleCli("listtransactions", "\"*\" 20 100") +
+            "\nList the most recent page of 1000 transactions, then the page before it\n"
+            + HelpExampleCli("listtransactions", "\"*\" 1000 0 false \"\"") +
+            HelpExampleCli("listtransactions", "\"*\" 1000 0 false \"123456\"") +
             "\nAs a json rpc call\n"
             + HelpExampleRpc("listtransactions", "\"*\", 20, 100")
         );
@@ -1819,6 +1828,48 @@ UniValue listtransactions(const JSONRPCRequest& request)
 
     const CWallet::TxItems & txOrdered = pwallet->wtxOrdered;
 
+    if (!request.params[4].isNull()) {
+        if (nFrom != 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot combine skip with cursor");
+
+        // The cursor is the order position of the oldest transaction returned
+        // so far; resume right before it so a page costs O(count), however
+        // deep into the history it is.
+        CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin();
+        int64_t nCursor = 0;
+        const std::string& strCursor = request.params[4].get_str();
+        if (!strCursor.empty()) {
+            if (!ParseInt64(strCursor, &nCursor))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+            it = CWallet::TxItems::const_reverse_iterator(txOrdered.lower_bound(nCursor));
+        }
+
+        // Stop only between order positions, so an entry sharing a position
+        // with the last one returned is not lost.
+        bool fConsumed = false;
+        for (; it != txOrdered.rend() && ((int)ret.size() < nCount || (fConsumed && it->first == nCursor)); ++it) {
+            CWalletTx *const pwtx = (*it).second.first;
+            if (pwtx != nullptr)
+                ListTransactions(pwallet, *pwtx, strAccount, 0, true, ret, filter);
+            CAccountingEntry *const pacentry = (*it).second.second;
+            if (pacentry != nullptr)
+                AcentryToJSON(*pacentry, strAccount, ret);
+            nCursor = it->first;
+            fConsumed = true;
+        }
+
+        std::vector<UniValue> arrTmp = ret.getValues();
+        std::reverse(arrTmp.begin(), arrTmp.end()); // Return oldest to newest
+        UniValue transactions(UniValue::VARR);
+        transactions.push_backV(arrTmp);
+
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("transactions", transactions));
+        if (it != txOrdered.rend() && (fConsumed || !strCursor.empty()))
+            result.push_back(Pair("cursor", i64tostr(nCursor)));
+        return result;
+    }
+
     // iterate backwards until we have nCount items to return:
     for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
     {
@@ -2049,11 +2100,14 @@ UniValue listsinceblock(const JSONRPCRequest& request)
 
     UniValue transactions(UniValue::VARR);
 
-    for (const std::pair<uint256, CWalletTx>& pairWtx : pwallet->mapWallet) {
-        CWalletTx tx = pairWtx.second;
-
-        if (depth == -1 || tx.GetDepthInMainChain() < depth) {
-            ListTransactions(pwallet, tx, "*", 0, true, transactions, filter);
+    // Only visit the transactions confirmed after pindex or not confirmed in
+    // the active chain at all, instead of every transaction in the wallet.
+    // They are listed in txid order, as when all of mapWallet was walked.
+    std::vector<const CWalletTx*> vpwtx = pwallet->GetTransactionsAboveHeight(pindex ? pindex->nHeight : -1);
+    std::sort(vpwtx.begin(), vpwtx.end(), [](const CWalletTx* a, const CWalletTx* b) { return a->GetHash() < b->GetHash(); });
+    for (const CWalletTx* pwtx : vpwtx) {
+        if (depth == -1 || pwtx->GetDepthInMainChain() < depth) {
+            ListTransactions(pwallet, *pwtx, "*", 0, true, transactions, filter);
         }
     }
 
@@ -2769,6 +2823,10 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
             "  \"unlocked_until\": ttt,           (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
             "  \"paytxfee\": x.xxxx,              (numeric) the transaction fee configuration, set in " + CURRENCY_UNIT + "/kB\n"
             "  \"hdmasterkeyid\": \"<hash160>\"     (string, optional) the Hash160 of the HD master pubkey (only present when HD is enabled)\n"
+            "  \"import_session\": {            (json object, optional) only present while an import session is open (see importsession)\n"
+            "    \"started\": ttt,                (numeric) the timestamp in seconds since epoch when the session was started\n"
+            "    \"rescan_from\": ttt             (numeric, optional) the earliest key time the deferred rescan covers, if any import deferred one\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
@@ -2786,11 +2844,12 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
     UniValue obj(UniValue::VOBJ);
 
     size_t kpExternalSize = pwallet->KeypoolCountExternalKeys();
+    const CWalletBalance balances = pwallet->GetBalances();
     obj.push_back(Pair("walletname", pwallet->GetName()));
     obj.push_back(Pair("walletversion", pwallet->GetVersion()));
-    obj.push_back(Pair("balance",       ValueFromAmount(pwallet->GetBalance())));
-    obj.push_back(Pair("unconfirmed_balance", ValueFromAmount(pwallet->GetUnconfirmedBalance())));
-    obj.push_back(Pair("immature_balance",    ValueFromAmount(pwallet->GetImmatureBalance())));
+    obj.push_back(Pair("balance",       ValueFromAmount(balances.m_mine_trusted)));
+    obj.push_back(Pair("unconfirmed_balance", ValueFromAmount(balances.m_mine_untrusted_pending)));
+    obj.push_back(Pair("immature_balance",    ValueFromAmount(balances.m_mine_immature)));
     obj.push_back(Pair("txcount",       (int)pwallet->mapWallet.size()));
     obj.push_back(Pair("keypoololdest", pwallet->GetOldestKeyPoolTime()));
     obj.push_back(Pair("keypoolsize", (int64_t)kpExternalSize));
@@ -2804,6 +2863,15 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
     obj.push_back(Pair("paytxfee",      ValueFromAmount(payTxFee.GetFeePerK())));
     if (!masterKeyID.IsNull())
          obj.push_back(Pair("hdmasterkeyid", masterKeyID.GetHex()));
+    int64_t nSessionStarted, nSessionRescanTime;
+    if (pwallet->GetImportSession(nSessionStarted, nSessionRescanTime)) {
+        UniValue session(UniValue::VOBJ);
+        session.push_back(Pair("started", nSessionStarted));
+        if (nSessionRescanTime != std::numeric_limits<int64_t>::max()) {
+            session.push_back(Pair("rescan_from", nSessionRescanTime));
+        }
+        obj.push_back(Pair("import_session", session));
+    }
     return obj;
 }
 
@@ -3521,6 +3589,7 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
 }
 
 extern UniValue abortrescan(const JSONRPCRequest& request); // in rpcdump.cpp
+extern UniValue importsession(const JSONRPCRequest& request); // in rpcdump.cpp
 extern UniValue dumpprivkey(const JSONRPCRequest& request); // in rpcdump.cpp
 extern UniValue importprivkey(const JSONRPCRequest& request);
 extern UniValue importaddress(const JSONRPCRequest& request);
@@ -3563,6 +3632,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "importaddress",            &importaddress,            {"address","label","rescan","p2sh"} },
     { "wallet",             "importprunedfunds",        &importprunedfunds,        {"rawtransaction","txoutproof"} },
     { "wallet",             "importpubkey",             &importpubkey,             {"pubkey","label","rescan"} },
+    { "wallet",             "importsession",            &importsession,            {"action"} },
     { "wallet",             "keypoolrefill",            &keypoolrefill,            {"newsize"} },
     { "wallet",             "listaccounts",             &listaccounts,             {"minconf","include_watchonly"} },
     { "wallet",             "listaddressgroupings",     &listaddressgroupings,     {} },
@@ -3570,7 +3640,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    {"minconf","include_empty","include_watchonly"} },
     { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    {"minconf","include_empty","include_watchonly"} },
     { "wallet",             "listsinceblock",           &listsinceblock,           {"blockhash","target_confirmations","include_watchonly","include_removed"} },
-    { "wallet",             "listtransactions",         &listtransactions,         {"account","count","skip","include_watchonly"} },
+    { "wallet",             "listtransactions",         &listtransactions,         {"account","count","skip","include_watchonly","cursor"} },
     { "wallet",             "listunspent",              &listunspent,              {"minconf","maxconf","addresses","include_unsafe","query_options"} },
     { "wallet",             "listwallets",              &listwallets,              {} },
     { "wallet",             "lockunspent",              &lockunspent,              {"unlock","transactions"} },
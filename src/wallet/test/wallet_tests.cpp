@@ -4,12 +4,15 @@
 
 #include <wallet/wallet.h>
 
+#include <atomic>
 #include <memory>
 #include <set>
 #include <stdint.h>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include <consensus/merkle.h>
 #include <consensus/validation.h>
 #include <rpc/server.h>
 #include <test/test_bitcoin.h>
@@ -559,6 +562,75 @@ static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64
     return wallet.mapWallet.at(wtx.GetHash()).nTimeSmart;
 }
 
+BOOST_AUTO_TEST_CASE(BranchAndBoundSelection)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    LOCK(testWallet.cs_wallet);
+
+    empty_wallet();
+
+    // An exact match leaving no change is found
+    add_coin(4 * COIN);
+    add_coin(3 * COIN);
+    add_coin(3 * COIN);
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(6 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, COIN / 10));
+    BOOST_CHECK_EQUAL(nValueRet, 6 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    empty_wallet();
+
+    // Excess within the window is accepted, even with a larger coin available
+    add_coin(7 * COIN);
+    add_coin(4 * COIN);
+    add_coin(205 * CENT);
+    add_coin(2 * CENT);
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(6 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, COIN / 10));
+    BOOST_CHECK_EQUAL(nValueRet, 605 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // Smallest excess wins
+    add_coin(198 * CENT);
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(6 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, COIN / 10));
+    BOOST_CHECK_EQUAL(nValueRet, 6 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 3U);
+
+    empty_wallet();
+
+    // Nothing in the window: fall back to the knapsack solver
+    add_coin(4 * COIN);
+    add_coin(25 * COIN / 10);
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(6 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, COIN / 10));
+    BOOST_CHECK_EQUAL(nValueRet, 65 * COIN / 10);
+
+    empty_wallet();
+
+    // A larger coin with the same excess as a set of many equal values wins
+    // on input count
+    for (int i = 0; i < 50; i++)
+        add_coin(2 * COIN);
+    add_coin(52 * COIN);
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(5170 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet, COIN / 2));
+    BOOST_CHECK_EQUAL(nValueRet, 52 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+    empty_wallet();
+
+    // Within the search too: {4, 1, 1} is found first, {3, 3} replaces it
+    add_coin(4 * COIN);
+    add_coin(3 * COIN);
+    add_coin(3 * COIN);
+    add_coin(1 * COIN);
+    add_coin(1 * COIN);
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(595 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet, COIN / 10));
+    BOOST_CHECK_EQUAL(nValueRet, 6 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+    BOOST_CHECK(setCoinsRet.begin()->txout.nValue == 3 * COIN);
+
+    empty_wallet();
+}
+
 // Simple test to verify assignment of CWalletTx::nSmartTime value. Could be
 // expanded to cover more corner cases of smart time logic.
 BOOST_AUTO_TEST_CASE(ComputeTimeSmart)
@@ -603,6 +675,345 @@ BOOST_AUTO_TEST_CASE(LoadReceiveRequests)
     BOOST_CHECK_EQUAL(values[1], "val_rr1");
 }
 
+static isminetype IsMineOutput(const CWallet& wallet, const CScript& script)
+{
+    return wallet.IsMine(CTxOut(1, script));
+}
+
+BOOST_AUTO_TEST_CASE(TopUpKeyPoolDerivation)
+{
+    // A keypool top-up derives the same keys as deriving them one at a time
+    CKey master;
+    master.MakeNewKey(true);
+    CWallet batched, serial;
+    LOCK2(batched.cs_wallet, serial.cs_wallet);
+    for (CWallet* wallet : {&batched, &serial}) {
+        wallet->SetMinVersion(FEATURE_HD_SPLIT);
+        BOOST_CHECK(wallet->AddKeyPubKey(master, master.GetPubKey()));
+        BOOST_CHECK(wallet->SetHDMasterKey(master.GetPubKey()));
+    }
+
+    BOOST_CHECK(batched.TopUpKeyPool(40));
+    BOOST_CHECK_EQUAL(batched.KeypoolCountExternalKeys(), 40U);
+    BOOST_CHECK_EQUAL(batched.GetKeyPoolSize(), 80U);
+
+    CWalletDB walletdb(serial.GetDBHandle());
+    for (bool internal : {false, true}) {
+        for (int i = 0; i < 40; i++) {
+            CPubKey pubkey = serial.GenerateNewKey(walletdb, internal);
+            BOOST_CHECK(batched.HaveKey(pubkey.GetID()));
+            BOOST_CHECK_EQUAL(batched.mapKeyMetadata[pubkey.GetID()].hdKeypath, serial.mapKeyMetadata[pubkey.GetID()].hdKeypath);
+        }
+    }
+    BOOST_CHECK_EQUAL(batched.GetHDChain().nExternalChainCounter, 40U);
+    BOOST_CHECK_EQUAL(batched.GetHDChain().nInternalChainCounter, 40U);
+}
+
+BOOST_AUTO_TEST_CASE(LoadWalletRecords)
+{
+    // Enough records to span several decoding batches
+    std::vector<CPubKey> vPubKeys;
+    std::vector<uint256> vTxids;
+    {
+        CWalletDBWrapper dbw(&bitdb, "wallet_load_test.dat");
+        CWalletDB walletdb(dbw, "cr+");
+        for (int i = 0; i < 1500; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            vPubKeys.push_back(key.GetPubKey());
+            BOOST_CHECK(walletdb.WriteKey(key.GetPubKey(), key.GetPrivKey(), CKeyMetadata(1)));
+
+            CMutableTransaction mtx;
+            mtx.vin.resize(1);
+            mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            mtx.vout.emplace_back(COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+            CWalletTx wtx(nullptr, MakeTransactionRef(std::move(mtx)));
+            wtx.nOrderPos = i;
+            vTxids.push_back(wtx.GetHash());
+            BOOST_CHECK(walletdb.WriteTx(wtx));
+        }
+    }
+
+    std::unique_ptr<CWalletDBWrapper> dbw(new CWalletDBWrapper(&bitdb, "wallet_load_test.dat"));
+    CWallet wallet(std::move(dbw));
+    bool fFirstRun;
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    LOCK(wallet.cs_wallet);
+    for (const CPubKey& pubkey : vPubKeys) {
+        BOOST_CHECK(wallet.HaveKey(pubkey.GetID()));
+    }
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), vTxids.size());
+    for (const uint256& txid : vTxids) {
+        BOOST_CHECK(wallet.mapWallet.count(txid));
+    }
+    BOOST_CHECK_EQUAL(wallet.GetBalances().m_mine_untrusted_pending, 0);
+}
+
+BOOST_AUTO_TEST_CASE(ImportSession)
+{
+    CWallet wallet;
+    int64_t nStartTime;
+    BOOST_CHECK(!wallet.DeferImportRescan(100));
+    BOOST_CHECK(!wallet.EndImportSession(nStartTime));
+
+    BOOST_CHECK(wallet.BeginImportSession());
+    BOOST_CHECK(!wallet.BeginImportSession());
+    BOOST_CHECK(wallet.EndImportSession(nStartTime));
+    BOOST_CHECK_EQUAL(nStartTime, std::numeric_limits<int64_t>::max());
+
+    // The rescan starts from the earliest time of any import
+    BOOST_CHECK(wallet.BeginImportSession());
+    BOOST_CHECK(wallet.DeferImportRescan(300));
+    BOOST_CHECK(wallet.DeferImportRescan(100));
+    BOOST_CHECK(wallet.DeferImportRescan(200));
+    BOOST_CHECK(wallet.EndImportSession(nStartTime));
+    BOOST_CHECK_EQUAL(nStartTime, 100);
+    BOOST_CHECK(!wallet.DeferImportRescan(100));
+
+    // An open session reports its state until it is aborted
+    int64_t nStarted, nRescanTime;
+    BOOST_CHECK(!wallet.IsImportSessionOpen());
+    BOOST_CHECK(!wallet.GetImportSession(nStarted, nRescanTime));
+    BOOST_CHECK(!wallet.AbortImportSession());
+    SetMockTime(1000);
+    BOOST_CHECK(wallet.BeginImportSession());
+    SetMockTime(0);
+    BOOST_CHECK(wallet.IsImportSessionOpen());
+    BOOST_CHECK(wallet.DeferImportRescan(500));
+    BOOST_CHECK(wallet.GetImportSession(nStarted, nRescanTime));
+    BOOST_CHECK_EQUAL(nStarted, 1000);
+    BOOST_CHECK_EQUAL(nRescanTime, 500);
+    BOOST_CHECK(wallet.AbortImportSession());
+    BOOST_CHECK(!wallet.IsImportSessionOpen());
+    BOOST_CHECK(!wallet.EndImportSession(nStartTime));
+}
+
+static bool ReadTestName(CWalletDBWrapper& dbw, const std::string& address, std::string& name)
+{
+    CDB batch(dbw, "r");
+    return batch.Read(std::make_pair(std::string("name"), address), name);
+}
+
+BOOST_AUTO_TEST_CASE(GroupCommit)
+{
+    CWalletDBWrapper& dbw = pwalletMain->GetDBHandle();
+    std::atomic<bool> fRead(false);
+    std::string name;
+    std::thread reader;
+    {
+        CWalletDBGroupCommit group_commit(dbw);
+        {
+            CWalletDBGroupCommit nested(dbw);
+            BOOST_CHECK(CWalletDB(dbw).WriteName("group1", "one"));
+            BOOST_CHECK(nested.Commit());
+        }
+        CWalletDB walletdb(dbw);
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.WriteName("group2", "two"));
+        BOOST_CHECK(walletdb.TxnAbort());
+        BOOST_CHECK(walletdb.WriteName("group3", "three"));
+
+        // Readers on this thread see the writes of the group
+        BOOST_CHECK(ReadTestName(dbw, "group1", name));
+
+        // Other threads wait for the group to be committed
+        reader = std::thread([&] {
+            std::string other;
+            fRead = ReadTestName(dbw, "group3", other) && other == "three";
+        });
+        MilliSleep(50);
+        BOOST_CHECK(!fRead);
+        BOOST_CHECK(group_commit.Commit());
+    }
+    reader.join();
+    BOOST_CHECK(fRead);
+    BOOST_CHECK(ReadTestName(dbw, "group1", name));
+    BOOST_CHECK_EQUAL(name, "one");
+}
+
+BOOST_AUTO_TEST_CASE(GroupCommitAbort)
+{
+    CWalletDBWrapper& dbw = pwalletMain->GetDBHandle();
+    std::string name;
+
+    // A scope left without Commit() discards its writes
+    {
+        CWalletDBGroupCommit group_commit(dbw);
+        BOOST_CHECK(CWalletDB(dbw).WriteName("abort1", "one"));
+    }
+    BOOST_CHECK(!ReadTestName(dbw, "abort1", name));
+
+    // So does a nested one, for the whole group, and the outer commit says so
+    {
+        CWalletDBGroupCommit group_commit(dbw);
+        BOOST_CHECK(CWalletDB(dbw).WriteName("abort2", "two"));
+        try {
+            CWalletDBGroupCommit nested(dbw);
+            BOOST_CHECK(CWalletDB(dbw).WriteName("abort3", "three"));
+            throw std::runtime_error("GroupCommitAbort");
+        } catch (const std::runtime_error&) {
+        }
+        BOOST_CHECK(!group_commit.Commit());
+    }
+    BOOST_CHECK(!ReadTestName(dbw, "abort2", name));
+    BOOST_CHECK(!ReadTestName(dbw, "abort3", name));
+
+    // The database is usable afterwards
+    {
+        CWalletDBGroupCommit group_commit(dbw);
+        BOOST_CHECK(CWalletDB(dbw).WriteName("abort4", "four"));
+        BOOST_CHECK(group_commit.Commit());
+    }
+    BOOST_CHECK(ReadTestName(dbw, "abort4", name));
+}
+
+BOOST_AUTO_TEST_CASE(GroupCommitFailure)
+{
+    CWallet& wallet = *pwalletMain;
+    CWalletDBWrapper& dbw = wallet.GetDBHandle();
+    LOCK(cs_main);
+    const CBlockIndex* pindex = chainActive.Tip();
+    wallet.SetBestChain(chainActive.GetLocator());
+    BOOST_CHECK(!wallet.IsRescanRequired());
+
+    // Abort the group the block notification joins, so its commit fails.
+    // The notification reports it instead of throwing.
+    {
+        CWalletDBGroupCommit group_commit(dbw);
+        {
+            CWalletDBGroupCommit nested(dbw);
+        }
+        BOOST_CHECK_NO_THROW(wallet.BlockConnected(std::make_shared<const CBlock>(), pindex, {}));
+        BOOST_CHECK_NO_THROW(wallet.BlockDisconnected(std::make_shared<const CBlock>()));
+        BOOST_CHECK(!group_commit.Commit());
+    }
+    BOOST_CHECK(wallet.IsRescanRequired());
+
+    // The best block is not advanced any more, so the next start rescans
+    CBlockLocator locator;
+    locator.vHave.push_back(uint256S("0x01"));
+    wallet.SetBestChain(locator);
+    BOOST_CHECK(CWalletDB(dbw).ReadBestBlock(locator));
+    BOOST_CHECK(locator.vHave.front() == pindex->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_CASE(TopUpKeyPoolBatches)
+{
+    // A top-up spanning several database transactions writes every key
+    CKey master;
+    master.MakeNewKey(true);
+    LOCK(pwalletMain->cs_wallet);
+    pwalletMain->SetMinVersion(FEATURE_HD_SPLIT);
+    BOOST_CHECK(pwalletMain->AddKeyPubKey(master, master.GetPubKey()));
+    BOOST_CHECK(pwalletMain->SetHDMasterKey(master.GetPubKey()));
+
+    const unsigned int nKeys = 2 * KEYPOOL_COMMIT_BATCH_SIZE + 500;
+    BOOST_CHECK(pwalletMain->TopUpKeyPool(nKeys));
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), 2 * nKeys);
+
+    CWalletDB walletdb(pwalletMain->GetDBHandle());
+    unsigned int nInternal = 0;
+    for (int64_t index = 1; index <= 2 * nKeys; index++) {
+        CKeyPool keypool;
+        BOOST_REQUIRE(walletdb.ReadPool(index, keypool));
+        BOOST_CHECK(pwalletMain->HaveKey(keypool.vchPubKey.GetID()));
+        nInternal += keypool.fInternal;
+    }
+    BOOST_CHECK_EQUAL(nInternal, nKeys);
+    BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nExternalChainCounter, nKeys);
+    BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nInternalChainCounter, nKeys);
+
+    // A batch whose commit fails leaves no trace in memory either
+    const size_t nKeysBefore = pwalletMain->GetKeys().size();
+    {
+        CWalletDBGroupCommit group_commit(pwalletMain->GetDBHandle());
+        {
+            CWalletDBGroupCommit nested(pwalletMain->GetDBHandle());
+        }
+        BOOST_CHECK_THROW(pwalletMain->TopUpKeyPool(nKeys + 10), std::runtime_error);
+        BOOST_CHECK(!group_commit.Commit());
+    }
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), 2 * nKeys);
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeys().size(), nKeysBefore);
+    BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nExternalChainCounter, nKeys);
+    BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nInternalChainCounter, nKeys);
+
+    // and the next top-up continues where the database left off
+    BOOST_CHECK(pwalletMain->TopUpKeyPool(nKeys + 10));
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), 2 * (nKeys + 10));
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeys().size(), nKeysBefore + 20);
+    CKeyPool keypool;
+    BOOST_REQUIRE(walletdb.ReadPool(2 * nKeys + 20, keypool));
+    BOOST_CHECK(pwalletMain->HaveKey(keypool.vchPubKey.GetID()));
+}
+
+BOOST_AUTO_TEST_CASE(IsMineScriptPubKeyFilter)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CScript p2pkh = GetScriptForDestination(pubkey.GetID());
+    CScript p2wpkh = GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()));
+    CScript p2sh_p2wpkh = GetScriptForDestination(CScriptID(p2wpkh));
+
+    LOCK(pwalletMain->cs_wallet);
+    BOOST_CHECK_EQUAL(IsMineOutput(*pwalletMain, p2pkh), ISMINE_NO);
+    BOOST_CHECK_EQUAL(IsMineOutput(*pwalletMain, p2wpkh), ISMINE_NO);
+
+    BOOST_CHECK(pwalletMain->AddKeyPubKey(key, pubkey));
+    BOOST_CHECK_EQUAL(IsMineOutput(*pwalletMain, GetScriptForRawPubKey(pubkey)), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(IsMineOutput(*pwalletMain, p2pkh), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(IsMineOutput(*pwalletMain, p2wpkh), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(IsMineOutput(*pwalletMain, p2sh_p2wpkh), ISMINE_SPENDABLE);
+
+    // Redeem scripts are matched through P2SH, watch-only scripts directly
+    CKey other;
+    other.MakeNewKey(true);
+    CScript multisig = GetScriptForMultisig(1, {pubkey});
+    CScript p2sh_multisig = GetScriptForDestination(CScriptID(multisig));
+    BOOST_CHECK_EQUAL(IsMineOutput(*pwalletMain, p2sh_multisig), ISMINE_NO);
+    BOOST_CHECK(pwalletMain->AddCScript(multisig));
+    BOOST_CHECK_EQUAL(IsMineOutput(*pwalletMain, p2sh_multisig), ISMINE_SPENDABLE);
+
+    CScript watched = GetScriptForDestination(other.GetPubKey().GetID());
+    BOOST_CHECK_EQUAL(IsMineOutput(*pwalletMain, watched), ISMINE_NO);
+    BOOST_CHECK(pwalletMain->AddWatchOnly(watched, 0));
+    BOOST_CHECK_EQUAL(IsMineOutput(*pwalletMain, watched), ISMINE_WATCH_UNSOLVABLE);
+}
+
+// Recompute the balances with an uncached full scan over mapWallet, to
+// check the incrementally maintained ones against.
+static CWalletBalance GetBalancesFullScan(const CWallet& wallet)
+{
+    CWalletBalance balances;
+    LOCK2(cs_main, wallet.cs_wallet);
+    for (const auto& entry : wallet.mapWallet) {
+        const CWalletTx& wtx = entry.second;
+        if (wtx.IsTrusted()) {
+            balances.m_mine_trusted += wtx.GetAvailableCredit(false);
+            balances.m_watchonly_trusted += wtx.GetAvailableWatchOnlyCredit(false);
+        } else if (wtx.GetDepthInMainChain() == 0 && wtx.InMempool()) {
+            balances.m_mine_untrusted_pending += wtx.GetAvailableCredit(false);
+            balances.m_watchonly_untrusted_pending += wtx.GetAvailableWatchOnlyCredit(false);
+        }
+        balances.m_mine_immature += wtx.GetImmatureCredit(false);
+        balances.m_watchonly_immature += wtx.GetImmatureWatchOnlyCredit(false);
+    }
+    return balances;
+}
+
+static void CheckBalances(const CWallet& wallet)
+{
+    const CWalletBalance expected = GetBalancesFullScan(wallet);
+    const CWalletBalance balances = wallet.GetBalances();
+    BOOST_CHECK_EQUAL(balances.m_mine_trusted, expected.m_mine_trusted);
+    BOOST_CHECK_EQUAL(balances.m_mine_untrusted_pending, expected.m_mine_untrusted_pending);
+    BOOST_CHECK_EQUAL(balances.m_mine_immature, expected.m_mine_immature);
+    BOOST_CHECK_EQUAL(balances.m_watchonly_trusted, expected.m_watchonly_trusted);
+    BOOST_CHECK_EQUAL(balances.m_watchonly_untrusted_pending, expected.m_watchonly_untrusted_pending);
+    BOOST_CHECK_EQUAL(balances.m_watchonly_immature, expected.m_watchonly_immature);
+}
+
 class ListCoinsTestingSetup : public TestChain100Setup
 {
 public:
@@ -668,6 +1079,8 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
 
     // Check initial balance from one mature coinbase transaction.
     BOOST_CHECK_EQUAL(50 * COIN, wallet->GetAvailableBalance());
+    BOOST_CHECK_EQUAL(50 * COIN, wallet->GetBalance());
+    CheckBalances(*wallet);
 
     // Add a transaction creating a change address, and confirm ListCoins still
     // returns the coin associated with the change address underneath the
@@ -678,6 +1091,7 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.size(), 1);
     BOOST_CHECK_EQUAL(boost::get<CKeyID>(list.begin()->first).ToString(), coinbaseAddress);
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
+    CheckBalances(*wallet);
 
     // Lock both coins. Confirm number of available coins drops to 0.
     std::vector<COutput> available;
@@ -700,4 +1114,125 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+// Extend the active chain with a block index entry for a block holding vtx
+// and tell the wallet, as validation would. No block is stored.
+static void ConnectWalletBlock(CWallet& wallet, const std::vector<CTransactionRef>& vtx, const std::vector<CTransactionRef>& vtxConflicted = {})
+{
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+    block->vtx = vtx;
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        CBlockIndex* pprev = chainActive.Tip();
+        block->hashPrevBlock = pprev->GetBlockHash();
+        block->nTime = pprev->nTime + 1;
+        block->nNonce = InsecureRand32();
+        block->hashMerkleRoot = BlockMerkleRoot(*block);
+        auto inserted = mapBlockIndex.emplace(block->GetHash(), new CBlockIndex(*block));
+        assert(inserted.second);
+        pindex = inserted.first->second;
+        pindex->phashBlock = &inserted.first->first;
+        pindex->pprev = pprev;
+        pindex->nHeight = pprev->nHeight + 1;
+        pindex->BuildSkip();
+        chainActive.SetTip(pindex);
+    }
+    wallet.BlockConnected(block, pindex, vtxConflicted);
+}
+
+// Disconnect the tip, whose block held vtx
+static void DisconnectWalletBlock(CWallet& wallet, const std::vector<CTransactionRef>& vtx)
+{
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+    block->vtx = vtx;
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(chainActive.Tip()->pprev);
+    }
+    wallet.BlockDisconnected(block);
+}
+
+BOOST_AUTO_TEST_CASE(balances_follow_chain)
+{
+    CWallet wallet;
+    CKey key;
+    key.MakeNewKey(true);
+    AddKey(wallet, key);
+    const CScript scriptMine = GetScriptForRawPubKey(key.GetPubKey());
+    const CScript scriptOther = CScript() << OP_TRUE;
+    CheckBalances(wallet);
+
+    // A coinbase paying to the wallet is immature until it has
+    // COINBASE_MATURITY blocks on top of it
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.emplace_back(50 * COIN, scriptMine);
+    const CTransactionRef ptxCoinbase = MakeTransactionRef(std::move(coinbase));
+    ConnectWalletBlock(wallet, {ptxCoinbase});
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 50 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+    for (int i = 0; i < COINBASE_MATURITY; i++) {
+        ConnectWalletBlock(wallet, {});
+        CheckBalances(wallet);
+    }
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 0);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 50 * COIN);
+
+    // Disconnecting a block makes it immature again
+    DisconnectWalletBlock(wallet, {});
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 50 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+    ConnectWalletBlock(wallet, {});
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 50 * COIN);
+
+    // Spend it to ourselves in the mempool
+    CMutableTransaction spend;
+    spend.vin.emplace_back(COutPoint(ptxCoinbase->GetHash(), 0));
+    spend.vout.emplace_back(49 * COIN, scriptMine);
+    const CTransactionRef ptxSpend = MakeTransactionRef(std::move(spend));
+    wallet.TransactionAddedToMempool(ptxSpend);
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 49 * COIN);
+
+    // A double spend paying someone else confirms, so the first spend is
+    // conflicted
+    CMutableTransaction doubleSpend;
+    doubleSpend.vin.emplace_back(COutPoint(ptxCoinbase->GetHash(), 0));
+    doubleSpend.vout.emplace_back(48 * COIN, scriptOther);
+    const CTransactionRef ptxDoubleSpend = MakeTransactionRef(std::move(doubleSpend));
+    ConnectWalletBlock(wallet, {ptxDoubleSpend}, {ptxSpend});
+    CheckBalances(wallet);
+    {
+        LOCK2(cs_main, wallet.cs_wallet);
+        BOOST_CHECK(wallet.mapWallet.at(ptxSpend->GetHash()).GetDepthInMainChain() < 0);
+    }
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+
+    // Reorg: the double spend goes back to the mempool, and the first spend
+    // confirms instead, conflicting it
+    DisconnectWalletBlock(wallet, {ptxDoubleSpend});
+    wallet.TransactionAddedToMempool(ptxDoubleSpend);
+    CheckBalances(wallet);
+    ConnectWalletBlock(wallet, {ptxSpend}, {ptxDoubleSpend});
+    CheckBalances(wallet);
+    {
+        LOCK2(cs_main, wallet.cs_wallet);
+        BOOST_CHECK(wallet.mapWallet.at(ptxDoubleSpend->GetHash()).GetDepthInMainChain() < 0);
+    }
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 49 * COIN);
+
+    // Disconnecting that block leaves the spend unconfirmed and out of the
+    // mempool, so nothing is trusted until it is accepted again
+    DisconnectWalletBlock(wallet, {ptxSpend});
+    CheckBalances(wallet);
+    wallet.TransactionAddedToMempool(ptxSpend);
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 49 * COIN);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
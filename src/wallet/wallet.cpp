@@ -12,6 +12,7 @@
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
 #include <fs.h>
+#include <hash.h>
 #include <wallet/init.h>
 #include <key.h>
 #include <keystore.h>
@@ -21,9 +22,11 @@
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <primitives/block.h>
+#include <primitives/blockview.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
 #include <scheduler.h>
+#include <threadpool.h>
 #include <timedata.h>
 #include <txmempool.h>
 #include <util.h>
@@ -32,6 +35,7 @@
 
 #include <assert.h>
 #include <future>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -178,14 +182,12 @@ CPubKey CWallet::GenerateNewKey(CWalletDB &walletdb, bool internal)
     return pubkey;
 }
 
-void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal)
+void CWallet::DeriveChainKey(CExtKey& chainChildKey, bool internal)
 {
     // for now we use a fixed keypath scheme of m/0'/0'/k
     CKey key;                      //master key seed (256bit)
     CExtKey masterKey;             //hd master key
     CExtKey accountKey;            //key at m/0'
-    CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
-    CExtKey childKey;              //key at m/0'/0'/<n>'
 
     // try to get the master key
     if (!GetKey(hdChain.masterKeyID, key))
@@ -200,6 +202,14 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
     // derive m/0'/0' (external chain) OR m/0'/1' (internal chain)
     assert(internal ? CanSupportFeature(FEATURE_HD_SPLIT) : true);
     accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT+(internal ? 1 : 0));
+}
+
+void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal)
+{
+    CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
+    CExtKey childKey;              //key at m/0'/0'/<n>'
+
+    DeriveChainKey(chainChildKey, internal);
 
     // derive child key at next index, skip keys already known to the wallet
     do {
@@ -224,6 +234,85 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
         throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
 }
 
+void CWallet::GenerateNewKeys(CWalletDB& walletdb, bool internal, size_t nCount, std::vector<CPubKey>& vPubKeys)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    if (nCount == 0) {
+        return;
+    }
+    nCount += vPubKeys.size();
+    vPubKeys.reserve(nCount);
+    if (!IsHDEnabled()) {
+        while (vPubKeys.size() < nCount) {
+            vPubKeys.push_back(GenerateNewKey(walletdb, internal));
+        }
+        return;
+    }
+
+    // Same as GenerateNewKey() does per key, but the chain key is derived
+    // once and the child keys, their public keys and the consistency checks
+    // are computed in parallel. The keys are then added one by one.
+    internal = CanSupportFeature(FEATURE_HD_SPLIT) ? internal : false;
+    if (CanSupportFeature(FEATURE_COMPRPUBKEY)) {
+        SetMinVersion(FEATURE_COMPRPUBKEY);
+    }
+    CExtKey chainChildKey;
+    DeriveChainKey(chainChildKey, internal);
+    uint32_t& nCounter = internal ? hdChain.nInternalChainCounter : hdChain.nExternalChainCounter;
+    const int64_t nCreationTime = GetTime();
+    const int nThreads = std::max(1, std::min(GetNumCores(), MAX_KEYPOOL_THREADS));
+
+    while (vPubKeys.size() < nCount) {
+        // Keys already known to the wallet are skipped below and made up for
+        // by the next batch
+        const size_t nBatch = nCount - vPubKeys.size();
+        std::vector<CExtKey> vChildKeys(nBatch);
+        std::vector<CPubKey> vChildPubKeys(nBatch);
+        ParallelFor(nBatch, nThreads, [&](size_t i) {
+            // always derive hardened keys
+            chainChildKey.Derive(vChildKeys[i], (nCounter + i) | BIP32_HARDENED_KEY_LIMIT);
+            vChildPubKeys[i] = vChildKeys[i].key.GetPubKey();
+            assert(vChildKeys[i].key.VerifyPubKey(vChildPubKeys[i]));
+        });
+
+        for (size_t i = 0; i < nBatch; i++) {
+            CKeyMetadata metadata(nCreationTime);
+            metadata.hdKeypath = (internal ? "m/0'/1'/" : "m/0'/0'/") + std::to_string(nCounter) + "'";
+            metadata.hdMasterKeyID = hdChain.masterKeyID;
+            nCounter++;
+
+            const CPubKey& pubkey = vChildPubKeys[i];
+            if (HaveKey(pubkey.GetID())) {
+                continue;
+            }
+            mapKeyMetadata[pubkey.GetID()] = metadata;
+            vPubKeys.push_back(pubkey);
+            if (!AddKeyPubKeyWithDB(walletdb, vChildKeys[i].key, pubkey)) {
+                throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+            }
+        }
+    }
+    UpdateTimeFirstKey(nCreationTime);
+
+    // update the chain model in the database
+    if (!walletdb.WriteHDChain(hdChain))
+        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+}
+
+void CWallet::ForgetUncommittedKeys(const std::vector<CPubKey>& vPubKeys)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    LOCK(cs_KeyStore);
+    // The scripts learned for these keys stay; superfluous scripts never
+    // make anything IsMine on their own
+    for (const CPubKey& pubkey : vPubKeys) {
+        const CKeyID keyid = pubkey.GetID();
+        mapKeys.erase(keyid);
+        mapCryptedKeys.erase(keyid);
+        mapKeyMetadata.erase(keyid);
+    }
+}
+
 bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const CPubKey &pubkey)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
@@ -240,6 +329,7 @@ bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const
         return false;
     }
     if (needsDB) pwalletdbEncryption = nullptr;
+    LearnScriptPubKeysForKey(pubkey);
 
     // check if we need to remove from watch-only
     CScript script;
@@ -271,6 +361,7 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
 {
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
         return false;
+    LearnScriptPubKeysForKey(vchPubKey);
     {
         LOCK(cs_wallet);
         if (pwalletdbEncryption)
@@ -300,9 +391,20 @@ bool CWallet::LoadScriptMetadata(const CScriptID& script_id, const CKeyMetadata
     return true;
 }
 
+bool CWallet::LoadKey(const CKey& key, const CPubKey &pubkey)
+{
+    if (!CCryptoKeyStore::AddKeyPubKey(key, pubkey))
+        return false;
+    LearnScriptPubKeysForKey(pubkey);
+    return true;
+}
+
 bool CWallet::LoadCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret)
 {
-    return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret);
+    if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
+        return false;
+    LearnScriptPubKeysForKey(vchPubKey);
+    return true;
 }
 
 /**
@@ -325,6 +427,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    LearnScriptPubKeysForScript(redeemScript);
     return CWalletDB(*dbw).WriteCScript(Hash160(redeemScript), redeemScript);
 }
 
@@ -341,13 +444,17 @@ bool CWallet::LoadCScript(const CScript& redeemScript)
         return true;
     }
 
-    return CCryptoKeyStore::AddCScript(redeemScript);
+    if (!CCryptoKeyStore::AddCScript(redeemScript))
+        return false;
+    LearnScriptPubKeysForScript(redeemScript);
+    return true;
 }
 
 bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    LearnScriptPubKeysForScript(dest);
     const CKeyMetadata& meta = m_script_metadata[CScriptID(dest)];
     UpdateTimeFirstKey(meta.nCreateTime);
     NotifyWatchonlyChanged(true);
@@ -375,7 +482,80 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
 
 bool CWallet::LoadWatchOnly(const CScript &dest)
 {
-    return CCryptoKeyStore::AddWatchOnly(dest);
+    if (!CCryptoKeyStore::AddWatchOnly(dest))
+        return false;
+    LearnScriptPubKeysForScript(dest);
+    return true;
+}
+
+uint64_t CWallet::GetScriptPubKeyHash(const unsigned char* pbegin, const unsigned char* pend) const
+{
+    return CSipHasher(m_script_pub_key_k0, m_script_pub_key_k1).Write(pbegin, pend - pbegin).Finalize();
+}
+
+void CWallet::LearnScriptPubKey(const CScript& script)
+{
+    LOCK(cs_KeyStore);
+    m_script_pub_key_hashes.insert(GetScriptPubKeyHash(script.data(), script.data() + script.size()));
+}
+
+void CWallet::LearnScriptPubKeysForKey(const CPubKey& pubkey)
+{
+    // P2PK and P2PKH match on HaveKey; the P2WPKH script is learned
+    // implicitly by the keystore for compressed keys, which also makes
+    // bare P2WPKH and P2SH-P2WPKH outputs match.
+    LearnScriptPubKey(GetScriptForRawPubKey(pubkey));
+    LearnScriptPubKey(GetScriptForDestination(pubkey.GetID()));
+    if (pubkey.IsCompressed()) {
+        LearnScriptPubKeysForScript(GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID())));
+    }
+}
+
+void CWallet::LearnScriptPubKeysForScript(const CScript& script)
+{
+    // The script itself covers watch-only entries and bare witness programs
+    // (which are only mine when the program is a known script), P2SH covers
+    // known redeem scripts.
+    LearnScriptPubKey(script);
+    LearnScriptPubKey(GetScriptForDestination(CScriptID(script)));
+
+    // Watch-only P2PK scripts make the keystore learn the key's scripts too
+    std::vector<std::vector<unsigned char>> vSolutions;
+    txnouttype whichType;
+    if (Solver(script, whichType, vSolutions) && whichType == TX_PUBKEY) {
+        CPubKey pubkey(vSolutions[0]);
+        LearnScriptPubKey(GetScriptForDestination(pubkey.GetID()));
+        if (pubkey.IsCompressed()) {
+            CScript witprog = GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()));
+            LearnScriptPubKey(witprog);
+            LearnScriptPubKey(GetScriptForDestination(CScriptID(witprog)));
+        }
+    }
+}
+
+/**
+ * Cheap pre-check for IsMine: for the standard P2PK, P2PKH, P2SH, P2WPKH
+ * and P2WSH templates every script IsMine can match has been learned, so
+ * a miss means the output is not ours. Other scripts always need the
+ * full check.
+ */
+bool CWallet::MayBeMine(const unsigned char* pbegin, const unsigned char* pend) const
+{
+    const unsigned char* script = pbegin;
+    const size_t size = pend - pbegin;
+    // The same templates as IsPayToScriptHash and IsPayToWitnessScriptHash,
+    // then P2PKH, P2WPKH and P2PK
+    const bool fIndexed =
+        (size == 23 && script[0] == OP_HASH160 && script[1] == 20 && script[22] == OP_EQUAL) ||
+        (size == 34 && script[0] == OP_0 && script[1] == 32) ||
+        (size == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+            script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) ||
+        (size == 22 && script[0] == OP_0 && script[1] == 20) ||
+        (((size == 35 && script[0] == 33) || (size == 67 && script[0] == 65)) && script[size - 1] == OP_CHECKSIG);
+    if (!fIndexed)
+        return true;
+    LOCK(cs_KeyStore);
+    return m_script_pub_key_hashes.count(GetScriptPubKeyHash(pbegin, pend)) > 0;
 }
 
 bool CWallet::Unlock(const SecureString& strWalletPassphrase)
@@ -446,6 +626,10 @@ bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase,
 
 void CWallet::SetBestChain(const CBlockLocator& loc)
 {
+    if (m_rescan_required) {
+        // Keep the last locator whose transactions are all on disk
+        return;
+    }
     CWalletDB walletdb(*dbw);
     walletdb.WriteBestBlock(loc);
 }
@@ -911,8 +1095,13 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     // Inserts only if not already there, returns tx inserted or tx found
     std::pair<std::map<uint256, CWalletTx>::iterator, bool> ret = mapWallet.insert(std::make_pair(hash, wtxIn));
     CWalletTx& wtx = (*ret.first).second;
-    wtx.BindWallet(this);
     bool fInsertedNew = ret.second;
+    if (fInsertedNew) {
+        wtx.m_balance_contribution = CWalletBalance();
+        wtx.m_balance_depth = 0;
+        wtx.m_index_height = -1;
+    }
+    wtx.BindWallet(this);
     if (fInsertedNew) {
         wtx.nTimeReceived = GetAdjustedTime();
         wtx.nOrderPos = IncOrderPosNext(&walletdb);
@@ -988,6 +1177,11 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     uint256 hash = wtxIn.GetHash();
     const auto& ins = mapWallet.emplace(hash, wtxIn);
     CWalletTx& wtx = ins.first->second;
+    if (/* insertion took place */ ins.second) {
+        wtx.m_balance_contribution = CWalletBalance();
+        wtx.m_balance_depth = 0;
+        wtx.m_index_height = -1;
+    }
     wtx.BindWallet(this);
     if (/* insertion took place */ ins.second) {
         wtx.m_it_wtxOrdered = wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
@@ -1239,11 +1433,23 @@ void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx) {
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
         it->second.fInMempool = false;
+        MarkBalanceDirty(it->first);
+    }
+}
+
+void CWallet::GroupCommitFailed(const char* context)
+{
+    LogPrintf("%s: wallet writes were not stored, the wallet will be rescanned at the next start\n", context);
+    if (!m_rescan_required.exchange(true)) {
+        uiInterface.ThreadSafeMessageBox(
+            _("Error writing to the wallet database. Restart to rescan the blocks since the last successful write."),
+            "", CClientUIInterface::MSG_ERROR);
     }
 }
 
 void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) {
     LOCK2(cs_main, cs_wallet);
+    CWalletDBGroupCommit group_commit(*dbw);
     // TODO: Temporarily ensure that mempool removals are notified before
     // connected transactions.  This shouldn't matter, but the abandoned
     // state of transactions in our wallet is currently cleared when we
@@ -1260,16 +1466,23 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
         SyncTransaction(pblock->vtx[i], pindex, i);
         TransactionRemovedFromMempool(pblock->vtx[i]);
     }
+    if (!group_commit.Commit()) {
+        GroupCommitFailed(__func__);
+    }
 
     m_last_block_processed = pindex;
 }
 
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
     LOCK2(cs_main, cs_wallet);
+    CWalletDBGroupCommit group_commit(*dbw);
 
     for (const CTransactionRef& ptx : pblock->vtx) {
         SyncTransaction(ptx);
     }
+    if (!group_commit.Commit()) {
+        GroupCommitFailed(__func__);
+    }
 }
 
 
@@ -1334,6 +1547,8 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
 
 isminetype CWallet::IsMine(const CTxOut& txout) const
 {
+    if (!MayBeMine(txout.scriptPubKey))
+        return ISMINE_NO;
     return ::IsMine(*this, txout.scriptPubKey);
 }
 
@@ -1564,6 +1779,62 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
 
 }
 
+bool CWallet::BeginImportSession()
+{
+    LOCK(cs_wallet);
+    if (m_import_session)
+        return false;
+    m_import_session = true;
+    m_import_session_start = GetTime();
+    m_import_rescan_time = std::numeric_limits<int64_t>::max();
+    return true;
+}
+
+bool CWallet::IsImportSessionOpen() const
+{
+    LOCK(cs_wallet);
+    return m_import_session;
+}
+
+bool CWallet::DeferImportRescan(int64_t startTime)
+{
+    LOCK(cs_wallet);
+    if (!m_import_session)
+        return false;
+    m_import_rescan_time = std::min(m_import_rescan_time, startTime);
+    return true;
+}
+
+bool CWallet::EndImportSession(int64_t& startTimeRet)
+{
+    LOCK(cs_wallet);
+    if (!m_import_session)
+        return false;
+    m_import_session = false;
+    startTimeRet = m_import_rescan_time;
+    return true;
+}
+
+bool CWallet::AbortImportSession()
+{
+    int64_t nStartTime;
+    if (!EndImportSession(nStartTime))
+        return false;
+    if (nStartTime != std::numeric_limits<int64_t>::max())
+        LogPrintf("%s: import session aborted, the rescan from time %d it deferred was not done\n", __func__, nStartTime);
+    return true;
+}
+
+bool CWallet::GetImportSession(int64_t& startedRet, int64_t& rescanTimeRet) const
+{
+    LOCK(cs_wallet);
+    if (!m_import_session)
+        return false;
+    startedRet = m_import_session_start;
+    rescanTimeRet = m_import_rescan_time;
+    return true;
+}
+
 /**
  * Scan active chain for relevant transactions after importing keys. This should
  * be called whenever new keys are added to the wallet, with the oldest key
@@ -1593,6 +1864,83 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+namespace {
+/**
+ * Conservative pre-filter used by the rescan workers to find transactions
+ * that may involve the wallet without holding cs_wallet. A transaction
+ * passes if it is already known to the wallet, spends an outpoint the
+ * wallet has seen spent (conflicts) or spends an output of a wallet
+ * transaction. Outputs are checked against the keystore separately.
+ */
+struct RescanFilter
+{
+    std::unordered_set<uint256, SaltedTxidHasher> txids;
+    std::unordered_set<COutPoint, SaltedOutpointHasher> spent;
+
+    void Add(const CTransaction& tx)
+    {
+        txids.insert(tx.GetHash());
+        if (tx.IsCoinBase())
+            return;
+        for (const CTxIn& txin : tx.vin)
+            spent.insert(txin.prevout);
+    }
+
+    bool SpendsFromWallet(const CTxView& tx) const
+    {
+        if (tx.IsCoinBase())
+            return false;
+        for (const CTxInView& txin : tx.Inputs()) {
+            const COutPoint prevout = txin.GetPrevout();
+            if (txids.count(prevout.hash) || spent.count(prevout))
+                return true;
+        }
+        return false;
+    }
+};
+
+/**
+ * A block read ahead by a rescan worker, with the transactions that passed
+ * the filter. Blocks are only walked through a CBlockView; just the
+ * transactions that may involve the wallet get deserialized.
+ */
+struct RescanBlock
+{
+    CBlockIndex* pindex;
+    std::vector<unsigned char> vData;
+    std::unique_ptr<const CBlockView> view; // null if the block could not be read
+    std::vector<bool> vCandidate;
+};
+
+void FilterRescanBlock(const CWallet& wallet, const RescanFilter& filter, RescanBlock& block, const Consensus::Params& params)
+{
+    if (!ReadRawBlockFromDisk(block.vData, block.pindex, params))
+        return;
+    std::unique_ptr<const CBlockView> view;
+    try {
+        view.reset(new CBlockView(block.vData));
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Deserialize error - %s at height %d\n", __func__, e.what(), block.pindex->nHeight);
+        return;
+    }
+    const std::vector<CTxView>& vtx = view->Transactions();
+    block.vCandidate.resize(vtx.size());
+    for (size_t posInBlock = 0; posInBlock < vtx.size(); ++posInBlock) {
+        const CTxView& tx = vtx[posInBlock];
+        bool fCandidate = filter.txids.count(tx.GetHash()) || filter.SpendsFromWallet(tx);
+        // IsMine only touches the keystore, which has its own lock. Only
+        // outputs that pass the pre-check are copied out for the full check.
+        for (auto it = tx.Outputs().begin(); !fCandidate && it != tx.Outputs().end(); ++it) {
+            const CScriptView script = it->GetScriptPubKey();
+            fCandidate = wallet.MayBeMine(script.begin(), script.end()) &&
+                ::IsMine(wallet, script.ToScript()) != ISMINE_NO;
+        }
+        block.vCandidate[posInBlock] = fCandidate;
+    }
+    block.view = std::move(view);
+}
+} // namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1608,6 +1956,10 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
  * Caller needs to make sure pindexStop (and the optional pindexStart) are on
  * the main chain after to the addition of any new keys you want to detect
  * transactions for.
+ *
+ * Blocks are processed in batches of RESCAN_BATCH_SIZE: -rescanthreads
+ * workers read each batch from disk and filter it without cs_wallet, then
+ * the candidate transactions are added to the wallet in block order.
  */
 CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver &reserver, bool fUpdate)
 {
@@ -1619,6 +1971,20 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
         assert(pindexStop->nHeight >= pindexStart->nHeight);
     }
 
+    int nThreads = gArgs.GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads += GetNumCores();
+    nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+
+    RescanFilter filter;
+    {
+        LOCK(cs_wallet);
+        for (const auto& entry : mapWallet)
+            filter.txids.insert(entry.first);
+        for (const auto& entry : mapTxSpends)
+            filter.spent.insert(entry.first);
+    }
+
     CBlockIndex* pindex = pindexStart;
     CBlockIndex* ret = nullptr;
     {
@@ -1633,9 +1999,10 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
             dProgressTip = GuessVerificationProgress(chainParams.TxData(), tip);
         }
+        std::vector<RescanBlock> vBatch;
         while (pindex && !fAbortRescan)
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
+            if (dProgressTip - dProgressStart > 0.0) {
                 double gvp = 0;
                 {
                     LOCK(cs_main);
@@ -1649,22 +2016,74 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            vBatch.clear();
+            {
+                LOCK(cs_main);
+                for (CBlockIndex* pnext = pindex; pnext && vBatch.size() < RESCAN_BATCH_SIZE; pnext = chainActive.Next(pnext)) {
+                    vBatch.push_back(RescanBlock{pnext, {}, nullptr, {}});
+                    if (pnext == pindexStop)
+                        break;
+                }
+            }
+
+            // Read and filter the batch in parallel
+            ParallelFor(vBatch.size(), nThreads, [&](size_t i) {
+                if (!fAbortRescan)
+                    FilterRescanBlock(*this, filter, vBatch[i], chainParams.GetConsensus());
+            });
+            if (fAbortRescan)
+                break;
+
+            bool fReorged = false;
+            {
                 LOCK2(cs_main, cs_wallet);
-                if (pindex && !chainActive.Contains(pindex)) {
-                    // Abort scan if current block is no longer active, to prevent
-                    // marking transactions as coming from the wrong block.
-                    ret = pindex;
-                    break;
+                CWalletDBGroupCommit group_commit(*dbw);
+                // Transactions may have been added to the wallet since the
+                // filter was built (e.g. from newly connected blocks); pick
+                // them up and recheck inputs against them.
+                bool fRecheckInputs = false;
+                if (filter.txids.size() != mapWallet.size()) {
+                    for (const auto& entry : mapWallet)
+                        filter.Add(*entry.second.tx);
+                    fRecheckInputs = true;
                 }
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+                // A keypool top-up may add keys that later outputs pay to
+                bool fRecheckAll = false;
+                const size_t nKeys = mapKeyMetadata.size();
+                for (const RescanBlock& block : vBatch) {
+                    pindex = block.pindex;
+                    if (!block.view) {
+                        ret = pindex;
+                        continue;
+                    }
+                    if (!chainActive.Contains(pindex)) {
+                        // Abort scan if current block is no longer active, to prevent
+                        // marking transactions as coming from the wrong block.
+                        ret = pindex;
+                        fReorged = true;
+                        break;
+                    }
+                    const std::vector<CTxView>& vtx = block.view->Transactions();
+                    for (size_t posInBlock = 0; posInBlock < vtx.size(); ++posInBlock) {
+                        if (!fRecheckAll && !block.vCandidate[posInBlock] && !(fRecheckInputs && filter.SpendsFromWallet(vtx[posInBlock])))
+                            continue;
+                        const bool fKnown = filter.txids.count(vtx[posInBlock].GetHash()) > 0;
+                        const CTransactionRef ptx = vtx[posInBlock].ToTransaction();
+                        if (AddToWalletIfInvolvingMe(ptx, pindex, posInBlock, fUpdate) && !fKnown) {
+                            // Later transactions in this batch may spend from or conflict with this one
+                            filter.Add(*ptx);
+                            fRecheckInputs = true;
+                        }
+                        if (mapKeyMetadata.size() != nKeys)
+                            fRecheckAll = true;
+                    }
+                }
+                if (!group_commit.Commit()) {
+                    GroupCommitFailed(__func__);
+                    ret = pindex;
                 }
-            } else {
-                ret = pindex;
             }
-            if (pindex == pindexStop) {
+            if (fReorged || pindex == pindexStop) {
                 break;
             }
             {
@@ -1900,6 +2319,21 @@ CAmount CWalletTx::GetAvailableWatchOnlyCredit(const bool fUseCache) const
     return nCredit;
 }
 
+void CWalletTx::MarkDirty() const
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+    if (pwallet)
+        pwallet->MarkBalanceDirty(GetHash());
+}
+
 CAmount CWalletTx::GetChange() const
 {
     if (fChangeCached)
@@ -2013,94 +2447,185 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance() const
+void CWallet::MarkBalanceDirty(const uint256& hash) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+    LOCK(cs_wallet);
+    m_balance_dirty.insert(hash);
+}
+
+/**
+ * Recompute a transaction's contribution to the wallet balances, using the
+ * same rules as a full scan over mapWallet would, and file it under the set
+ * that decides when it needs to be looked at again.
+ */
+void CWallet::UpdateBalanceContribution(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    const int nDepth = wtx.GetDepthInMainChain();
+    CWalletBalance contribution;
+    if (wtx.IsTrusted()) {
+        contribution.m_mine_trusted = wtx.GetAvailableCredit();
+        contribution.m_watchonly_trusted = wtx.GetAvailableWatchOnlyCredit();
+    } else if (nDepth == 0 && wtx.InMempool()) {
+        contribution.m_mine_untrusted_pending = wtx.GetAvailableCredit();
+        contribution.m_watchonly_untrusted_pending = wtx.GetAvailableWatchOnlyCredit();
+    }
+    contribution.m_mine_immature = wtx.GetImmatureCredit();
+    contribution.m_watchonly_immature = wtx.GetImmatureWatchOnlyCredit();
+
+    m_balance -= wtx.m_balance_contribution;
+    m_balance += contribution;
+    wtx.m_balance_contribution = contribution;
+
+    // A transaction entering or leaving the conflicted state (e.g. when the
+    // conflicting block is disconnected) changes whether the outputs it
+    // spends are available.
+    if ((nDepth < 0) != (wtx.m_balance_depth < 0) && !wtx.IsCoinBase()) {
+        for (const CTxIn& txin : wtx.tx->vin) {
+            auto it = mapWallet.find(txin.prevout.hash);
+            if (it != mapWallet.end())
+                it->second.MarkDirty();
         }
     }
+    wtx.m_balance_depth = nDepth;
 
-    return nTotal;
+    const uint256& hash = wtx.GetHash();
+    if (nDepth == 0) {
+        m_balance_pending.insert(hash);
+        m_balance_unsettled.erase(hash);
+    } else if (nDepth < 0 || wtx.GetBlocksToMaturity() > 0) {
+        m_balance_pending.erase(hash);
+        m_balance_unsettled.insert(hash);
+    } else {
+        m_balance_pending.erase(hash);
+        m_balance_unsettled.erase(hash);
+    }
 }
 
-CAmount CWallet::GetUnconfirmedBalance() const
+void CWallet::UpdateUnspentOutputs(const CWalletTx& wtx) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) != ISMINE_NO && !IsSpent(hash, i)) {
+            m_unspent_outputs.emplace(hash, i);
+        } else {
+            m_unspent_outputs.erase(COutPoint(hash, i));
         }
     }
-    return nTotal;
 }
 
-CAmount CWallet::GetImmatureBalance() const
+void CWallet::UpdateHeightIndex(const CWalletTx& wtx) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureCredit();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    const CBlockIndex* pindex = nullptr;
+    const int nHeight = wtx.GetDepthInMainChain(pindex) > 0 ? pindex->nHeight : -1;
+    m_txs_by_height.erase(std::make_pair(wtx.m_index_height, wtx.GetHash()));
+    m_txs_by_height.emplace(nHeight, wtx.GetHash());
+    wtx.m_index_height = nHeight;
+}
+
+void CWallet::SyncDirtyTransactions() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    while (!m_balance_dirty.empty()) {
+        const uint256 hash = *m_balance_dirty.begin();
+        m_balance_dirty.erase(m_balance_dirty.begin());
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            UpdateBalanceContribution(it->second);
+            UpdateUnspentOutputs(it->second);
+            UpdateHeightIndex(it->second);
         }
     }
-    return nTotal;
 }
 
-CAmount CWallet::GetWatchOnlyBalance() const
+void CWallet::RemoveCachedTxState(const CWalletTx& wtx)
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
+    AssertLockHeld(cs_wallet);
+    const uint256& hash = wtx.GetHash();
+    m_balance -= wtx.m_balance_contribution;
+    wtx.m_balance_contribution = CWalletBalance();
+    m_balance_dirty.erase(hash);
+    m_balance_pending.erase(hash);
+    m_balance_unsettled.erase(hash);
+    m_txs_by_height.erase(std::make_pair(wtx.m_index_height, hash));
+    m_unspent_outputs.erase(m_unspent_outputs.lower_bound(COutPoint(hash, 0)),
+                            m_unspent_outputs.upper_bound(COutPoint(hash, std::numeric_limits<uint32_t>::max())));
+}
+
+CWalletBalance CWallet::GetBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+    if (m_balance_tip != chainActive.Tip()) {
+        // A shorter chain lowers the depth of every block still in it, so
+        // coinbases that matured near the old tip can be immature again
+        if (m_balance_tip && chainActive.Height() < m_balance_tip->nHeight) {
+            auto it = m_txs_by_height.lower_bound(std::make_pair(chainActive.Height() - COINBASE_MATURITY, uint256()));
+            for (; it != m_txs_by_height.end(); ++it)
+                m_balance_dirty.insert(it->second);
         }
+        m_balance_tip = chainActive.Tip();
+        m_balance_dirty.insert(m_balance_unsettled.begin(), m_balance_unsettled.end());
     }
+    m_balance_dirty.insert(m_balance_pending.begin(), m_balance_pending.end());
+    SyncDirtyTransactions();
+    return m_balance;
+}
 
-    return nTotal;
+std::vector<const CWalletTx*> CWallet::GetTransactionsAboveHeight(int nHeight) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    SyncDirtyTransactions();
+
+    std::vector<const CWalletTx*> result;
+    const auto confirmed = m_txs_by_height.lower_bound(std::make_pair(0, uint256()));
+    for (auto it = m_txs_by_height.lower_bound(std::make_pair(std::max(nHeight + 1, 0), uint256())); it != m_txs_by_height.end(); ++it) {
+        result.push_back(&mapWallet.at(it->second));
+    }
+    for (auto it = m_txs_by_height.begin(); it != confirmed; ++it) {
+        result.push_back(&mapWallet.at(it->second));
+    }
+    return result;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().m_mine_trusted;
+}
+
+CAmount CWallet::GetUnconfirmedBalance() const
+{
+    return GetBalances().m_mine_untrusted_pending;
+}
+
+CAmount CWallet::GetImmatureBalance() const
+{
+    return GetBalances().m_mine_immature;
+}
+
+CAmount CWallet::GetWatchOnlyBalance() const
+{
+    return GetBalances().m_watchonly_trusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().m_watchonly_untrusted_pending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().m_watchonly_immature;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2167,13 +2692,24 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
 
     {
         LOCK2(cs_main, cs_wallet);
+        SyncDirtyTransactions();
 
         CAmount nTotal = 0;
 
-        for (const auto& entry : mapWallet)
+        auto it = m_unspent_outputs.begin();
+        while (it != m_unspent_outputs.end())
         {
-            const uint256& wtxid = entry.first;
-            const CWalletTx* pcoin = &entry.second;
+            // Visit each transaction's indexed outputs together
+            const uint256 wtxid = it->hash;
+            auto itOutputsBegin = it;
+            while (it != m_unspent_outputs.end() && it->hash == wtxid)
+                ++it;
+            auto itOutputsEnd = it;
+
+            auto itWallet = mapWallet.find(wtxid);
+            if (itWallet == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &itWallet->second;
 
             if (!CheckFinalTx(*pcoin->tx))
                 continue;
@@ -2230,16 +2766,19 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
             if (nDepth < nMinDepth || nDepth > nMaxDepth)
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
+            for (auto itOutput = itOutputsBegin; itOutput != itOutputsEnd; ++itOutput) {
+                const unsigned int i = itOutput->n;
                 if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
                     continue;
 
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
+                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(*itOutput))
                     continue;
 
-                if (IsLockedCoin(entry.first, i))
+                if (IsLockedCoin(wtxid, i))
                     continue;
 
+                // Spends the index was not told about (e.g. a conflicted
+                // spender that a reorg revived) are still caught here
                 if (IsSpent(wtxid, i))
                     continue;
 
@@ -2335,6 +2874,9 @@ const CTxOut& CWallet::FindNonChangeParentOutput(const CTransaction& tx, int out
     return ptx->vout[n];
 }
 
+//! Upper bound on the steps of the branch and bound coin selection search
+static const size_t BNB_MAX_TRIES = 100000;
+
 static void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
                                   std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
 {
@@ -2381,8 +2923,86 @@ static void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const C
     }
 }
 
+/**
+ * Depth first branch and bound search for a subset of vValue (sorted by
+ * descending value) worth at least nTargetValue and less than
+ * nTargetValue + nMaxExcess, preferring the smallest excess and then the
+ * fewest inputs. Branches that can no longer reach the target or already
+ * do no better than the best set found are cut, and the search gives up
+ * after BNB_MAX_TRIES steps.
+ */
+static bool SelectCoinsBnB(const std::vector<CInputCoin>& vValue, const CAmount& nTargetValue, const CAmount& nMaxExcess,
+                           std::vector<char>& vfBest, CAmount& nBest)
+{
+    CAmount nAvailable = 0;
+    for (const CInputCoin& coin : vValue)
+        nAvailable += coin.txout.nValue;
+    if (nAvailable < nTargetValue)
+        return false;
+
+    std::vector<char> vfSelected;
+    vfSelected.reserve(vValue.size());
+    CAmount nSelected = 0;
+    size_t nSelectedInputs = 0;
+    // A set with exactly nMaxExcess excess is outside the window, so it must
+    // not count as a tie with this starting bound
+    CAmount nBestExcess = nMaxExcess;
+    size_t nBestInputs = 0;
+    vfBest.clear();
+
+    for (size_t nTries = 0; nTries < BNB_MAX_TRIES; nTries++) {
+        bool fBacktrack = false;
+        const CAmount nExcess = nSelected - nTargetValue;
+        if (nSelected + nAvailable < nTargetValue || nExcess > nBestExcess ||
+            (nExcess == nBestExcess && nSelectedInputs >= nBestInputs)) {
+            // Cannot reach the target any more, or no better than what we have
+            fBacktrack = true;
+        } else if (nSelected >= nTargetValue) {
+            nBestExcess = nExcess;
+            nBestInputs = nSelectedInputs;
+            vfBest = vfSelected;
+            vfBest.resize(vValue.size(), false);
+            // Coins are tried largest first, so the first exact match found
+            // is unlikely to be beaten on input count
+            if (nBestExcess == 0)
+                break;
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Undo trailing omissions, then omit the last included coin
+            while (!vfSelected.empty() && !vfSelected.back()) {
+                vfSelected.pop_back();
+                nAvailable += vValue[vfSelected.size()].txout.nValue;
+            }
+            if (vfSelected.empty())
+                break; // Search space exhausted
+            vfSelected.back() = false;
+            nSelected -= vValue[vfSelected.size() - 1].txout.nValue;
+            nSelectedInputs--;
+        } else {
+            const CInputCoin& coin = vValue[vfSelected.size()];
+            nAvailable -= coin.txout.nValue;
+            // Including a coin worth the same as one just omitted would only
+            // revisit an equivalent branch
+            if (!vfSelected.empty() && !vfSelected.back() && coin.txout.nValue == vValue[vfSelected.size() - 1].txout.nValue) {
+                vfSelected.push_back(false);
+            } else {
+                vfSelected.push_back(true);
+                nSelected += coin.txout.nValue;
+                nSelectedInputs++;
+            }
+        }
+    }
+
+    if (vfBest.empty())
+        return false;
+    nBest = nTargetValue + nBestExcess;
+    return true;
+}
+
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
-                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
+                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CAmount& nMaxExcess) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
@@ -2447,12 +3067,34 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
     std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
     std::reverse(vValue.begin(), vValue.end());
     std::vector<char> vfBest;
     CAmount nBest;
 
+    // Prefer an input set that leaves no change. The larger coin is not part
+    // of the search; when it also fits the window it wins ties, as a single
+    // input is the cheapest set.
+    const bool fBnB = nMaxExcess > 0 && SelectCoinsBnB(vValue, nTargetValue, nMaxExcess, vfBest, nBest);
+    if (coinLowestLarger && coinLowestLarger->txout.nValue - nTargetValue < nMaxExcess &&
+        (!fBnB || coinLowestLarger->txout.nValue <= nBest)) {
+        setCoinsRet.insert(coinLowestLarger.get());
+        nValueRet += coinLowestLarger->txout.nValue;
+        LogPrint(BCLog::SELECTCOINS, "SelectCoins() branch and bound: larger coin, total %s\n", FormatMoney(nValueRet));
+        return true;
+    }
+    if (fBnB) {
+        for (unsigned int i = 0; i < vValue.size(); i++) {
+            if (vfBest[i]) {
+                setCoinsRet.insert(vValue[i]);
+                nValueRet += vValue[i].txout.nValue;
+            }
+        }
+        LogPrint(BCLog::SELECTCOINS, "SelectCoins() branch and bound: %d inputs, total %s\n", setCoinsRet.size(), FormatMoney(nValueRet));
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
     ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
         ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
@@ -2487,7 +3129,7 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
     return true;
 }
 
-bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl) const
+bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, const CAmount& nMaxExcess) const
 {
     std::vector<COutput> vCoins(vAvailableCoins);
 
@@ -2539,13 +3181,13 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
     bool fRejectLongChains = gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
     bool res = nTargetValue <= nValueFromPresetInputs ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet) ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet));
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, nMaxExcess) ||
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, nMaxExcess) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, nMaxExcess)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet, nMaxExcess)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet, nMaxExcess)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet, nMaxExcess)) ||
+        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet, nMaxExcess));
 
     // because SelectCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
     setCoinsRet.insert(setPresetCoins.begin(), setPresetCoins.end());
@@ -2818,7 +3460,9 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                 if (pick_new_inputs) {
                     nValueIn = 0;
                     setCoins.clear();
-                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control))
+                    // Any excess below the change dust threshold goes to the fee
+                    // instead of a change output
+                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control, GetDustThreshold(change_prototype_txout, discard_rate)))
                     {
                         strFailReason = _("Insufficient funds");
                         return false;
@@ -3128,6 +3772,7 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
     for (uint256 hash : vHashOut) {
         const auto& it = mapWallet.find(hash);
         wtxOrdered.erase(it->second.m_it_wtxOrdered);
+        RemoveCachedTxState(it->second);
         mapWallet.erase(it);
     }
 
@@ -3310,28 +3955,52 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             // don't create extra internal keys
             missingInternal = 0;
         }
-        bool internal = false;
-        CWalletDB walletdb(*dbw);
-        for (int64_t i = missingInternal + missingExternal; i--;)
-        {
-            if (i < missingInternal) {
-                internal = true;
-            }
-
-            assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
-            int64_t index = ++m_max_keypool_index;
-
-            CPubKey pubkey(GenerateNewKey(walletdb, internal));
-            if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
-                throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
-            }
+        // Keys are written in transactions of at most KEYPOOL_COMMIT_BATCH_SIZE
+        // keys, so that a large top-up stays within the database's lock limits
+        for (bool internal : {false, true}) {
+            int64_t missing = internal ? missingInternal : missingExternal;
+            while (missing > 0) {
+                const int64_t nBatch = std::min(missing, (int64_t) KEYPOOL_COMMIT_BATCH_SIZE);
+                std::set<int64_t>& setKeyPool = internal ? setInternalKeyPool : setExternalKeyPool;
+                std::vector<CPubKey> vGenerated;
+                std::vector<std::pair<int64_t, CKeyID>> vAdded;
+                const CHDChain hdChainSaved = hdChain;
+                const int64_t nMaxKeypoolIndexSaved = m_max_keypool_index;
+                const int64_t nTimeFirstKeySaved = nTimeFirstKey;
+                try {
+                    CWalletDBGroupCommit group_commit(*dbw);
+                    CWalletDB walletdb(*dbw);
+                    GenerateNewKeys(walletdb, internal, nBatch, vGenerated);
+                    for (const CPubKey& pubkey : vGenerated) {
+                        assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
+                        int64_t index = ++m_max_keypool_index;
+
+                        if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
+                            throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
+                        }
 
-            if (internal) {
-                setInternalKeyPool.insert(index);
-            } else {
-                setExternalKeyPool.insert(index);
+                        setKeyPool.insert(index);
+                        m_pool_key_to_index[pubkey.GetID()] = index;
+                        vAdded.emplace_back(index, pubkey.GetID());
+                    }
+                    if (!group_commit.Commit()) {
+                        throw std::runtime_error(std::string(__func__) + ": committing generated keys failed");
+                    }
+                } catch (...) {
+                    // The batch was not written, so put the in-memory state
+                    // back to what the database holds
+                    for (const auto& added : vAdded) {
+                        setKeyPool.erase(added.first);
+                        m_pool_key_to_index.erase(added.second);
+                    }
+                    ForgetUncommittedKeys(vGenerated);
+                    hdChain = hdChainSaved;
+                    m_max_keypool_index = nMaxKeypoolIndexSaved;
+                    nTimeFirstKey = nTimeFirstKeySaved;
+                    throw;
+                }
+                missing -= nBatch;
             }
-            m_pool_key_to_index[pubkey.GetID()] = index;
         }
         if (missingInternal + missingExternal > 0) {
             LogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size(), setInternalKeyPool.size());
@@ -3992,7 +4661,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
     }
 
     walletInstance->m_last_block_processed = chainActive.Tip();
-    RegisterValidationInterface(walletInstance);
+    RegisterValidationInterface(walletInstance, "wallet " + walletInstance->GetName());
 
     if (chainActive.Tip() && chainActive.Tip() != pindexRescan)
     {
@@ -4080,7 +4749,7 @@ void CWallet::postInitProcess(CScheduler& scheduler)
 
     // Run a thread to flush wallet periodically
     if (!CWallet::fFlushScheduled.exchange(true)) {
-        scheduler.scheduleEvery(MaybeCompactWalletDB, 500);
+        scheduler.scheduleEvery(MaybeCompactWalletDB, 500, CScheduler::Priority::LOW, "compactwallet");
     }
 }
 
@@ -8,6 +8,7 @@
 
 #include <amount.h>
 #include <policy/feerate.h>
+#include <random.h>
 #include <streams.h>
 #include <tinyformat.h>
 #include <ui_interface.h>
@@ -27,6 +28,7 @@
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -66,6 +68,16 @@ static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 static const bool DEFAULT_WALLET_RBF = false;
 static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
+//! -rescanthreads default (0 = one per core)
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of threads reading blocks during a rescan
+static const int MAX_RESCAN_THREADS = 16;
+//! Number of blocks read ahead and filtered per rescan batch
+static const size_t RESCAN_BATCH_SIZE = 64;
+//! Maximum number of threads deriving HD keys for a keypool top-up
+static const int MAX_KEYPOOL_THREADS = 16;
+//! Number of keys written per database transaction during a keypool top-up
+static const unsigned int KEYPOOL_COMMIT_BATCH_SIZE = 1000;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -191,6 +203,39 @@ static inline void WriteOrderPos(const int64_t& nOrderPos, mapValue_t& mapValue)
     mapValue["n"] = i64tostr(nOrderPos);
 }
 
+/** Wallet balances split by trust and maturity, see CWallet::GetBalances */
+struct CWalletBalance
+{
+    CAmount m_mine_trusted{0};                 //!< Trusted available credit
+    CAmount m_mine_untrusted_pending{0};       //!< Untrusted available credit in the mempool
+    CAmount m_mine_immature{0};                //!< Immature coinbase credit
+    CAmount m_watchonly_trusted{0};
+    CAmount m_watchonly_untrusted_pending{0};
+    CAmount m_watchonly_immature{0};
+
+    CWalletBalance& operator+=(const CWalletBalance& other)
+    {
+        m_mine_trusted += other.m_mine_trusted;
+        m_mine_untrusted_pending += other.m_mine_untrusted_pending;
+        m_mine_immature += other.m_mine_immature;
+        m_watchonly_trusted += other.m_watchonly_trusted;
+        m_watchonly_untrusted_pending += other.m_watchonly_untrusted_pending;
+        m_watchonly_immature += other.m_watchonly_immature;
+        return *this;
+    }
+
+    CWalletBalance& operator-=(const CWalletBalance& other)
+    {
+        m_mine_trusted -= other.m_mine_trusted;
+        m_mine_untrusted_pending -= other.m_mine_untrusted_pending;
+        m_mine_immature -= other.m_mine_immature;
+        m_watchonly_trusted -= other.m_watchonly_trusted;
+        m_watchonly_untrusted_pending -= other.m_watchonly_untrusted_pending;
+        m_watchonly_immature -= other.m_watchonly_immature;
+        return *this;
+    }
+};
+
 struct COutputEntry
 {
     CTxDestination destination;
@@ -349,6 +394,11 @@ public:
     mutable CAmount nImmatureWatchCreditCached;
     mutable CAmount nAvailableWatchCreditCached;
     mutable CAmount nChangeCached;
+    //! This transaction's share of the wallet's maintained balances (see CWallet::GetBalances)
+    mutable CWalletBalance m_balance_contribution;
+    mutable int m_balance_depth;
+    //! Key of this transaction in CWallet::m_txs_by_height
+    mutable int m_index_height;
 
     CWalletTx()
     {
@@ -389,6 +439,9 @@ public:
         nAvailableWatchCreditCached = 0;
         nImmatureWatchCreditCached = 0;
         nChangeCached = 0;
+        m_balance_contribution = CWalletBalance();
+        m_balance_depth = 0;
+        m_index_height = -1;
         nOrderPos = -1;
     }
 
@@ -436,18 +489,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    void MarkDirty() const;
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -674,13 +716,26 @@ private:
     std::mutex mutexScanning;
     friend class WalletRescanReserver;
 
+    /**
+     * Set when grouped writes from chain notifications or a rescan failed to
+     * commit. The best block is then no longer recorded, so the blocks whose
+     * transactions are missing from disk get rescanned at the next start.
+     */
+    std::atomic<bool> m_rescan_required{false};
+    void GroupCommitFailed(const char* context);
+
+    //! Whether an import session is open, when it was opened, and the earliest time its imports need rescanning from
+    bool m_import_session = false;
+    int64_t m_import_session_start = 0;
+    int64_t m_import_rescan_time = std::numeric_limits<int64_t>::max();
+
 
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
      * all coins from coinControl are selected; Never select unconfirmed coins
      * if they are not ours
      */
-    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr) const;
+    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr, const CAmount& nMaxExcess = 0) const;
 
     CWalletDB *pwalletdbEncryption;
 
@@ -716,9 +771,19 @@ private:
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
+    /* HD derive the key of the internal or external chain (m/0'/1' or m/0'/0') */
+    void DeriveChainKey(CExtKey& chainChildKey, bool internal);
+
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal = false);
 
+    /* Generate nCount new keys into vPubKeys, deriving HD keys on several threads.
+     * On failure vPubKeys holds the keys that were already added. */
+    void GenerateNewKeys(CWalletDB& walletdb, bool internal, size_t nCount, std::vector<CPubKey>& vPubKeys);
+
+    /* Forget keys whose database writes were not committed */
+    void ForgetUncommittedKeys(const std::vector<CPubKey>& vPubKeys);
+
     std::set<int64_t> setInternalKeyPool;
     std::set<int64_t> setExternalKeyPool;
     int64_t m_max_keypool_index;
@@ -737,6 +802,62 @@ private:
      */
     bool AddWatchOnly(const CScript& dest) override;
 
+    /**
+     * Salted hashes of every scriptPubKey IsMine could match for the keys,
+     * scripts and watch-only entries in the keystore, so IsMine(CTxOut) can
+     * answer the common "not mine" case for standard outputs with a single
+     * probe. Entries are never removed (a stale entry only costs a full
+     * IsMine check). Protected by cs_KeyStore.
+     */
+    std::unordered_set<uint64_t> m_script_pub_key_hashes;
+    const uint64_t m_script_pub_key_k0{GetRand(std::numeric_limits<uint64_t>::max())};
+    const uint64_t m_script_pub_key_k1{GetRand(std::numeric_limits<uint64_t>::max())};
+
+    uint64_t GetScriptPubKeyHash(const unsigned char* pbegin, const unsigned char* pend) const;
+    void LearnScriptPubKey(const CScript& script);
+    void LearnScriptPubKeysForKey(const CPubKey& pubkey);
+    void LearnScriptPubKeysForScript(const CScript& script);
+
+    /**
+     * Balances maintained incrementally from the per-transaction
+     * contributions in CWalletTx::m_balance_contribution. Transactions are
+     * queued for recomputation by CWalletTx::MarkDirty. Unconfirmed ones
+     * are recomputed on every query, and the ones whose contribution still
+     * depends on the chain height (conflicted, or coinbases that are not
+     * yet mature) whenever the tip changes, along with recent coinbases
+     * when the chain gets shorter. Protected by cs_wallet.
+     */
+    mutable CWalletBalance m_balance;
+    mutable std::set<uint256> m_balance_dirty;
+    mutable std::set<uint256> m_balance_pending;
+    mutable std::set<uint256> m_balance_unsettled;
+    mutable const CBlockIndex* m_balance_tip = nullptr;
+
+    /**
+     * Outputs of wallet transactions that were ours and unspent when the
+     * transaction was last synced, in outpoint (i.e. mapWallet) order.
+     * Maintained from the same dirty queue as the balances so AvailableCoins
+     * only visits candidate outputs instead of every output in mapWallet.
+     * Protected by cs_wallet.
+     */
+    mutable std::set<COutPoint> m_unspent_outputs;
+
+    /**
+     * Wallet transactions keyed by the height of the active chain block
+     * they were confirmed in, or -1 for transactions that are unconfirmed,
+     * conflicted or only confirmed in a block that is no longer part of the
+     * active chain. Maintained from the same dirty queue as the balances.
+     * Protected by cs_wallet.
+     */
+    mutable std::set<std::pair<int, uint256>> m_txs_by_height;
+
+    void UpdateBalanceContribution(const CWalletTx& wtx) const;
+    void UpdateUnspentOutputs(const CWalletTx& wtx) const;
+    void UpdateHeightIndex(const CWalletTx& wtx) const;
+    //! Bring the balances and unspent outputs up to date for all queued transactions
+    void SyncDirtyTransactions() const;
+    void RemoveCachedTxState(const CWalletTx& wtx);
+
     std::unique_ptr<CWalletDBWrapper> dbw;
 
     /**
@@ -863,9 +984,11 @@ public:
      * Shuffle and select coins until nTargetValue is reached while avoiding
      * small change; This method is stochastic for some inputs and upon
      * completion the coin set and corresponding actual target value is
-     * assembled
+     * assembled. If nMaxExcess is set, a branch and bound search for a set
+     * worth less than nTargetValue + nMaxExcess (i.e. one that needs no
+     * change output) is tried first.
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CAmount& nMaxExcess = 0) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
@@ -891,7 +1014,7 @@ public:
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey) override;
     bool AddKeyPubKeyWithDB(CWalletDB &walletdb,const CKey& key, const CPubKey &pubkey);
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
-    bool LoadKey(const CKey& key, const CPubKey &pubkey) { return CCryptoKeyStore::AddKeyPubKey(key, pubkey); }
+    bool LoadKey(const CKey& key, const CPubKey &pubkey);
     //! Load metadata (used by LoadWallet)
     bool LoadKeyMetadata(const CKeyID& keyID, const CKeyMetadata &metadata);
     bool LoadScriptMetadata(const CScriptID& script_id, const CKeyMetadata &metadata);
@@ -950,12 +1073,36 @@ public:
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
     bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
     int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update);
+    /**
+     * While an import session is open, imports record the time their rescan
+     * would start from with DeferImportRescan() instead of rescanning.
+     * EndImportSession() returns the earliest such time (or the maximum
+     * int64_t if none was recorded) so a single rescan can cover them all.
+     * AbortImportSession() closes the session without rescanning, e.g. for
+     * one left open by a client that went away.
+     */
+    bool BeginImportSession();
+    bool IsImportSessionOpen() const;
+    bool DeferImportRescan(int64_t startTime);
+    bool EndImportSession(int64_t& startTimeRet);
+    bool AbortImportSession();
+    //! If a session is open, return when it was opened and its earliest deferred rescan time
+    bool GetImportSession(int64_t& startedRet, int64_t& rescanTimeRet) const;
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver& reserver, bool fUpdate = false);
     void TransactionRemovedFromMempool(const CTransactionRef &ptx) override;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     // ResendWalletTransactionsBefore may only be called if fBroadcastTransactions!
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
+    CWalletBalance GetBalances() const;
+    /**
+     * Return the wallet transactions that are confirmed in the active chain
+     * above nHeight, in block height order, followed by the ones that are not
+     * confirmed in the active chain at all.
+     */
+    std::vector<const CWalletTx*> GetTransactionsAboveHeight(int nHeight) const;
+    //! Queue a transaction for recomputation of its balance contribution
+    void MarkBalanceDirty(const uint256& hash) const;
     CAmount GetBalance() const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
@@ -1019,6 +1166,9 @@ public:
      */
     CAmount GetDebit(const CTxIn& txin, const isminefilter& filter) const;
     isminetype IsMine(const CTxOut& txout) const;
+    /** Cheap pre-check for IsMine on a serialized scriptPubKey; false means it is not ours */
+    bool MayBeMine(const unsigned char* pbegin, const unsigned char* pend) const;
+    bool MayBeMine(const CScript& scriptPubKey) const { return MayBeMine(scriptPubKey.data(), scriptPubKey.data() + scriptPubKey.size()); }
     CAmount GetCredit(const CTxOut& txout, const isminefilter& filter) const;
     bool IsChange(const CTxOut& txout) const;
     CAmount GetChange(const CTxOut& txout) const;
@@ -1031,6 +1181,8 @@ public:
     CAmount GetCredit(const CTransaction& tx, const isminefilter& filter) const;
     CAmount GetChange(const CTransaction& tx) const;
     void SetBestChain(const CBlockLocator& loc) override;
+    //! Whether wallet writes failed and the next start must rescan
+    bool IsRescanRequired() const { return m_rescan_required; }
 
     DBErrors LoadWallet(bool& fFirstRunRet);
     DBErrors ZapWalletTx(std::vector<CWalletTx>& vWtx);
@@ -12,6 +12,7 @@
 #include <protocol.h>
 #include <serialize.h>
 #include <sync.h>
+#include <threadpool.h>
 #include <util.h>
 #include <utiltime.h>
 #include <wallet/wallet.h>
@@ -20,6 +21,11 @@
 
 #include <boost/thread.hpp>
 
+//! Number of records read and decoded per batch while loading a wallet
+static const size_t WALLET_LOAD_BATCH_SIZE = 1024;
+//! Maximum number of threads decoding records while loading a wallet
+static const int MAX_WALLET_LOAD_THREADS = 16;
+
 //
 // CWalletDB
 //
@@ -240,6 +246,115 @@ public:
     }
 };
 
+static bool DecodeTx(CDataStream& ssKey, CDataStream& ssValue, uint256& hash, CWalletTx& wtx, bool& fUpgraded, std::string& strErr)
+{
+    ssKey >> hash;
+    ssValue >> wtx;
+    CValidationState state;
+    if (!(CheckTransaction(*wtx.tx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+        return false;
+
+    // Undo serialize changes in 31600
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgraded = true;
+    }
+    return true;
+}
+
+static void LoadTx(CWallet* pwallet, CWalletScanState& wss, const uint256& hash, const CWalletTx& wtx, bool fUpgraded)
+{
+    if (fUpgraded)
+        wss.vWalletUpgrade.push_back(hash);
+
+    if (wtx.nOrderPos == -1)
+        wss.fAnyUnordered = true;
+
+    pwallet->LoadToWallet(wtx);
+}
+
+static bool DecodeKey(const std::string& strType, CDataStream& ssKey, CDataStream& ssValue, CPubKey& vchPubKey, CKey& key, std::string& strErr)
+{
+    ssKey >> vchPubKey;
+    if (!vchPubKey.IsValid())
+    {
+        strErr = "Error reading wallet database: CPubKey corrupt";
+        return false;
+    }
+    CPrivKey pkey;
+    uint256 hash;
+
+    if (strType == "key")
+    {
+        ssValue >> pkey;
+    } else {
+        CWalletKey wkey;
+        ssValue >> wkey;
+        pkey = wkey.vchPrivKey;
+    }
+
+    // Old wallets store keys as "key" [pubkey] => [privkey]
+    // ... which was slow for wallets with lots of keys, because the public key is re-derived from the private key
+    // using EC operations as a checksum.
+    // Newer wallets store keys as "key"[pubkey] => [privkey][hash(pubkey,privkey)], which is much faster while
+    // remaining backwards-compatible.
+    try
+    {
+        ssValue >> hash;
+    }
+    catch (...) {}
+
+    bool fSkipCheck = false;
+
+    if (!hash.IsNull())
+    {
+        // hash pubkey/privkey to accelerate wallet load
+        std::vector<unsigned char> vchKey;
+        vchKey.reserve(vchPubKey.size() + pkey.size());
+        vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
+        vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
+
+        if (Hash(vchKey.begin(), vchKey.end()) != hash)
+        {
+            strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
+            return false;
+        }
+
+        fSkipCheck = true;
+    }
+
+    if (!key.Load(pkey, vchPubKey, fSkipCheck))
+    {
+        strErr = "Error reading wallet database: CPrivKey corrupt";
+        return false;
+    }
+    return true;
+}
+
+static bool LoadKey(CWallet* pwallet, const CKey& key, const CPubKey& vchPubKey, std::string& strErr)
+{
+    if (!pwallet->LoadKey(key, vchPubKey))
+    {
+        strErr = "Error reading wallet database: LoadKey failed";
+        return false;
+    }
+    return true;
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, std::string& strType, std::string& strErr)
@@ -264,37 +379,11 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         else if (strType == "tx")
         {
             uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(*wtx.tx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+            bool fUpgraded = false;
+            if (!DecodeTx(ssKey, ssValue, hash, wtx, fUpgraded, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->LoadToWallet(wtx);
+            LoadTx(pwallet, wss, hash, wtx, fUpgraded);
         }
         else if (strType == "acentry")
         {
@@ -326,67 +415,14 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "key" || strType == "wkey")
         {
-            CPubKey vchPubKey;
-            ssKey >> vchPubKey;
-            if (!vchPubKey.IsValid())
-            {
-                strErr = "Error reading wallet database: CPubKey corrupt";
-                return false;
-            }
-            CKey key;
-            CPrivKey pkey;
-            uint256 hash;
-
             if (strType == "key")
-            {
                 wss.nKeys++;
-                ssValue >> pkey;
-            } else {
-                CWalletKey wkey;
-                ssValue >> wkey;
-                pkey = wkey.vchPrivKey;
-            }
-
-            // Old wallets store keys as "key" [pubkey] => [privkey]
-            // ... which was slow for wallets with lots of keys, because the public key is re-derived from the private key
-            // using EC operations as a checksum.
-            // Newer wallets store keys as "key"[pubkey] => [privkey][hash(pubkey,privkey)], which is much faster while
-            // remaining backwards-compatible.
-            try
-            {
-                ssValue >> hash;
-            }
-            catch (...) {}
-
-            bool fSkipCheck = false;
-
-            if (!hash.IsNull())
-            {
-                // hash pubkey/privkey to accelerate wallet load
-                std::vector<unsigned char> vchKey;
-                vchKey.reserve(vchPubKey.size() + pkey.size());
-                vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
-                vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
-
-                if (Hash(vchKey.begin(), vchKey.end()) != hash)
-                {
-                    strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
-                    return false;
-                }
-
-                fSkipCheck = true;
-            }
-
-            if (!key.Load(pkey, vchPubKey, fSkipCheck))
-            {
-                strErr = "Error reading wallet database: CPrivKey corrupt";
+            CPubKey vchPubKey;
+            CKey key;
+            if (!DecodeKey(strType, ssKey, ssValue, vchPubKey, key, strErr))
                 return false;
-            }
-            if (!pwallet->LoadKey(key, vchPubKey))
-            {
-                strErr = "Error reading wallet database: LoadKey failed";
+            if (!LoadKey(pwallet, key, vchPubKey, strErr))
                 return false;
-            }
         }
         else if (strType == "mkey")
         {
@@ -512,6 +548,73 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
     return true;
 }
 
+/** A record read by CWalletDB::LoadWallet(). Transactions and plaintext
+ * keys, which dominate the load time of large wallets, are decoded and
+ * checked by DecodeRecord() on worker threads; LoadRecord() then loads the
+ * records into the wallet in database order.
+ */
+struct CWalletRecord
+{
+    CDataStream ssKey{SER_DISK, CLIENT_VERSION};
+    CDataStream ssValue{SER_DISK, CLIENT_VERSION};
+
+    //! Set if DecodeRecord() consumed the streams into the fields below
+    bool fDecoded = false;
+    bool fDecodeOK = false;
+    std::string strType;
+    std::string strErr;
+    // "tx"
+    uint256 hash;
+    CWalletTx wtx;
+    bool fUpgraded = false;
+    // "key" and "wkey"
+    CPubKey vchPubKey;
+    CKey key;
+};
+
+static void DecodeRecord(CWalletRecord& record)
+{
+    try {
+        std::string strType;
+        CDataStream ssType(record.ssKey);
+        ssType >> strType;
+        if (strType != "tx" && strType != "key" && strType != "wkey")
+            return;
+        record.fDecoded = true;
+        record.strType = strType;
+        record.ssKey >> strType;
+        if (strType == "tx") {
+            record.fDecodeOK = DecodeTx(record.ssKey, record.ssValue, record.hash, record.wtx, record.fUpgraded, record.strErr);
+        } else {
+            record.fDecodeOK = DecodeKey(strType, record.ssKey, record.ssValue, record.vchPubKey, record.key, record.strErr);
+        }
+    } catch (...) {
+        record.fDecodeOK = false;
+    }
+}
+
+static bool LoadRecord(CWallet* pwallet, CWalletRecord& record, CWalletScanState& wss, std::string& strType, std::string& strErr)
+{
+    if (!record.fDecoded)
+        return ReadKeyValue(pwallet, record.ssKey, record.ssValue, wss, strType, strErr);
+
+    strType = record.strType;
+    strErr = record.strErr;
+    if (strType == "key")
+        wss.nKeys++;
+    if (!record.fDecodeOK)
+        return false;
+    try {
+        if (strType == "tx") {
+            LoadTx(pwallet, wss, record.hash, record.wtx, record.fUpgraded);
+            return true;
+        }
+        return LoadKey(pwallet, record.key, record.vchPubKey, strErr);
+    } catch (...) {
+        return false;
+    }
+}
+
 bool CWalletDB::IsKeyType(const std::string& strType)
 {
     return (strType== "key" || strType == "wkey" ||
@@ -542,39 +645,56 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
-        while (true)
+        const int nThreads = std::max(1, std::min(GetNumCores(), MAX_WALLET_LOAD_THREADS));
+        std::vector<CWalletRecord> vRecords;
+        vRecords.reserve(WALLET_LOAD_BATCH_SIZE);
+        bool fDone = false;
+        while (!fDone)
         {
-            // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = batch.ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND)
-                break;
-            else if (ret != 0)
+            // Read next batch of records
+            vRecords.clear();
+            while (vRecords.size() < WALLET_LOAD_BATCH_SIZE)
             {
-                LogPrintf("Error reading next record from wallet database\n");
-                return DB_CORRUPT;
+                vRecords.emplace_back();
+                int ret = batch.ReadAtCursor(pcursor, vRecords.back().ssKey, vRecords.back().ssValue);
+                if (ret == DB_NOTFOUND)
+                {
+                    vRecords.pop_back();
+                    fDone = true;
+                    break;
+                }
+                else if (ret != 0)
+                {
+                    LogPrintf("Error reading next record from wallet database\n");
+                    return DB_CORRUPT;
+                }
             }
 
-            // Try to be tolerant of single corrupt records:
-            std::string strType, strErr;
-            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
+            // Decode in parallel
+            ParallelFor(vRecords.size(), nThreads, [&](size_t i) { DecodeRecord(vRecords[i]); });
+
+            for (CWalletRecord& record : vRecords)
             {
-                // losing keys is considered a catastrophic error, anything else
-                // we assume the user can live with:
-                if (IsKeyType(strType) || strType == "defaultkey")
-                    result = DB_CORRUPT;
-                else
+                // Try to be tolerant of single corrupt records:
+                std::string strType, strErr;
+                if (!LoadRecord(pwallet, record, wss, strType, strErr))
                 {
-                    // Leave other errors alone, if we try to fix them we might make things worse.
-                    fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
-                    if (strType == "tx")
-                        // Rescan if there is a bad transaction record:
-                        gArgs.SoftSetBoolArg("-rescan", true);
+                    // losing keys is considered a catastrophic error, anything else
+                    // we assume the user can live with:
+                    if (IsKeyType(strType) || strType == "defaultkey")
+                        result = DB_CORRUPT;
+                    else
+                    {
+                        // Leave other errors alone, if we try to fix them we might make things worse.
+                        fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
+                        if (strType == "tx")
+                            // Rescan if there is a bad transaction record:
+                            gArgs.SoftSetBoolArg("-rescan", true);
+                    }
                 }
+                if (!strErr.empty())
+                    LogPrintf("%s\n", strErr);
             }
-            if (!strErr.empty())
-                LogPrintf("%s\n", strErr);
         }
         pcursor->close();
     }
@@ -738,6 +858,20 @@ DBErrors CWalletDB::ZapWalletTx(std::vector<CWalletTx>& vWtx)
     return DB_LOAD_OK;
 }
 
+bool CWalletDBGroupCommit::Commit()
+{
+    if (!m_active) {
+        // No group was started; the writes were committed one by one
+        return true;
+    }
+    m_active = false;
+    if (!m_dbw.EndGroupCommit(true)) {
+        LogPrintf("%s: writes to %s could not be committed\n", __func__, m_dbw.GetName());
+        return false;
+    }
+    return true;
+}
+
 void MaybeCompactWalletDB()
 {
     static std::atomic<bool> fOneThread(false);
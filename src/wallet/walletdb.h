@@ -248,6 +248,34 @@ private:
     CWalletDBWrapper& m_dbw;
 };
 
+/** RAII scope grouping the writes this thread makes to a wallet database
+ * into a single transaction. Writers on other threads wait for the commit,
+ * so only open one while holding the wallet lock, and keep it short.
+ *
+ * The writes of the scope only count once Commit() returns; the outermost
+ * scope commits the transaction there. A scope left without Commit(), for
+ * example by an exception, discards the writes of the whole group.
+ */
+class CWalletDBGroupCommit
+{
+public:
+    explicit CWalletDBGroupCommit(CWalletDBWrapper& dbw) : m_dbw(dbw), m_active(dbw.BeginGroupCommit()) {}
+    ~CWalletDBGroupCommit()
+    {
+        if (m_active) m_dbw.EndGroupCommit(false);
+    }
+
+    /** End the scope. Returns false if the group's writes are not stored. */
+    bool Commit();
+
+    CWalletDBGroupCommit(const CWalletDBGroupCommit&) = delete;
+    CWalletDBGroupCommit& operator=(const CWalletDBGroupCommit&) = delete;
+
+private:
+    CWalletDBWrapper& m_dbw;
+    bool m_active;
+};
+
 //! Compacts BDB state so that wallet.dat is self-contained (if there are changes)
 void MaybeCompactWalletDB();
 
@@ -9,13 +9,14 @@
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+class uint256;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(nullptr) { }
+    CZMQAbstractNotifier() : psocket(nullptr), outbound_message_high_water_mark(-1) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -28,6 +29,12 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetOutboundMessageHighWaterMark() const { return outbound_message_high_water_mark; }
+    void SetOutboundMessageHighWaterMark(const int sndhwm) {
+        if (sndhwm >= 0) {
+            outbound_message_high_water_mark = sndhwm;
+        }
+    }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
@@ -35,10 +42,20 @@ public:
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
 
+    // Mempool and chain events for notifiers that mirror the mempool
+    virtual bool NotifyTransactionAcceptance(const CTransaction &transaction);
+    virtual bool NotifyTransactionRemoval(const CTransaction &transaction);
+    virtual bool NotifyBlockConnect(const uint256 &hash);
+    virtual bool NotifyBlockDisconnect(const uint256 &hash);
+
+    // Send out anything a notifier holds back for batching
+    virtual bool Flush();
+
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    int outbound_message_high_water_mark; // aka SNDHWM, negative keeps the ZMQ default
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
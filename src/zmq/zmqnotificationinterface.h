@@ -13,6 +13,11 @@
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
+/** Default outbound message high water mark (ZMQ_SNDHWM) of the publishing sockets */
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+/** Default maximum number of events combined into one "sequence" message */
+static const int DEFAULT_ZMQ_SEQUENCE_BATCH = 1000;
+
 class CZMQNotificationInterface final : public CValidationInterface
 {
 public:
@@ -26,6 +31,7 @@ protected:
 
     // CValidationInterface
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
@@ -33,8 +39,12 @@ protected:
 private:
     CZMQNotificationInterface();
 
+    void NotifyTransaction(const CTransaction& tx);
+    void FlushNotifiers(bool fForce);
+
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+    bool fFlushQueued;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
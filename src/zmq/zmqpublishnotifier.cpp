@@ -5,6 +5,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <streams.h>
+#include <zmq/zmqnotificationinterface.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
 #include <util.h>
@@ -16,6 +17,10 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_SEQUENCE  = "sequence";
+
+/** Size of one event record in a sequence message: hash, label, LE64 event sequence */
+static const size_t SEQUENCE_EVENT_SIZE = 32 + 1 + sizeof(uint64_t);
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -76,6 +81,17 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
+        LogPrint(BCLog::ZMQ, "zmq: Outbound message high water mark for %s at %s is %d\n", type, address, outbound_message_high_water_mark);
+
+        if (outbound_message_high_water_mark >= 0) {
+            int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &outbound_message_high_water_mark, sizeof(outbound_message_high_water_mark));
+            if (rc != 0) {
+                zmqError("Failed to set outbound message high water mark");
+                zmq_close(psocket);
+                return false;
+            }
+        }
+
         int rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
@@ -195,3 +211,56 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+CZMQPublishSequenceNotifier::CZMQPublishSequenceNotifier() :
+    nEventSequence(0),
+    nMaxBatch(std::max<int64_t>(1, gArgs.GetArg("-zmqpubsequencebatch", DEFAULT_ZMQ_SEQUENCE_BATCH))),
+    nPendingEvents(0)
+{
+}
+
+bool CZMQPublishSequenceNotifier::AddEvent(const uint256 &hash, char label)
+{
+    unsigned char record[SEQUENCE_EVENT_SIZE];
+    for (unsigned int i = 0; i < 32; i++)
+        record[31 - i] = hash.begin()[i];
+    record[32] = label;
+    WriteLE64(&record[33], nEventSequence++);
+    vPending.insert(vPending.end(), record, record + sizeof(record));
+
+    if (++nPendingEvents >= nMaxBatch)
+        return Flush();
+    return true;
+}
+
+bool CZMQPublishSequenceNotifier::Flush()
+{
+    if (nPendingEvents == 0)
+        return true;
+
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence batch of %u events\n", nPendingEvents);
+    bool fSent = SendMessage(MSG_SEQUENCE, vPending.data(), vPending.size());
+    vPending.clear();
+    nPendingEvents = 0;
+    return fSent;
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction)
+{
+    return AddEvent(transaction.GetHash(), 'A');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &transaction)
+{
+    return AddEvent(transaction.GetHash(), 'R');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const uint256 &hash)
+{
+    return AddEvent(hash, 'C');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const uint256 &hash)
+{
+    return AddEvent(hash, 'D');
+}
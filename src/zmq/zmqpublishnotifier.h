@@ -7,6 +7,8 @@
 
 #include <zmq/zmqabstractnotifier.h>
 
+#include <vector>
+
 class CBlockIndex;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
@@ -52,4 +54,34 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+/**
+ * Publishes mempool and chain events, each numbered with a monotonically
+ * increasing event sequence, so that subscribers can mirror the mempool
+ * without polling. Events are fixed size records:
+ *   * 32 byte hash (txid or block hash, in the same byte order as hashtx)
+ *   * 1 byte label: 'A' tx added to mempool, 'R' tx removed from mempool,
+ *     'C' block connected, 'D' block disconnected
+ *   * 8 byte LE event sequence number
+ * Several records may be sent in one message body when events arrive in bursts.
+ */
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+private:
+    uint64_t nEventSequence; //!< upcounting per event sequence number
+    size_t nMaxBatch;        //!< flush once this many events are pending
+    size_t nPendingEvents;
+    std::vector<unsigned char> vPending;
+
+    bool AddEvent(const uint256 &hash, char label);
+
+public:
+    CZMQPublishSequenceNotifier();
+
+    bool NotifyTransactionAcceptance(const CTransaction &transaction) override;
+    bool NotifyTransactionRemoval(const CTransaction &transaction) override;
+    bool NotifyBlockConnect(const uint256 &hash) override;
+    bool NotifyBlockDisconnect(const uint256 &hash) override;
+    bool Flush() override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
@@ -34,6 +34,27 @@ class ZMQSubscriber:
         return body
 
 
+class ZMQSequenceSubscriber(ZMQSubscriber):
+    """Splits batched "sequence" messages into (hash, label, event sequence) records."""
+    def __init__(self, socket, topic):
+        super().__init__(socket, topic)
+        self.event_sequence = 0
+        self.events = []
+
+    def receive_event(self):
+        if not self.events:
+            body = self.receive()
+            assert_equal(len(body) % 41, 0)
+            for i in range(0, len(body), 41):
+                record = body[i:i + 41]
+                self.events.append((bytes_to_hex_str(record[:32]), record[32:33], struct.unpack('<Q', record[33:])[0]))
+        hash, label, event_sequence = self.events.pop(0)
+        # Event sequence should be incremental across batches.
+        assert_equal(event_sequence, self.event_sequence)
+        self.event_sequence += 1
+        return hash, label
+
+
 class ZMQTest (BitcoinTestFramework):
     def set_test_params(self):
         self.num_nodes = 2
@@ -71,7 +92,16 @@ class ZMQTest (BitcoinTestFramework):
         self.rawblock = ZMQSubscriber(socket, b"rawblock")
         self.rawtx = ZMQSubscriber(socket, b"rawtx")
 
-        self.extra_args = [["-zmqpub%s=%s" % (sub.topic.decode(), address) for sub in [self.hashblock, self.hashtx, self.rawblock, self.rawtx]], []]
+        # The sequence topic gets its own socket so that its batching does
+        # not interfere with the publishing order checked above.
+        sequence_address = "tcp://127.0.0.1:28333"
+        sequence_socket = self.zmq_context.socket(zmq.SUB)
+        sequence_socket.set(zmq.RCVTIMEO, 60000)
+        sequence_socket.connect(sequence_address)
+        self.sequence = ZMQSequenceSubscriber(sequence_socket, b"sequence")
+
+        self.extra_args = [["-zmqpub%s=%s" % (sub.topic.decode(), address) for sub in [self.hashblock, self.hashtx, self.rawblock, self.rawtx]] +
+                           ["-zmqpubsequence=%s" % sequence_address, "-zmqpubsequencehwm=10000"], []]
         self.add_nodes(self.num_nodes, self.extra_args)
         self.start_nodes()
 
@@ -110,6 +140,10 @@ class ZMQTest (BitcoinTestFramework):
             block = self.rawblock.receive()
             assert_equal(genhashes[x], bytes_to_hex_str(hash256(block[:80])))
 
+        for x in range(num_blocks):
+            # Should receive a block connect event for every generated block.
+            assert_equal(self.sequence.receive_event(), (genhashes[x], b"C"))
+
         self.log.info("Wait for tx from second node")
         payment_txid = self.nodes[1].sendtoaddress(self.nodes[0].getnewaddress(), 1.0)
         self.sync_all()
@@ -122,5 +156,12 @@ class ZMQTest (BitcoinTestFramework):
         hex = self.rawtx.receive()
         assert_equal(payment_txid, bytes_to_hex_str(hash256(hex)))
 
+        # Should receive a mempool acceptance event for the transaction.
+        assert_equal(self.sequence.receive_event(), (payment_txid, b"A"))
+
+        self.log.info("Mine the transaction and check it leaves the mempool with the block")
+        blockhash = self.nodes[0].generate(1)[0]
+        assert_equal(self.sequence.receive_event(), (blockhash, b"C"))
+
 if __name__ == '__main__':
     ZMQTest().main()
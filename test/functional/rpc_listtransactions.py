@@ -91,9 +91,29 @@ class ListTransactionsTest(BitcoinTestFramework):
         assert_array_result(self.nodes[0].listtransactions("watchonly", 100, 0, True),
                            {"category":"receive","amount":Decimal("0.1")},
                            {"txid":txid, "account" : "watchonly"} )
+
+        self.run_cursor_test()
     # TheHolyRoger has RBF disabled
     #    self.run_rbf_opt_in_test()
 
+    # Check that paging through the history with cursors returns exactly
+    # the same entries as a single call covering all of it.
+    def run_cursor_test(self):
+        node = self.nodes[0]
+        full = node.listtransactions("*", 10000, 0, True)
+        pages = []
+        page = node.listtransactions("*", 2, 0, True, "")
+        while True:
+            assert(len(page["transactions"]) >= 2 or "cursor" not in page)
+            pages = page["transactions"] + pages
+            if "cursor" not in page:
+                break
+            page = node.listtransactions("*", 2, 0, True, page["cursor"])
+        assert_equal(pages, full)
+
+        assert_raises_rpc_error(-8, "Cannot combine skip with cursor", node.listtransactions, "*", 2, 1, True, "")
+        assert_raises_rpc_error(-8, "Invalid cursor", node.listtransactions, "*", 2, 0, True, "abc")
+
     # Check that the opt-in-rbf flag works properly, for sent and received
     # transactions.
     def run_rbf_opt_in_test(self):
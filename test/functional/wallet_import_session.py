@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the importsession RPC.
+
+Imports made while a session is open do not rescan; finishing the session
+rescans once for all of them. Aborting a session closes it without
+rescanning."""
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+
+class ImportSessionTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+
+    def run_test(self):
+        self.nodes[0].generate(101)
+        addresses = [self.nodes[0].getnewaddress() for _ in range(3)]
+        for address in addresses:
+            self.nodes[0].sendtoaddress(address, 1)
+        self.nodes[0].generate(1)
+        self.sync_all()
+
+        node = self.nodes[1]
+        assert_raises_rpc_error(-4, "No import session is open", node.importsession, "finish")
+        assert_raises_rpc_error(-8, "Unknown action", node.importsession, "resume")
+
+        assert_raises_rpc_error(-4, "No import session is open", node.importsession, "abort")
+        assert "import_session" not in node.getwalletinfo()
+
+        self.log.info("Imports in a session do not rescan")
+        node.importsession("start")
+        assert_raises_rpc_error(-4, "An import session is already open", node.importsession, "start")
+        assert "rescan_from" not in node.getwalletinfo()["import_session"]
+        assert_equal(node.importaddress(addresses[0]), {"rescan_deferred": True})
+        assert_equal(node.importpubkey(self.nodes[0].validateaddress(addresses[1])["pubkey"]), {"rescan_deferred": True})
+        assert_equal(node.importprivkey(self.nodes[0].dumpprivkey(addresses[2])), {"rescan_deferred": True})
+        assert_equal(node.getbalance("*", 1, True), 0)
+        assert_equal(node.getwalletinfo()["import_session"]["rescan_from"], 0)
+
+        self.log.info("Finishing the session rescans once for all imports")
+        assert_equal(node.importsession("finish"), {"rescanned": True})
+        assert_equal(node.getbalance("*", 1, True), 3)
+
+        self.log.info("A session without imports needing a rescan does not rescan")
+        node.importsession("start")
+        assert_equal(node.importaddress(self.nodes[0].getnewaddress(), "", False), None)
+        assert_equal(node.importsession("finish"), {"rescanned": False})
+
+        self.log.info("Failed imports do not defer a rescan")
+        node.importsession("start")
+        assert_raises_rpc_error(-5, "Invalid private key encoding", node.importprivkey, "invalid")
+        assert_raises_rpc_error(-5, "Invalid ROGER address or script", node.importaddress, "invalid")
+        result = node.importmulti([{"scriptPubKey": {"address": "invalid"}, "timestamp": 0}])
+        assert not result[0]["success"]
+        assert "rescan_from" not in node.getwalletinfo()["import_session"]
+        assert_equal(node.importsession("finish"), {"rescanned": False})
+
+        self.log.info("Successful importmulti requests report the deferred rescan")
+        node.importsession("start")
+        result = node.importmulti([{"scriptPubKey": {"address": self.nodes[0].getnewaddress()}, "timestamp": "now"}])
+        assert_equal(result, [{"success": True, "rescan_deferred": True}])
+
+        self.log.info("Aborting a session closes it without rescanning")
+        assert_equal(node.importsession("abort"), None)
+        assert "import_session" not in node.getwalletinfo()
+        assert_raises_rpc_error(-4, "No import session is open", node.importsession, "finish")
+
+if __name__ == '__main__':
+    ImportSessionTest().main()